@@ -30,7 +30,6 @@
 #include "seasocks/StringUtil.h"
 
 #include <memory>
-#include <set>
 #include <string>
 
 // Simple chatroom server, showing how one might use authentication.
@@ -40,14 +39,20 @@ using namespace seasocks;
 namespace {
 
 struct Handler : WebSocket::Handler {
-    std::set<WebSocket*> _cons;
+    Server& _server;
+
+    explicit Handler(Server& server)
+            : _server(server) {
+    }
 
     void onConnect(WebSocket* con) override {
-        _cons.insert(con);
+        _server.subscribe(con, "chat");
         send(con->credentials()->username + " has joined");
     }
     void onDisconnect(WebSocket* con) override {
-        _cons.erase(con);
+        // The server would unsubscribe us after this returns anyway, but we
+        // don't want our own departure message.
+        _server.unsubscribe(con, "chat");
         send(con->credentials()->username + " has left");
     }
 
@@ -56,9 +61,7 @@ struct Handler : WebSocket::Handler {
     }
 
     void send(const std::string& msg) {
-        for (auto* con : _cons) {
-            con->send(msg);
-        }
+        _server.publish("chat", msg);
     }
 };
 
@@ -93,7 +96,7 @@ int main(int /*argc*/, const char* /*argv*/[]) {
     }
     Server server(std::make_shared<PrintfLogger>());
     server.addPageHandler(std::make_shared<MyAuthHandler>());
-    server.addWebSocketHandler("/chat", std::make_shared<Handler>());
+    server.addWebSocketHandler("/chat", std::make_shared<Handler>(server));
     server.serve("src/ws_chatroom_web", 9000);
     return 0;
 }
@@ -23,14 +23,21 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include "internal/Base64.h"
+#include "internal/ChunkedDecoder.h"
+#include "internal/ContentEncoding.h"
 #include "internal/Config.h"
+#include "internal/DeflateNegotiation.h"
 #include "internal/Embedded.h"
-#include "internal/HeaderMap.h"
+#include "internal/HeaderScan.h"
 #include "internal/HybiAccept.h"
 #include "internal/HybiPacketDecoder.h"
 #include "internal/LogStream.h"
 #include "internal/PageRequest.h"
+#include "internal/RequestHeaders.h"
 #include "internal/RaiiFd.h"
+#include "internal/StaticFileCache.h"
+#include "internal/Utf8.h"
 
 #include "md5/md5.h"
 
@@ -41,6 +48,7 @@
 #include "seasocks/Server.h"
 #include "seasocks/StringUtil.h"
 #include "seasocks/ToString.h"
+#include "seasocks/RequestBodyHandler.h"
 #include "seasocks/ResponseWriter.h"
 #include "seasocks/ZlibContext.h"
 
@@ -61,12 +69,16 @@
 #include <algorithm>
 #include <cassert>
 #include <cctype>
+#include <charconv>
 #include <cerrno>
+#include <chrono>
 #include <fcntl.h>
 #include <fstream>
+#include <initializer_list>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <random>
 #include <sstream>
 #include <cstdio>
 #include <cstring>
@@ -82,7 +94,7 @@
 
 namespace {
 
-uint32_t parseWebSocketKey(const std::string& key) {
+uint32_t parseWebSocketKey(std::string_view key) {
     uint32_t keyNumber = 0;
     uint32_t numSpaces = 0;
     for (auto c : key) {
@@ -167,6 +179,7 @@ bool isCacheable(const std::string& path) {
 
 constexpr size_t ReadWriteBufferSize = 16 * 1024;
 constexpr size_t MaxWebsocketMessageSize = 16384;
+constexpr size_t MaxCloseReasonLength = 123;
 constexpr size_t MaxHeadersSize = 64 * 1024;
 
 class PrefixWrapper : public seasocks::Logger {
@@ -183,8 +196,51 @@ public:
     }
 };
 
-bool hasConnectionType(const std::string& connection, const std::string& type) {
-    for (auto conType : seasocks::split(connection, ',')) {
+// Sniffs the magic numbers of common formats that are already compressed, and
+// so aren't worth deflating again.
+bool looksCompressed(const uint8_t* data, size_t length) {
+    auto startsWith = [data, length](std::initializer_list<uint8_t> magic) {
+        return length >= magic.size() && std::equal(magic.begin(), magic.end(), data);
+    };
+    return startsWith({0x1f, 0x8b})                    // gzip
+           || startsWith({'P', 'K', 0x03, 0x04})       // zip
+           || startsWith({0x89, 'P', 'N', 'G'})        // PNG
+           || startsWith({0xff, 0xd8, 0xff})           // JPEG
+           || startsWith({'G', 'I', 'F', '8'})         // GIF
+           || startsWith({0x28, 0xb5, 0x2f, 0xfd})     // zstd
+           || startsWith({'B', 'Z', 'h'})              // bzip2
+           || startsWith({0xfd, '7', 'z', 'X', 'Z'})   // xz
+           || (startsWith({'R', 'I', 'F', 'F'}) && length >= 12 && memcmp(data + 8, "WEBP", 4) == 0);
+}
+
+bool isDataFrame(uint8_t opcode) {
+    using Opcode = seasocks::HybiPacketDecoder::Opcode;
+    return opcode == static_cast<uint8_t>(Opcode::Text) || opcode == static_cast<uint8_t>(Opcode::Binary);
+}
+
+// The total size of the hybi frame starting at frame, which must hold at
+// least the frame's whole header.
+size_t hybiFrameSize(const uint8_t* frame) {
+    size_t headerLength = 2;
+    uint64_t payloadLength = frame[1] & 0x7f;
+    if (payloadLength == 126) {
+        payloadLength = (frame[2] << 8) | frame[3];
+        headerLength += 2;
+    } else if (payloadLength == 127) {
+        payloadLength = 0;
+        for (int i = 0; i < 8; ++i) {
+            payloadLength = (payloadLength << 8) | frame[2 + i];
+        }
+        headerLength += 8;
+    }
+    if (frame[1] & 0x80) {
+        headerLength += 4;
+    }
+    return headerLength + payloadLength;
+}
+
+bool hasConnectionType(std::string_view connection, const std::string& type) {
+    for (auto conType : seasocks::split(std::string(connection), ',')) {
         while (!conType.empty() && isspace(conType[0]))
             conType = conType.substr(1);
         if (seasocks::caseInsensitiveSame(conType, type))
@@ -193,6 +249,24 @@ bool hasConnectionType(const std::string& connection, const std::string& type) {
     return false;
 }
 
+// Splits the block held by headers into names and values, in place.
+bool parseHeaderBlock(seasocks::RequestHeaders& headers) {
+    uint8_t* first = headers.block();
+    uint8_t* last = first + headers.blockSize();
+    while (first < last) {
+        char* colonPos = nullptr;
+        char* headerLine = extractLine(first, last, &colonPos);
+        assert(headerLine != nullptr);
+        if (colonPos == nullptr) {
+            return false;
+        }
+        *colonPos = 0;
+        const char* value = seasocks::skipWhitespace(colonPos + 1);
+        headers.add(std::string_view(headerLine, static_cast<size_t>(colonPos - headerLine)), value);
+    }
+    return true;
+}
+
 } // namespace
 
 namespace seasocks {
@@ -215,6 +289,10 @@ struct Connection::Writer : ResponseWriter {
         if (_connection)
             _connection->header(header, value);
     }
+    void header(const std::string& header, size_t value) override {
+        if (_connection)
+            _connection->header(header, value);
+    }
     void payload(const void* data, size_t size, bool flush) override {
         if (_connection)
             _connection->payload(data, size, flush);
@@ -233,6 +311,26 @@ struct Connection::Writer : ResponseWriter {
     }
 };
 
+struct Connection::BodyFlow : RequestBodyHandler::Flow {
+    Connection* _connection;
+    explicit BodyFlow(Connection& connection)
+            : _connection(&connection) {
+    }
+
+    void detach() {
+        _connection = nullptr;
+    }
+
+    void pause() override {
+        if (_connection)
+            _connection->pauseReading();
+    }
+    void resume() override {
+        if (_connection)
+            _connection->resumeReading();
+    }
+};
+
 Connection::Connection(
     std::shared_ptr<Logger> logger,
     ServerImpl& server,
@@ -258,12 +356,30 @@ Connection::Connection(
 Connection::~Connection() {
     _server.checkThread();
     finalise();
+    if (_deflateState) {
+        _deflateState->connection = nullptr;
+    }
 }
 
 void Connection::close() {
+    close(CloseCode::Normal, "");
+}
+
+void Connection::close(CloseCode code, const std::string& reason) {
     // This is the user-side close requests ONLY! You should Call closeInternal
     _shutdownByUser = true;
-    closeInternal();
+    if (_state != State::HANDLING_HYBI_WEBSOCKET) {
+        closeInternal();
+        return;
+    }
+    if (_closeSent) {
+        return;
+    }
+    _closeCode = code;
+    _closeReason = reason;
+    // Queued data goes out first; we then wait for the client's Close frame,
+    // or for the Server to give up on it.
+    sendClose(code, reason);
 }
 
 void Connection::closeWhenEmpty() {
@@ -286,6 +402,12 @@ void Connection::closeInternal() {
 
 
 void Connection::finalise() {
+    if (_bodyHandler) {
+        _bodyFlow->detach();
+        _bodyFlow.reset();
+        _bodyHandler->onAbort(*_request);
+        _bodyHandler.reset();
+    }
     if (_response) {
         _response->cancel();
         _response.reset();
@@ -293,7 +415,7 @@ void Connection::finalise() {
         _writer.reset();
     }
     if (_webSocketHandler) {
-        _webSocketHandler->onDisconnect(this);
+        _webSocketHandler->onDisconnect(this, _closeCode, _closeReason);
         _webSocketHandler.reset();
     }
     if (_fd != -1) {
@@ -338,7 +460,7 @@ bool Connection::write(const void* data, size_t size, bool flushIt) {
     }
     if (size) {
         ssize_t bytesSent = 0;
-        if (_outBuf.empty() && flushIt) {
+        if (_outBuf.empty() && flushIt && !_corked) {
             // Attempt fast path, send directly.
             bytesSent = safeSend(data, size);
             if (bytesSent == static_cast<int>(size)) {
@@ -367,16 +489,31 @@ bool Connection::write(const void* data, size_t size, bool flushIt) {
     return true;
 }
 
-bool Connection::bufferLine(const char* line) {
-    static const char crlf[] = {'\r', '\n'};
-    if (!write(line, strlen(line), false))
+bool Connection::bufferLine(std::string_view line) {
+    if (!write(line.data(), line.size(), false))
         return false;
-    return write(crlf, 2, false);
+    return write("\r\n", 2, false);
+}
+
+bool Connection::bufferHeader(std::string_view name, std::string_view value) {
+    // Written piecemeal, rather than building a temporary for the whole line.
+    return write(name.data(), name.size(), false)
+           && write(": ", 2, false)
+           && write(value.data(), value.size(), false)
+           && write("\r\n", 2, false);
 }
 
-bool Connection::bufferLine(const std::string& line) {
-    std::string lineAndCrlf = line + "\r\n";
-    return write(lineAndCrlf.c_str(), lineAndCrlf.length(), false);
+bool Connection::bufferHeader(std::string_view name, size_t value) {
+    return write(name.data(), name.size(), false)
+           && write(": ", 2, false)
+           && bufferNumber(value)
+           && write("\r\n", 2, false);
+}
+
+bool Connection::bufferNumber(size_t value) {
+    char digits[20];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    return write(digits, static_cast<size_t>(result.ptr - digits), false);
 }
 
 void Connection::handleDataReadyForRead() {
@@ -401,6 +538,7 @@ void Connection::handleDataReadyForRead() {
     }
     _bytesReceived += result;
     _inBuf.resize(curSize + result);
+    _lastActivity = std::chrono::steady_clock::now();
     handleNewData();
 }
 
@@ -408,18 +546,33 @@ void Connection::handleDataReadyForWrite() {
     if (closed()) {
         return;
     }
-    flush();
+    _lastActivity = std::chrono::steady_clock::now();
+    if (flush()) {
+        sendQueuedMessages(false);
+        if (_state == State::READING_HEADERS && !_inBuf.empty()) {
+            // Pipelined requests may have been waiting for room.
+            handleNewData();
+        }
+    }
 }
 
 bool Connection::flush() {
-    if (_outBuf.empty()) {
+    if (_outBuf.empty() || (_corked && _outBuf.size() < ReadWriteBufferSize)) {
         return true;
     }
-    auto numSent = safeSend(&_outBuf[0], _outBuf.size());
-    if (numSent == -1) {
+    if (!_expiringFrames.empty()) {
+        dropExpiredFrames(std::chrono::steady_clock::now());
+    }
+    if (!_controlBuf.empty() && !flushControlFrames()) {
         return false;
     }
-    _outBuf.erase(_outBuf.begin(), _outBuf.begin() + numSent);
+    if (_controlBuf.empty() && !_outBuf.empty()) {
+        auto numSent = safeSend(&_outBuf[0], _outBuf.size());
+        if (numSent == -1) {
+            return false;
+        }
+        consumeOutBuf(static_cast<size_t>(numSent));
+    }
     if (!_outBuf.empty() && !_registeredForWriteEvents) {
         if (!_server.subscribeToWriteEvents(this)) {
             return false;
@@ -438,15 +591,125 @@ bool Connection::flush() {
     return true;
 }
 
+bool Connection::flushControlFrames() {
+    // Control frames go out at the next frame boundary, so first finish
+    // whatever's partly sent.
+    if (_nextFrameBoundary > 0) {
+        auto numSent = safeSend(&_outBuf[0], _nextFrameBoundary);
+        if (numSent == -1) {
+            return false;
+        }
+        consumeOutBuf(static_cast<size_t>(numSent));
+        if (_nextFrameBoundary > 0) {
+            return true;
+        }
+    }
+    auto numSent = safeSend(_controlBuf.data(), _controlBuf.size());
+    if (numSent == -1) {
+        return false;
+    }
+    _controlBuf.erase(_controlBuf.begin(), _controlBuf.begin() + numSent);
+    return true;
+}
+
+void Connection::consumeOutBuf(size_t numSent) {
+    if (_framing) {
+        while (_nextFrameBoundary < numSent) {
+            _nextFrameBoundary += hybiFrameSize(&_outBuf[_nextFrameBoundary]);
+        }
+        _nextFrameBoundary -= numSent;
+        // Frames that have started going out have to be finished.
+        while (!_expiringFrames.empty() && _expiringFrames.front().offset < numSent) {
+            _expiringFrames.pop_front();
+        }
+        for (auto& frame : _expiringFrames) {
+            frame.offset -= numSent;
+        }
+    }
+    _outBuf.erase(_outBuf.begin(), _outBuf.begin() + static_cast<ptrdiff_t>(numSent));
+}
+
+void Connection::spliceControlFrames() {
+    // With nothing left after the boundary to overtake, the control frames
+    // can simply follow on in _outBuf.
+    if (_controlBuf.empty() || _nextFrameBoundary < _outBuf.size()) {
+        return;
+    }
+    _outBuf.insert(_outBuf.end(), _controlBuf.begin(), _controlBuf.end());
+    _controlBuf.clear();
+}
+
+void Connection::dropExpiredFrames(Deadline now) {
+    // One pass over the buffer: each surviving run of bytes is moved down over
+    // the expired frames before it.
+    auto* data = _outBuf.data();
+    size_t removed = 0;
+    size_t keptFrom = 0;
+    auto kept = _expiringFrames.begin();
+    for (auto& frame : _expiringFrames) {
+        if (frame.deadline > now || frame.offset < _nextFrameBoundary || frame.offset >= _outBuf.size()) {
+            *kept++ = ExpiringFrame{frame.offset - removed, frame.deadline};
+            continue;
+        }
+        auto frameSize = hybiFrameSize(data + frame.offset);
+        memmove(data + keptFrom - removed, data + keptFrom, frame.offset - keptFrom);
+        keptFrom = frame.offset + frameSize;
+        removed += frameSize;
+        ++_messagesExpired;
+        _bytesExpired += frameSize;
+    }
+    if (removed == 0) {
+        return;
+    }
+    _expiringFrames.erase(kept, _expiringFrames.end());
+    memmove(data + keptFrom - removed, data + keptFrom, _outBuf.size() - keptFrom);
+    _outBuf.resize(_outBuf.size() - removed);
+    spliceControlFrames();
+}
+
 bool Connection::closed() const {
     return _fd == -1 || _shutdown;
 }
 
 void Connection::handleNewData() {
+    if (_handlingNewData) {
+        // A response finished while we were dispatching its request; the loop
+        // below picks up anything pipelined behind it.
+        return;
+    }
+    _handlingNewData = true;
+    // Loop rather than recurse: a single read can carry many pipelined
+    // requests. Stop once a pass makes no progress.
+    for (;;) {
+        const auto state = _state;
+        const auto pending = _inBuf.size();
+        handleNewDataForState();
+        if (closed()) {
+            _corked = false;
+            break;
+        }
+        if (_state != state || _inBuf.size() != pending) {
+            continue;
+        }
+        if (!_corked) {
+            break;
+        }
+        // Send the responses to the pipelined requests together. That may
+        // make room to dispatch the rest, so go round again.
+        _corked = false;
+        flush();
+    }
+    _handlingNewData = false;
+}
+
+void Connection::handleNewDataForState() {
     switch (_state) {
         case State::READING_HEADERS:
             handleHeaders();
             break;
+        case State::READING_UPGRADE_RESPONSE:
+            handleUpgradeResponse();
+            break;
         case State::READING_WEBSOCKET_KEY3:
             handleWebSocketKey3();
             break;
@@ -459,6 +722,9 @@ void Connection::handleNewData() {
         case State::BUFFERING_POST_DATA:
             handleBufferingPostData();
             break;
+        case State::STREAMING_REQUEST_BODY:
+            handleStreamingRequestBody();
+            break;
         case State::AWAITING_RESPONSE_BEGIN:
         case State::SENDING_RESPONSE_BODY:
         case State::SENDING_RESPONSE_HEADERS:
@@ -470,26 +736,130 @@ void Connection::handleNewData() {
 }
 
 void Connection::handleHeaders() {
-    if (_inBuf.size() < 4) {
+    if (_closeOnEmpty) {
+        // The last response closes the connection: ignore anything pipelined
+        // after its request.
         return;
     }
-    for (size_t i = 0; i <= _inBuf.size() - 4; ++i) {
-        if (_inBuf[i] == '\r' &&
-            _inBuf[i + 1] == '\n' &&
-            _inBuf[i + 2] == '\r' &&
-            _inBuf[i + 3] == '\n') {
-            if (!processHeaders(&_inBuf[0], &_inBuf[i + 2])) {
-                closeInternal();
-                return;
-            }
-            _inBuf.erase(_inBuf.begin(), _inBuf.begin() + i + 4);
-            handleNewData();
-            return;
+    if (_outBuf.size() >= ReadWriteBufferSize) {
+        // Don't pile pipelined responses on top of ones the client isn't
+        // reading; handleDataReadyForWrite() carries on once they drain.
+        return;
+    }
+    auto end = findHeaderTerminator(_inBuf.data(), _inBuf.size(), _headerBytesSearched);
+    if (end == NoHeaderTerminator) {
+        _headerBytesSearched = _inBuf.size();
+        if (_inBuf.size() > MaxHeadersSize) {
+            sendUnsupportedError("Headers too big");
+        }
+        return;
+    }
+    _headerBytesSearched = 0;
+    if (_inBuf.size() > end + 4) {
+        // More has arrived behind this request, most likely further pipelined
+        // requests: hold on to the response and send it along with theirs.
+        _corked = true;
+    }
+    if (!processHeaders(&_inBuf[0], &_inBuf[end + 2])) {
+        closeInternal();
+        return;
+    }
+    _inBuf.erase(_inBuf.begin(), _inBuf.begin() + static_cast<ptrdiff_t>(end) + 4);
+}
+
+void Connection::startClientHandshake(const std::string& host, const std::string& path,
+                                      std::shared_ptr<WebSocket::Handler> handler) {
+    _client = true;
+    _clientPath = path;
+    _webSocketHandler = handler;
+    std::random_device random;
+    uint8_t key[16];
+    for (auto& byte : key) {
+        byte = static_cast<uint8_t>(random());
+    }
+    _clientKey = base64Encode(key, sizeof(key));
+    _maskState = (static_cast<uint64_t>(random()) << 32) | random() | 1;
+
+    bufferLine("GET " + path + " HTTP/1.1");
+    bufferHeader("Host", host);
+    bufferLine("Upgrade: websocket");
+    bufferLine("Connection: Upgrade");
+    bufferHeader("Sec-WebSocket-Key", _clientKey);
+    bufferLine("Sec-WebSocket-Version: 13");
+    bufferLine("");
+    _state = State::READING_UPGRADE_RESPONSE;
+    // If we're still connecting this just waits for the socket to become writable.
+    flush();
+}
+
+void Connection::handleUpgradeResponse() {
+    auto end = findHeaderTerminator(_inBuf.data(), _inBuf.size(), _headerBytesSearched);
+    if (end == NoHeaderTerminator) {
+        _headerBytesSearched = _inBuf.size();
+        if (_inBuf.size() > MaxHeadersSize) {
+            LS_WARNING(_logger, "WebSocket upgrade response headers too big");
+            closeInternal();
         }
+        return;
+    }
+    _headerBytesSearched = 0;
+    if (!processUpgradeResponse(&_inBuf[0], &_inBuf[end + 2])) {
+        closeInternal();
+        return;
+    }
+    _inBuf.erase(_inBuf.begin(), _inBuf.begin() + static_cast<ptrdiff_t>(end) + 4);
+}
+
+bool Connection::processUpgradeResponse(uint8_t* first, uint8_t* last) {
+    char* statusLine = extractLine(first, last);
+    assert(statusLine != nullptr);
+    LS_DEBUG(_logger, "Upgrade response: " << statusLine);
+    const char* httpVersion = shift(statusLine);
+    const char* statusCode = shift(statusLine);
+    if (!httpVersion || strcmp(httpVersion, "HTTP/1.1") != 0 || !statusCode || strcmp(statusCode, "101") != 0) {
+        LS_WARNING(_logger, "WebSocket upgrade refused: " << (httpVersion ? httpVersion : "") << " "
+                                                          << (statusCode ? statusCode : "") << " " << statusLine);
+        return false;
+    }
+
+    RequestHeaders headers(first, last);
+    if (!parseHeaderBlock(headers)) {
+        LS_WARNING(_logger, "Malformed header in WebSocket upgrade response");
+        return false;
+    }
+    if (!headers.has(KnownHeader::Upgrade) || !compareCaseInsensitive(headers.get(KnownHeader::Upgrade), "websocket")
+        || !headers.has(KnownHeader::Connection) || !hasConnectionType(headers.get(KnownHeader::Connection), "Upgrade")) {
+        LS_WARNING(_logger, "WebSocket upgrade response is missing its Upgrade or Connection headers");
+        return false;
+    }
+    if (!headers.has(KnownHeader::SecWebSocketAccept) || headers.get(KnownHeader::SecWebSocketAccept) != getAcceptKey(_clientKey)) {
+        LS_WARNING(_logger, "WebSocket upgrade response has the wrong Sec-WebSocket-Accept");
+        return false;
+    }
+    if (headers.has(KnownHeader::SecWebSocketExtensions)) {
+        // We never offer any extensions.
+        LS_WARNING(_logger, "WebSocket upgrade response has unrequested extensions");
+        return false;
     }
-    if (_inBuf.size() > MaxHeadersSize) {
-        sendUnsupportedError("Headers too big");
+
+    _request = std::make_unique<PageRequest>(_address, _clientPath, _server.server(),
+                                             Request::Verb::WebSocket, std::move(headers));
+    _state = State::HANDLING_HYBI_WEBSOCKET;
+    _lastPingSent = std::chrono::steady_clock::now();
+    startFraming();
+    if (_webSocketHandler) {
+        _webSocketHandler->onConnect(this);
     }
+    return true;
+}
+
+uint32_t Connection::nextMask() {
+    // xorshift64*: cheap, and seeded from std::random_device so the masks
+    // aren't predictable to whatever is between us and the server.
+    _maskState ^= _maskState >> 12;
+    _maskState ^= _maskState << 25;
+    _maskState ^= _maskState >> 27;
+    return static_cast<uint32_t>((_maskState * 0x2545f4914f6cdd1dull) >> 32);
 }
 
 void Connection::handleWebSocketKey3() {
@@ -504,8 +874,8 @@ void Connection::handleWebSocketKey3() {
         char key3[WebSocketKeyLen];
     } md5Source;
 
-    auto key1 = parseWebSocketKey(_request->getHeader("Sec-WebSocket-Key1"));
-    auto key2 = parseWebSocketKey(_request->getHeader("Sec-WebSocket-Key2"));
+    auto key1 = parseWebSocketKey(_request->getHeaderView(KnownHeader::SecWebSocketKey1));
+    auto key2 = parseWebSocketKey(_request->getHeaderView(KnownHeader::SecWebSocketKey2));
 
     LS_DEBUG(_logger, "Got a hixie websocket with key1=0x" << std::hex << key1 << ", key2=0x" << key2);
 
@@ -525,11 +895,11 @@ void Connection::handleWebSocketKey3() {
     bufferLine("Upgrade: websocket");
     bufferLine("Connection: Upgrade");
     bool allowCrossOrigin = _server.isCrossOriginAllowed(_request->getRequestUri());
-    if (_request->hasHeader("Origin") && allowCrossOrigin) {
-        bufferLine("Sec-WebSocket-Origin: " + _request->getHeader("Origin"));
+    if (_request->hasHeader(KnownHeader::Origin) && allowCrossOrigin) {
+        bufferHeader("Sec-WebSocket-Origin", _request->getHeaderView(KnownHeader::Origin));
     }
-    if (_request->hasHeader("Host")) {
-        auto host = _request->getHeader("Host");
+    if (_request->hasHeader(KnownHeader::Host)) {
+        auto host = std::string(_request->getHeaderView(KnownHeader::Host));
         if (!allowCrossOrigin) {
             bufferLine("Sec-WebSocket-Origin: http://" + host);
         }
@@ -548,11 +918,10 @@ void Connection::handleWebSocketKey3() {
 }
 
 void Connection::pickProtocol() {
-    static std::string protocolHeader = "Sec-WebSocket-Protocol";
-    if (!_request->hasHeader(protocolHeader) || !_webSocketHandler)
+    if (!_request->hasHeader(KnownHeader::SecWebSocketProtocol) || !_webSocketHandler)
         return;
     // Ideally we need o support this header being set multiple times...but the headers don't support that.
-    auto protocols = split(_request->getHeader(protocolHeader), ',');
+    auto protocols = split(std::string(_request->getHeaderView(KnownHeader::SecWebSocketProtocol)), ',');
     LS_DEBUG(_logger, "Requested protocols:");
     std::transform(protocols.begin(), protocols.end(), protocols.begin(), trimWhitespace);
     for (auto&& p : protocols) {
@@ -561,100 +930,589 @@ void Connection::pickProtocol() {
     auto choice = _webSocketHandler->chooseProtocol(protocols);
     if (choice >= 0 && choice < static_cast<ssize_t>(protocols.size())) {
         LS_DEBUG(_logger, "Chose protocol " + protocols[choice]);
-        bufferLine(protocolHeader + ": " + protocols[choice]);
+        bufferHeader("Sec-WebSocket-Protocol", protocols[choice]);
     }
 }
 
 void Connection::handleBufferingPostData() {
-    if (_request->consumeContent(_inBuf)) {
-        _state = State::READING_HEADERS;
-        if (!handlePageRequest()) {
-            closeInternal();
+    if (_chunkedBody) {
+        size_t consumed = 0;
+        size_t decoded = 0;
+        auto result = _chunkedDecoder->decode(_inBuf.data(), _inBuf.size(), consumed, decoded);
+        if (result == ChunkedDecoder::Result::Error) {
+            discardPostData();
+            sendBadRequest("Malformed chunked body");
+            return;
+        }
+        if (_chunkedContent.size() + decoded > _server.clientBufferSize()) {
+            discardPostData();
+            sendError(ResponseCode::PayloadTooLarge, "Content length too long");
+            return;
+        }
+        _chunkedContent.insert(_chunkedContent.end(), _inBuf.begin(), _inBuf.begin() + static_cast<ptrdiff_t>(decoded));
+        _inBuf.erase(_inBuf.begin(), _inBuf.begin() + static_cast<ptrdiff_t>(consumed));
+        if (result == ChunkedDecoder::Result::NeedMore) {
+            return;
+        }
+        _request->setContent(std::move(_chunkedContent));
+        _chunkedContent.clear();
+    } else if (!_request->consumeContent(_inBuf)) {
+        return;
+    }
+    _state = State::READING_HEADERS;
+    if (!handlePageRequest()) {
+        closeInternal();
+    }
+}
+
+void Connection::discardPostData() {
+    // The error response closes the connection, so nothing more is decoded.
+    _state = State::READING_HEADERS;
+    _inBuf.clear();
+    _chunkedContent.clear();
+}
+
+bool Connection::beginStreamingBody(std::shared_ptr<RequestBodyHandler> handler) {
+    _bodyHandler = std::move(handler);
+    _bodyFlow = std::make_shared<BodyFlow>(*this);
+    _bodyRemaining = _request->contentLength();
+    _state = State::STREAMING_REQUEST_BODY;
+    try {
+        _bodyHandler->onBegin(*_request, _bodyFlow);
+    } catch (const std::exception& e) {
+        LS_ERROR(_logger, "request body error: " << e.what());
+        endStreamingBody();
+        return sendISE(e.what());
+    } catch (...) {
+        LS_ERROR(_logger, "request body error: (unknown)");
+        endStreamingBody();
+        return sendISE("(unknown)");
+    }
+    if (!_chunkedBody && _bodyRemaining == 0) {
+        return finishStreamingBody();
+    }
+    return true;
+}
+
+void Connection::handleStreamingRequestBody() {
+    if (_readingPaused) {
+        return;
+    }
+    size_t consumed = 0;
+    size_t decoded = 0;
+    bool done = false;
+    if (_chunkedBody) {
+        auto result = _chunkedDecoder->decode(_inBuf.data(), _inBuf.size(), consumed, decoded);
+        if (result == ChunkedDecoder::Result::Error) {
+            _inBuf.clear();
+            endStreamingBody();
+            sendBadRequest("Malformed chunked body");
+            return;
+        }
+        done = result == ChunkedDecoder::Result::Done;
+    } else {
+        consumed = decoded = std::min(_bodyRemaining, _inBuf.size());
+        _bodyRemaining -= consumed;
+        done = _bodyRemaining == 0;
+    }
+    if (decoded) {
+        try {
+            _bodyHandler->onBodyData(*_request, _inBuf.data(), decoded);
+        } catch (const std::exception& e) {
+            LS_ERROR(_logger, "request body error: " << e.what());
+            _inBuf.clear();
+            endStreamingBody();
+            sendISE(e.what());
+            return;
+        } catch (...) {
+            LS_ERROR(_logger, "request body error: (unknown)");
+            _inBuf.clear();
+            endStreamingBody();
+            sendISE("(unknown)");
+            return;
         }
     }
+    _inBuf.erase(_inBuf.begin(), _inBuf.begin() + static_cast<ptrdiff_t>(consumed));
+    if (done && !finishStreamingBody()) {
+        closeInternal();
+    }
+}
+
+bool Connection::finishStreamingBody() {
+    auto handler = _bodyHandler;
+    endStreamingBody();
+    std::shared_ptr<Response> response;
+    try {
+        response = handler->onBodyEnd(*_request);
+    } catch (const std::exception& e) {
+        LS_ERROR(_logger, "request body error: " << e.what());
+        return sendISE(e.what());
+    } catch (...) {
+        LS_ERROR(_logger, "request body error: (unknown)");
+        return sendISE("(unknown)");
+    }
+    if (response == Response::unhandled()) {
+        return send404();
+    }
+    return sendResponse(response);
+}
+
+void Connection::endStreamingBody() {
+    _state = State::READING_HEADERS;
+    _bodyFlow->detach();
+    _bodyFlow.reset();
+    _bodyHandler.reset();
+    if (_readingPaused) {
+        resumeReading();
+    }
+}
+
+void Connection::pauseReading() {
+    if (_readingPaused || closed()) {
+        return;
+    }
+    _readingPaused = true;
+    _server.unsubscribeFromReadEvents(this);
+}
+
+void Connection::resumeReading() {
+    if (!_readingPaused) {
+        return;
+    }
+    _readingPaused = false;
+    if (closed()) {
+        return;
+    }
+    _server.subscribeToReadEvents(this);
+    // Carry on with anything read before we paused.
+    if (!_inBuf.empty()) {
+        handleNewData();
+    }
 }
 
 void Connection::send(const char* webSocketResponse) {
+    send(std::string_view(webSocketResponse));
+}
+
+void Connection::send(std::string_view webSocketResponse) {
+    sendText(webSocketResponse, NoDeadline);
+}
+
+void Connection::send(std::string_view webSocketResponse, std::chrono::milliseconds timeToLive) {
+    sendText(webSocketResponse, std::chrono::steady_clock::now() + timeToLive);
+}
+
+void Connection::send(const uint8_t* webSocketResponse, size_t length) {
+    sendBinary(webSocketResponse, length, NoDeadline);
+}
+
+void Connection::send(const uint8_t* webSocketResponse, size_t length, std::chrono::milliseconds timeToLive) {
+    sendBinary(webSocketResponse, length, std::chrono::steady_clock::now() + timeToLive);
+}
+
+void Connection::sendText(std::string_view webSocketResponse, Deadline deadline) {
     _server.checkThread();
-    if (_shutdown) {
+    if (_shutdown || _closeSent) {
         if (_shutdownByUser) {
             LS_ERROR(_logger, "Server wrote to connection after closing it");
         }
         return;
     }
-    auto messageLength = strlen(webSocketResponse);
     if (_state == State::HANDLING_HIXIE_WEBSOCKET) {
         uint8_t zero = 0;
         if (!write(&zero, 1, false))
             return;
-        if (!write(webSocketResponse, messageLength, false))
+        if (!write(webSocketResponse.data(), webSocketResponse.size(), false))
             return;
         uint8_t effeff = 0xff;
         write(&effeff, 1, true);
         return;
     }
     sendHybi(static_cast<uint8_t>(HybiPacketDecoder::Opcode::Text),
-             reinterpret_cast<const uint8_t*>(webSocketResponse), messageLength);
+             reinterpret_cast<const uint8_t*>(webSocketResponse.data()), webSocketResponse.size(), deadline);
 }
 
-void Connection::send(const uint8_t* webSocketResponse, size_t length) {
+void Connection::sendBinary(const uint8_t* webSocketResponse, size_t length, Deadline deadline) {
     _server.checkThread();
-    if (_shutdown) {
+    if (_shutdown || _closeSent) {
         if (_shutdownByUser) {
             LS_ERROR(_logger, "Client wrote to connection after closing it");
         }
         return;
     }
-    if (_state == State::HANDLING_HIXIE_WEBSOCKET) {
-        LS_ERROR(_logger, "Hixie does not support binary");
+    if (_state == State::HANDLING_HIXIE_WEBSOCKET) {
+        LS_ERROR(_logger, "Hixie does not support binary");
+        return;
+    }
+    sendHybi(static_cast<uint8_t>(HybiPacketDecoder::Opcode::Binary), webSocketResponse, length, deadline);
+}
+
+void Connection::sendConflated(const std::string& key, const char* webSocketResponse) {
+    if (_state == State::HANDLING_HIXIE_WEBSOCKET) {
+        send(webSocketResponse);
+        return;
+    }
+    sendConflated(key, static_cast<uint8_t>(HybiPacketDecoder::Opcode::Text),
+                  reinterpret_cast<const uint8_t*>(webSocketResponse), strlen(webSocketResponse));
+}
+
+void Connection::sendConflated(const std::string& key, const uint8_t* webSocketResponse, size_t length) {
+    if (_state == State::HANDLING_HIXIE_WEBSOCKET) {
+        LS_ERROR(_logger, "Hixie does not support binary");
+        return;
+    }
+    sendConflated(key, static_cast<uint8_t>(HybiPacketDecoder::Opcode::Binary), webSocketResponse, length);
+}
+
+void Connection::sendConflated(const std::string& key, uint8_t opcode, const uint8_t* webSocketResponse,
+                               size_t messageLength) {
+    _server.checkThread();
+    if (_shutdown || _closeSent) {
+        if (_shutdownByUser) {
+            LS_ERROR(_logger, "Server wrote to connection after closing it");
+        }
+        return;
+    }
+    if (_outBuf.empty() && _sendQueue.empty() && !_offloadBusy) {
+        // Keeping up: no need to queue anything.
+        writeHybi(opcode, webSocketResponse, messageLength);
+        return;
+    }
+    auto existing = _sendQueueByKey.find(key);
+    if (existing == _sendQueueByKey.end()) {
+        queueMessage(key, opcode, webSocketResponse, messageLength);
+        return;
+    }
+    auto& message = *existing->second;
+    _sendQueueBytes -= message.payload.size();
+    message.opcode = opcode;
+    message.payload.assign(webSocketResponse, webSocketResponse + messageLength);
+    message.deadline = NoDeadline;
+    _sendQueueBytes += messageLength;
+    ++_messagesConflated;
+}
+
+void Connection::queueMessage(const std::string& key, uint8_t opcode, const uint8_t* webSocketResponse,
+                              size_t messageLength, Deadline deadline) {
+    if (_outBuf.size() + _sendQueueBytes + messageLength >= _server.clientBufferSize()) {
+        LS_WARNING(_logger, "Closing connection: queued messages too large ("
+                                << _outBuf.size() + _sendQueueBytes + messageLength << " >= " << _server.clientBufferSize() << ")");
+        closeInternal();
+        return;
+    }
+    _sendQueue.push_back(QueuedMessage{key, opcode, std::vector<uint8_t>(webSocketResponse, webSocketResponse + messageLength), deadline});
+    _sendQueueBytes += messageLength;
+    if (!key.empty()) {
+        _sendQueueByKey[key] = std::prev(_sendQueue.end());
+    }
+}
+
+void Connection::sendQueuedMessages(bool evenIfBackedUp) {
+    Deadline now{};
+    while (!_sendQueue.empty() && !closed() && !_offloadBusy && (evenIfBackedUp || _outBuf.empty())) {
+        auto message = std::move(_sendQueue.front());
+        _sendQueue.pop_front();
+        _sendQueueBytes -= message.payload.size();
+        if (!message.key.empty()) {
+            _sendQueueByKey.erase(message.key);
+        }
+        if (message.deadline != NoDeadline) {
+            if (now == Deadline{}) {
+                now = std::chrono::steady_clock::now();
+            }
+            if (message.deadline <= now) {
+                ++_messagesExpired;
+                _bytesExpired += message.payload.size();
+                continue;
+            }
+        }
+        writeHybi(message.opcode, message.payload.data(), message.payload.size(), message.deadline);
+    }
+}
+
+void Connection::sendHybi(uint8_t opcode, const uint8_t* webSocketResponse, size_t messageLength,
+                          Deadline deadline) {
+    // Nothing may follow our Close frame (RFC 6455 section 5.5.1).
+    if (_closeSent) {
+        return;
+    }
+    if (!isDataFrame(opcode)) {
+        // Pings and pongs go ahead of queued and buffered data, so a client
+        // that's backed up still sees us as alive.
+        sendHybiData(0x80 | opcode, webSocketResponse, messageLength, true);
+        return;
+    }
+    // Keep everything in order behind any queued conflatable messages, or a
+    // message that's being compressed elsewhere.
+    if (!_sendQueue.empty() || _offloadBusy) {
+        queueMessage("", opcode, webSocketResponse, messageLength, deadline);
+        return;
+    }
+    writeHybi(opcode, webSocketResponse, messageLength, deadline);
+}
+
+void Connection::writeHybi(uint8_t opcode, const uint8_t* webSocketResponse, size_t messageLength,
+                           Deadline deadline) {
+    bool mayExpire = deadline != NoDeadline && _framing;
+    // Control frames must never be compressed (RFC 7692 section 6.1). Nor can
+    // a frame we might drop be, if the client's decompressor would need it to
+    // make sense of the next one.
+    bool compress = _perMessageDeflate && isDataFrame(opcode) && shouldCompress(webSocketResponse, messageLength)
+                    && (!mayExpire || _deflateNoContextTakeover);
+    if (compress && shouldOffload(messageLength)) {
+        deflateOffloaded(opcode, webSocketResponse, messageLength, deadline);
+        return;
+    }
+    if (mayExpire) {
+        // The frame starts at the end of the buffer. If it goes straight out
+        // flush() forgets about it again.
+        _expiringFrames.push_back(ExpiringFrame{_outBuf.size(), deadline});
+    }
+    if (compress) {
+        auto& compressed = _deflateBuffer;
+        compressed.clear();
+
+        auto startTime = std::chrono::steady_clock::now();
+        _deflateState->zlib.deflate(webSocketResponse, messageLength, compressed);
+        _compressionStats.timeCompressing += std::chrono::steady_clock::now() - startTime;
+
+        // Without context takeover nothing later depends on this message having
+        // been compressed, so we're free to send the original if it's smaller.
+        if (!_deflateNoContextTakeover || compressed.size() < messageLength) {
+            sendCompressed(opcode, compressed.data(), compressed.size(), messageLength);
+            return;
+        }
+    }
+    sendUncompressed(opcode, webSocketResponse, messageLength);
+}
+
+void Connection::deflateOffloaded(uint8_t opcode, const uint8_t* webSocketResponse, size_t messageLength,
+                                  Deadline deadline) {
+    struct Job {
+        std::vector<uint8_t> input;
+        std::vector<uint8_t> output;
+        std::chrono::nanoseconds timeTaken{0};
+        bool failed = false;
+    };
+    auto job = std::make_shared<Job>();
+    job->input.assign(webSocketResponse, webSocketResponse + messageLength);
+    auto state = _deflateState;
+    _offloadBusy = true;
+    _server.offload(
+        [state, job] {
+            auto startTime = std::chrono::steady_clock::now();
+            try {
+                state->zlib.deflate(job->input.data(), job->input.size(), job->output);
+            } catch (const std::exception&) {
+                job->failed = true;
+            }
+            job->timeTaken = std::chrono::steady_clock::now() - startTime;
+        },
+        [state, job, opcode, deadline] {
+            auto* connection = state->connection;
+            if (!connection) {
+                return;
+            }
+            connection->_offloadBusy = false;
+            connection->_compressionStats.timeCompressing += job->timeTaken;
+            if (job->failed) {
+                LS_ERROR(connection->_logger, "Error deflating message on a worker");
+                connection->closeInternal();
+                return;
+            }
+            if (deadline != NoDeadline && connection->_framing) {
+                connection->_expiringFrames.push_back(ExpiringFrame{connection->_outBuf.size(), deadline});
+            }
+            const auto& compressed = job->output;
+            if (!connection->_deflateNoContextTakeover || compressed.size() < job->input.size()) {
+                connection->sendCompressed(opcode, compressed.data(), compressed.size(), job->input.size());
+            } else {
+                connection->sendUncompressed(opcode, job->input.data(), job->input.size());
+            }
+            connection->resumeAfterOffload();
+        });
+}
+
+void Connection::inflateOffloaded(bool isText, std::vector<uint8_t>& compressed) {
+    struct Job {
+        std::vector<uint8_t> input;
+        std::vector<uint8_t> output;
+        int zlibError = 0;
+        bool succeeded = false;
+    };
+    auto job = std::make_shared<Job>();
+    job->input.swap(compressed);
+    auto state = _deflateState;
+    const auto maxSize = _server.clientBufferSize();
+    _offloadBusy = true;
+    _server.offload(
+        [state, job, maxSize] {
+            try {
+                job->succeeded = state->zlib.inflate(job->input, job->output, job->zlibError, maxSize);
+            } catch (const std::exception&) {
+                job->succeeded = false;
+            }
+        },
+        [state, job, isText] {
+            auto* connection = state->connection;
+            if (!connection) {
+                return;
+            }
+            connection->_offloadBusy = false;
+            if (!job->succeeded) {
+                connection->failInflate(job->zlibError);
+                return;
+            }
+            if (!connection->handleWebSocketDataMessage(isText, job->output.data(), job->output.size())) {
+                return;
+            }
+            connection->deliverReceivedMessages();
+            connection->resumeAfterOffload();
+        });
+}
+
+void Connection::failInflate(int zlibError) {
+    if (zlibError == 0) {
+        LS_WARNING(_logger, "Decompressed message too large");
+        failWebSocket(CloseCode::MessageTooBig, "Message too big");
+        return;
+    }
+    LS_WARNING(_logger, "Decompression error from zlib: " << zlibError);
+    failWebSocket(CloseCode::ProtocolError, "Invalid compressed data");
+}
+
+void Connection::resumeAfterOffload() {
+    if (closed()) {
+        return;
+    }
+    // Anything sent meanwhile, then anything received meanwhile.
+    sendQueuedMessages(false);
+    if (_offloadBusy || _state != State::HANDLING_HYBI_WEBSOCKET) {
         return;
     }
-    sendHybi(static_cast<uint8_t>(HybiPacketDecoder::Opcode::Binary), webSocketResponse, length);
+    if (_readingPaused) {
+        resumeReading();
+    } else {
+        handleHybiWebSocket();
+    }
 }
 
-void Connection::sendHybi(uint8_t opcode, const uint8_t* webSocketResponse, size_t messageLength) {
-    uint8_t firstByte = 0x80 | opcode;
-    if (_perMessageDeflate)
-        firstByte |= 0x40;
-    if (!write(&firstByte, 1, false))
-        return;
+void Connection::sendCompressed(uint8_t opcode, const uint8_t* compressed, size_t compressedLength,
+                                size_t originalLength) {
+    ++_compressionStats.messagesCompressed;
+    _compressionStats.bytesBeforeCompression += originalLength;
+    _compressionStats.bytesAfterCompression += compressedLength;
+    sendHybiData(0x80 | 0x40 | opcode, compressed, compressedLength);
+}
 
-    if (_perMessageDeflate) {
-        std::vector<uint8_t> compressed;
+void Connection::sendUncompressed(uint8_t opcode, const uint8_t* webSocketResponse, size_t messageLength) {
+    if (_perMessageDeflate && isDataFrame(opcode)) {
+        ++_compressionStats.messagesUncompressed;
+    }
+    sendHybiData(0x80 | opcode, webSocketResponse, messageLength);
+}
 
-        zlibContext.deflate(webSocketResponse, messageLength, compressed);
+bool Connection::canShareCompressedFrames() const {
+    return _state == State::HANDLING_HYBI_WEBSOCKET && _perMessageDeflate && _deflateNoContextTakeover
+           && !closed() && !_closeOnEmpty && !_closeSent && _sendQueue.empty() && !_offloadBusy;
+}
 
-        LS_DEBUG(_logger, "Compression result: " << messageLength << " bytes -> " << compressed.size() << " bytes");
-        sendHybiData(compressed.data(), compressed.size());
-    } else {
-        sendHybiData(webSocketResponse, messageLength);
+bool Connection::shouldCompress(const uint8_t* webSocketResponse, size_t messageLength) const {
+    if (messageLength < _compressionPolicy.minimumSize) {
+        return false;
     }
+    return !_compressionPolicy.skipCompressedContent || !looksCompressed(webSocketResponse, messageLength);
 }
 
-void Connection::sendHybiData(const uint8_t* webSocketResponse, size_t messageLength) {
+void Connection::sendHybiData(uint8_t firstByte, const uint8_t* webSocketResponse, size_t messageLength,
+                              bool jumpQueue) {
+    // The header is built up on the stack and buffered with a single write.
+    uint8_t header[14];
+    size_t headerLength = 2;
+    header[0] = firstByte;
     if (messageLength < 126) {
-        const auto nextByte = static_cast<uint8_t>(messageLength); // No MASK bit set.
-        if (!write(&nextByte, 1, false))
-            return;
+        header[1] = static_cast<uint8_t>(messageLength); // No MASK bit set.
     } else if (messageLength < 65536) {
-        const uint8_t nextByte = 126; // No MASK bit set.
-        if (!write(&nextByte, 1, false))
-            return;
+        header[1] = 126; // No MASK bit set.
         // htons in Windows takes a u_short
         const auto lengthBytes = htons(static_cast<uint16_t>(messageLength));
-        if (!write(&lengthBytes, 2, false))
-            return;
+        memcpy(header + headerLength, &lengthBytes, sizeof(lengthBytes));
+        headerLength += sizeof(lengthBytes);
     } else {
-        const uint8_t nextByte = 127; // No MASK bit set.
-        if (!write(&nextByte, 1, false))
-            return;
+        header[1] = 127; // No MASK bit set.
         const uint64_t lengthBytes = __bswap_64(messageLength);
-        if (!write(&lengthBytes, 8, false))
-            return;
+        memcpy(header + headerLength, &lengthBytes, sizeof(lengthBytes));
+        headerLength += sizeof(lengthBytes);
+    }
+    if (_client) {
+        // Clients mask everything they send (RFC 6455 section 5.3).
+        header[1] |= 0x80;
+        uint8_t mask[8];
+        auto maskKey = nextMask();
+        memcpy(mask, &maskKey, 4);
+        memcpy(mask + 4, mask, 4);
+        memcpy(header + headerLength, mask, 4);
+        headerLength += 4;
+        _maskBuffer.resize(messageLength);
+        uint64_t mask64;
+        memcpy(&mask64, mask, sizeof(mask64));
+        size_t i = 0;
+        for (; i + sizeof(mask64) <= messageLength; i += sizeof(mask64)) {
+            uint64_t word;
+            memcpy(&word, webSocketResponse + i, sizeof(word));
+            word ^= mask64;
+            memcpy(_maskBuffer.data() + i, &word, sizeof(word));
+        }
+        for (; i < messageLength; ++i) {
+            _maskBuffer[i] = webSocketResponse[i] ^ mask[i & 3];
+        }
+        webSocketResponse = _maskBuffer.data();
     }
+    if (jumpQueue && _framing && _nextFrameBoundary < _outBuf.size()) {
+        queueControlFrame(header, headerLength, webSocketResponse, messageLength);
+        return;
+    }
+    if (!write(header, headerLength, false))
+        return;
     write(webSocketResponse, messageLength, true);
 }
 
+void Connection::queueControlFrame(const uint8_t* header, size_t headerLength, const uint8_t* payload,
+                                   size_t payloadLength) {
+    if (closed() || _closeOnEmpty) {
+        return;
+    }
+    auto bufferSize = _outBuf.size() + _controlBuf.size() + headerLength + payloadLength;
+    if (bufferSize >= _server.clientBufferSize()) {
+        LS_WARNING(_logger, "Closing connection: buffer size too large ("
+                                << bufferSize << " >= " << _server.clientBufferSize() << ")");
+        closeInternal();
+        return;
+    }
+    _controlBuf.insert(_controlBuf.end(), header, header + headerLength);
+    _controlBuf.insert(_controlBuf.end(), payload, payload + payloadLength);
+    flush();
+}
+
+void Connection::startFraming() {
+    // Whatever is in the buffer now (the handshake) isn't frames.
+    _framing = true;
+    _nextFrameBoundary = _outBuf.size();
+}
+
+void Connection::discardUnsentData() {
+    _sendQueue.clear();
+    _sendQueueByKey.clear();
+    _sendQueueBytes = 0;
+    while (!_expiringFrames.empty() && _expiringFrames.back().offset >= _nextFrameBoundary) {
+        _expiringFrames.pop_back();
+    }
+    if (_framing && _nextFrameBoundary < _outBuf.size()) {
+        _outBuf.resize(_nextFrameBoundary);
+    }
+    spliceControlFrames();
+}
+
 std::shared_ptr<Credentials> Connection::credentials() const {
     _server.checkThread();
     return _request ? _request->credentials() : std::shared_ptr<Credentials>();
@@ -671,7 +1529,6 @@ void Connection::handleHixieWebSocket() {
             closeInternal();
             return;
         }
-        // TODO: UTF-8
         size_t endOfMessage = 0;
         for (size_t i = messageStart + 1; i < _inBuf.size(); ++i) {
             if (_inBuf[i] == 0xff) {
@@ -680,30 +1537,48 @@ void Connection::handleHixieWebSocket() {
             }
         }
         if (endOfMessage != 0) {
-            _inBuf[endOfMessage] = 0;
-            handleWebSocketTextMessage(reinterpret_cast<const char*>(&_inBuf[messageStart + 1]));
+            if (_validateUtf8 && !isValidUtf8(&_inBuf[messageStart + 1], endOfMessage - messageStart - 1)) {
+                LS_WARNING(_logger, "Invalid UTF-8 in WebSocket text message");
+                deliverReceivedMessages();
+                closeInternal();
+                return;
+            }
+            handleWebSocketTextMessage(&_inBuf[messageStart + 1], endOfMessage - messageStart - 1);
             messageStart = endOfMessage + 1;
         } else {
             break;
         }
     }
+    deliverReceivedMessages();
     if (messageStart != 0) {
         _inBuf.erase(_inBuf.begin(), _inBuf.begin() + messageStart);
     }
     if (_inBuf.size() > MaxWebsocketMessageSize) {
         LS_WARNING(_logger, "WebSocket message too long");
-        closeInternal();
+        failWebSocket(CloseCode::MessageTooBig, "");
     }
 }
 
 void Connection::handleHybiWebSocket() {
+    if (_closeOnEmpty) {
+        // Closing: anything more the client sends is of no interest.
+        _inBuf.clear();
+        return;
+    }
     if (_inBuf.empty()) {
         return;
     }
+    if (_offloadBusy) {
+        // Nothing is decoded until the worker's done, so stop the peer
+        // filling _inBuf meanwhile; resumeAfterOffload() picks it up again.
+        pauseReading();
+        return;
+    }
     HybiPacketDecoder decoder(*_logger, _inBuf);
     bool done = false;
+    auto& decodedMessage = _decodedMessage;
     while (!done) {
-        std::vector<uint8_t> decodedMessage;
+        decodedMessage.clear();
         bool deflateNeeded = false;
 
         auto messageState = decoder.decodeNextMessage(decodedMessage, deflateNeeded);
@@ -711,21 +1586,30 @@ void Connection::handleHybiWebSocket() {
         if (deflateNeeded) {
             if (!_perMessageDeflate) {
                 LS_WARNING(_logger, "Received deflated hybi frame but deflate wasn't negotiated");
-                closeInternal();
+                deliverReceivedMessages();
+                failWebSocket(CloseCode::ProtocolError, "Unexpected compressed frame");
                 return;
             }
 
+            if (shouldOffload(decodedMessage.size())) {
+                // Everything after this message waits until it's been inflated.
+                inflateOffloaded(messageState == HybiPacketDecoder::MessageState::TextMessage, decodedMessage);
+                done = true;
+                continue;
+            }
+
             size_t compressed_size = decodedMessage.size();
 
             std::vector<uint8_t> decompressed;
             int zlibError;
 
             // Note: inflate() alters decodedMessage
-            bool success = zlibContext.inflate(decodedMessage, decompressed, zlibError);
+            bool success = _deflateState->zlib.inflate(decodedMessage, decompressed, zlibError,
+                                                       _server.clientBufferSize());
 
             if (!success) {
-                LS_WARNING(_logger, "Decompression error from zlib: " << zlibError);
-                closeInternal();
+                deliverReceivedMessages();
+                failInflate(zlibError);
                 return;
             }
 
@@ -737,36 +1621,40 @@ void Connection::handleHybiWebSocket() {
 
         switch (messageState) {
             default:
-                closeInternal();
                 LS_WARNING(_logger, "Unknown HybiPacketDecoder state");
+                deliverReceivedMessages();
+                failWebSocket(CloseCode::InternalError, "");
                 return;
             case HybiPacketDecoder::MessageState::Error:
-                closeInternal();
+                deliverReceivedMessages();
+                failWebSocket(CloseCode::ProtocolError, "");
                 return;
             case HybiPacketDecoder::MessageState::TextMessage:
-                decodedMessage.push_back(0); // avoids a copy
-                handleWebSocketTextMessage(reinterpret_cast<const char*>(&decodedMessage[0]));
-                break;
             case HybiPacketDecoder::MessageState::BinaryMessage:
-                handleWebSocketBinaryMessage(decodedMessage);
+                if (!handleWebSocketDataMessage(messageState == HybiPacketDecoder::MessageState::TextMessage,
+                                                decodedMessage.data(), decodedMessage.size())) {
+                    return;
+                }
                 break;
             case HybiPacketDecoder::MessageState::Ping:
                 sendHybi(static_cast<uint8_t>(HybiPacketDecoder::Opcode::Pong),
                          &decodedMessage[0], decodedMessage.size());
                 break;
             case HybiPacketDecoder::MessageState::Pong:
-                // Pongs can be sent unsolicited (MSIE and Edge do this)
-                // The spec says to ignore them.
+                handlePong(decodedMessage);
                 break;
             case HybiPacketDecoder::MessageState::NoMessage:
                 done = true;
                 break;
             case HybiPacketDecoder::MessageState::Close:
                 LS_DEBUG(_logger, "Received WebSocket close");
-                closeInternal();
-                return;
+                deliverReceivedMessages();
+                handleClose(decodedMessage);
+                done = true;
+                break;
         }
     }
+    deliverReceivedMessages();
     if (decoder.numBytesDecoded() != 0) {
         _inBuf.erase(_inBuf.begin(), _inBuf.begin() + decoder.numBytesDecoded());
     }
@@ -776,18 +1664,182 @@ void Connection::handleHybiWebSocket() {
     }
 }
 
-void Connection::handleWebSocketTextMessage(const char* message) {
-    LS_DEBUG(_logger, "Got text web socket message: '" << message << "'");
-    if (_webSocketHandler) {
-        _webSocketHandler->onData(this, message);
+bool Connection::checkKeepAlive(std::chrono::steady_clock::time_point now,
+                                std::chrono::seconds pingInterval,
+                                std::chrono::seconds pongTimeout) {
+    if (_state != State::HANDLING_HYBI_WEBSOCKET || closed() || _closeSent) {
+        return true;
     }
+    if (_awaitingPong) {
+        return now - _lastPingSent < pongTimeout;
+    }
+    if (now - _lastPingSent < pingInterval) {
+        return true;
+    }
+    uint8_t payload[8];
+    uint64_t sent = static_cast<uint64_t>(now.time_since_epoch().count());
+    for (int i = 7; i >= 0; --i) {
+        payload[i] = static_cast<uint8_t>(sent);
+        sent >>= 8;
+    }
+    _lastPingSent = now;
+    _awaitingPong = true;
+    sendHybi(static_cast<uint8_t>(HybiPacketDecoder::Opcode::Ping), payload, sizeof(payload));
+    return true;
+}
+
+void Connection::handlePong(const std::vector<uint8_t>& payload) {
+    // Pongs can be sent unsolicited (MSIE and Edge do this), and the spec says
+    // to ignore them. Only a pong echoing our outstanding ping gives us an RTT.
+    if (!_awaitingPong || payload.size() != 8) {
+        return;
+    }
+    uint64_t sent = 0;
+    for (auto byte : payload) {
+        sent = (sent << 8) | byte;
+    }
+    if (sent != static_cast<uint64_t>(_lastPingSent.time_since_epoch().count())) {
+        return;
+    }
+    _awaitingPong = false;
+    auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - _lastPingSent);
+    // Smoothed the same way TCP smooths its RTT estimate (RFC 6298).
+    if (_averageRoundTripTime.count() == 0) {
+        _averageRoundTripTime = rtt;
+    } else {
+        _averageRoundTripTime += (rtt - _averageRoundTripTime) / 8;
+    }
+    _lastRoundTripTime = rtt;
+    LS_DEBUG(_logger, "WebSocket round trip time " << rtt.count() << "us");
+}
+
+void Connection::handleClose(const std::vector<uint8_t>& payload) {
+    auto code = CloseCode::NoStatus;
+    std::string reason;
+    if (payload.size() >= 2) {
+        code = static_cast<CloseCode>((payload[0] << 8) | payload[1]);
+        reason.assign(payload.begin() + 2, payload.end());
+    }
+    auto codeValue = static_cast<uint16_t>(code);
+    // Codes 1005, 1006 and 1015 are for reporting only, and 1004 is reserved.
+    bool validCode = code == CloseCode::NoStatus
+                     || (codeValue >= 1000 && codeValue <= 1003)
+                     || (codeValue >= 1007 && codeValue <= 1014)
+                     || (codeValue >= 3000 && codeValue <= 4999);
+    if (payload.size() == 1 || !validCode) {
+        LS_WARNING(_logger, "Received WebSocket close with invalid status code");
+        failWebSocket(CloseCode::ProtocolError, "");
+        return;
+    }
+    if (_validateUtf8 && !isValidUtf8(reinterpret_cast<const uint8_t*>(reason.data()), reason.size())) {
+        LS_WARNING(_logger, "Invalid UTF-8 in WebSocket close reason");
+        failWebSocket(CloseCode::InvalidData, "Invalid UTF-8");
+        return;
+    }
+    if (!_closeSent) {
+        // The client started the handshake: echo its code back.
+        _closeCode = code;
+        _closeReason = reason;
+        sendClose(code, "", true);
+    }
+    closeWhenEmpty();
+}
+
+void Connection::sendClose(CloseCode code, const std::string& reason, bool urgent) {
+    if (_closeSent || closed()) {
+        return;
+    }
+    std::vector<uint8_t> payload;
+    if (code != CloseCode::NoStatus) {
+        auto codeValue = static_cast<uint16_t>(code);
+        payload.push_back(static_cast<uint8_t>(codeValue >> 8));
+        payload.push_back(static_cast<uint8_t>(codeValue & 0xff));
+        // Control frames carry at most 125 bytes. Don't split a UTF-8 sequence.
+        auto length = std::min(reason.size(), MaxCloseReasonLength);
+        while (length < reason.size() && length > 0 && (reason[length] & 0xc0) == 0x80) {
+            --length;
+        }
+        payload.insert(payload.end(), reason.begin(), reason.begin() + length);
+    }
+    auto closeOpcode = static_cast<uint8_t>(HybiPacketDecoder::Opcode::Close);
+    if (urgent) {
+        // Nothing may follow the Close frame, so anything it overtakes is lost.
+        discardUnsentData();
+        sendHybiData(0x80 | closeOpcode, payload.data(), payload.size(), true);
+    } else {
+        // Whatever is queued has to go ahead of the Close frame, backed up or not.
+        sendQueuedMessages(true);
+        if (_offloadBusy) {
+            queueMessage("", closeOpcode, payload.data(), payload.size());
+        } else {
+            writeHybi(closeOpcode, payload.data(), payload.size());
+        }
+    }
+    _closeSent = true;
+    _closeStarted = std::chrono::steady_clock::now();
 }
 
-void Connection::handleWebSocketBinaryMessage(const std::vector<uint8_t>& message) {
-    LS_DEBUG(_logger, "Got binary web socket message (size: " << message.size() << ")");
+void Connection::failWebSocket(CloseCode code, const std::string& reason) {
+    if (_state != State::HANDLING_HYBI_WEBSOCKET) {
+        closeInternal();
+        return;
+    }
+    if (!_closeSent) {
+        _closeCode = code;
+        _closeReason = reason;
+        sendClose(code, reason, true);
+    }
+    closeWhenEmpty();
+}
+
+bool Connection::closeHandshakeExpired(std::chrono::steady_clock::time_point now,
+                                       std::chrono::seconds timeout) const {
+    return _closeSent && !closed() && now - _closeStarted >= timeout;
+}
+
+bool Connection::handleWebSocketDataMessage(bool isText, const uint8_t* message, size_t length) {
+    if (!isText) {
+        handleWebSocketBinaryMessage(message, length);
+        return true;
+    }
+    if (_validateUtf8 && !isValidUtf8(message, length)) {
+        LS_WARNING(_logger, "Invalid UTF-8 in WebSocket text message");
+        deliverReceivedMessages();
+        failWebSocket(CloseCode::InvalidData, "Invalid UTF-8");
+        return false;
+    }
+    handleWebSocketTextMessage(message, length);
+    return true;
+}
+
+void Connection::handleWebSocketTextMessage(const uint8_t* message, size_t length) {
+    LS_DEBUG(_logger, "Got text web socket message: '" << std::string_view(reinterpret_cast<const char*>(message), length) << "'");
+    _receivedMessages.push_back({true, _receivedData.size(), length});
+    _receivedData.insert(_receivedData.end(), message, message + length);
+    _receivedData.push_back(0);
+}
+
+void Connection::handleWebSocketBinaryMessage(const uint8_t* message, size_t length) {
+    LS_DEBUG(_logger, "Got binary web socket message (size: " << length << ")");
+    _receivedMessages.push_back({false, _receivedData.size(), length});
+    _receivedData.insert(_receivedData.end(), message, message + length);
+}
+
+void Connection::deliverReceivedMessages() {
+    if (_receivedMessages.empty()) {
+        return;
+    }
+    // Views are only built now, as _receivedData may have moved while it grew.
+    for (const auto& message : _receivedMessages) {
+        _receivedViews.push_back({message.isText, _receivedData.data() + message.offset, message.length});
+    }
+    _receivedMessages.clear();
     if (_webSocketHandler) {
-        _webSocketHandler->onData(this, &message[0], message.size());
+        _webSocketHandler->onDataBatch(this, _receivedViews.data(), _receivedViews.size());
     }
+    _receivedViews.clear();
+    _receivedData.clear();
 }
 
 bool Connection::sendError(ResponseCode errorCode, const std::string& body) {
@@ -810,7 +1862,7 @@ bool Connection::sendError(ResponseCode errorCode, const std::string& body) {
                                           "<a href=\"https://github.com/mattgodbolt/seasocks\">Seasocks</a></i></div></body></html>";
         document = documentStr.str();
     }
-    bufferLine("Content-Length: " + toString(document.length()));
+    bufferHeader("Content-Length", document.length());
     bufferLine("Connection: close");
     bufferLine("");
     bufferLine(document);
@@ -847,9 +1899,9 @@ bool Connection::sendISE(const std::string& error) {
 }
 
 bool Connection::processHeaders(uint8_t* first, uint8_t* last) {
-    // Ideally we'd copy off [first, last] now into a header structure here.
-    // Be careful about lifetimes though and multiple requests coming in, should
-    // we ever support HTTP pipelining and/or long-lived requests.
+    // Nothing in the request may point into [first, last]: it's erased from
+    // _inBuf as soon as we return, and the response may well outlive it, with
+    // further pipelined requests parsed in the meantime.
     char* requestLine = extractLine(first, last);
     assert(requestLine != nullptr);
 
@@ -872,47 +1924,56 @@ bool Connection::processHeaders(uint8_t* first, uint8_t* last) {
     if (httpVersion == nullptr) {
         return sendBadRequest("Malformed request line");
     }
-    if (strcmp(httpVersion, "HTTP/1.1") != 0) {
+    _http10 = strcmp(httpVersion, "HTTP/1.0") == 0;
+    if (!_http10 && strcmp(httpVersion, "HTTP/1.1") != 0) {
         return sendUnsupportedError("Unsupported HTTP version");
     }
     if (*requestLine != 0) {
         return sendBadRequest("Trailing crap after http version");
     }
 
-    HeaderMap headers(31);
-    while (first < last) {
-        char* colonPos = nullptr;
-        char* headerLine = extractLine(first, last, &colonPos);
-        assert(headerLine != nullptr);
-        if (colonPos == nullptr) {
-            return sendBadRequest("Malformed header");
-        }
-        *colonPos = 0;
-        const char* key = headerLine;
-        const char* value = skipWhitespace(colonPos + 1);
-        LS_DEBUG(_logger, "Key: " << key << " || " << value);
-        headers.emplace(key, value);
+    RequestHeaders headers(first, last);
+    if (!parseHeaderBlock(headers)) {
+        return sendBadRequest("Malformed header");
     }
 
-    if (headers.count("Connection") && headers.count("Upgrade") && hasConnectionType(headers["Connection"], "Upgrade") && caseInsensitiveSame(headers["Upgrade"], "websocket")) {
+    // HTTP/1.1 connections persist unless the client says otherwise; HTTP/1.0
+    // ones only if it asks.
+    const auto connectionHeader = headers.get(KnownHeader::Connection);
+    const auto maxRequests = _server.httpKeepAliveMaxRequests();
+    ++_requestsReceived;
+    _keepAlive = (_http10 ? hasConnectionType(connectionHeader, "keep-alive")
+                          : !hasConnectionType(connectionHeader, "close"))
+                 && (maxRequests <= 0 || _requestsReceived < static_cast<size_t>(maxRequests));
+
+    if (headers.has(KnownHeader::Connection) && headers.has(KnownHeader::Upgrade) && hasConnectionType(headers.get(KnownHeader::Connection), "Upgrade") && compareCaseInsensitive(headers.get(KnownHeader::Upgrade), "websocket")) {
         LS_INFO(_logger, "Websocket request for " << requestUri << "'");
         if (verb != Request::Verb::Get) {
             return sendBadRequest("Non-GET WebSocket request");
         }
+        if (_http10) {
+            return sendBadRequest("WebSocket request needs HTTP/1.1");
+        }
         _webSocketHandler = _server.getWebSocketHandler(requestUri);
         if (!_webSocketHandler) {
             LS_WARNING(_logger, "Couldn't find WebSocket end point for '" << requestUri << "'");
             return send404();
         }
         verb = Request::Verb::WebSocket;
+        _validateUtf8 = _server.server().getUtf8ValidationEnabled();
 
-        if (_server.server().getPerMessageDeflateEnabled() && headers.count("Sec-WebSocket-Extensions")) {
-            parsePerMessageDeflateHeader(headers["Sec-WebSocket-Extensions"]);
+        if (_server.server().getPerMessageDeflateEnabled() && headers.has(KnownHeader::SecWebSocketExtensions)) {
+            _compressionPolicy = _server.getCompressionPolicy(requestUri);
+            parsePerMessageDeflateHeader(std::string(headers.get(KnownHeader::SecWebSocketExtensions)));
         }
     }
 
     _request = std::make_unique<PageRequest>(_address, requestUri, _server.server(),
                                              verb, std::move(headers));
+    _acceptedEncoding = ContentEncoding::Identity;
+    if (_server.httpCompressionOptions().enabled && verb != Request::Verb::Head && verb != Request::Verb::WebSocket) {
+        _acceptedEncoding = negotiateContentEncoding(_request->getHeaderView(KnownHeader::AcceptEncoding));
+    }
 
     const EmbeddedContent* embedded = findEmbeddedContent(requestUri);
     if (verb == Request::Verb::Get && embedded) {
@@ -922,10 +1983,67 @@ bool Connection::processHeaders(uint8_t* first, uint8_t* last) {
         return sendHeader(getContentType(requestUri), embedded->length);
     }
 
-    if (_request->contentLength() > _server.clientBufferSize()) {
-        return sendBadRequest("Content length too long");
+    const auto transferEncoding = _request->getHeaderView(KnownHeader::TransferEncoding);
+    _chunkedBody = !transferEncoding.empty();
+    if (_chunkedBody) {
+        if (!compareCaseInsensitive(transferEncoding, "chunked")) {
+            return sendUnsupportedError("Unsupported transfer encoding");
+        }
+        if (_request->hasHeader(KnownHeader::ContentLength)) {
+            // Requests with both are a classic way of smuggling one request
+            // inside another past a proxy.
+            return sendBadRequest("Both Content-Length and Transfer-Encoding");
+        }
+        if (!_chunkedDecoder) {
+            _chunkedDecoder = std::make_unique<ChunkedDecoder>();
+        }
+        _chunkedDecoder->reset();
+    }
+
+    // HTTP/1.0 clients can't have meant anything by it.
+    const auto expect = _request->getHeaderView(KnownHeader::Expect);
+    const bool expectsContinue = !expect.empty() && !_http10;
+    if (expectsContinue && !compareCaseInsensitive(expect, "100-continue")) {
+        return sendError(ResponseCode::ExpectationFailed, "Unsupported expectation");
+    }
+
+    std::shared_ptr<RequestBodyHandler> bodyHandler;
+    if (verb != Request::Verb::WebSocket) {
+        bodyHandler = _server.getRequestBodyHandler(requestUri);
+    }
+    if (_chunkedBody || _request->contentLength() > 0) {
+        if (!bodyHandler && _request->contentLength() > _server.clientBufferSize()) {
+            return sendError(ResponseCode::PayloadTooLarge, "Content length too long");
+        }
+        std::shared_ptr<Response> refusal;
+        try {
+            refusal = bodyHandler ? bodyHandler->checkRequestBody(*_request)
+                                  : _server.checkRequestBody(*_request);
+        } catch (const std::exception& e) {
+            LS_ERROR(_logger, "page error: " << e.what());
+            return sendISE(e.what());
+        } catch (...) {
+            LS_ERROR(_logger, "page error: (unknown)");
+            return sendISE("(unknown)");
+        }
+        if (refusal != Response::unhandled()) {
+            // The body is left unread, so nothing after it can be trusted.
+            _keepAlive = false;
+            return sendResponse(refusal);
+        }
+        if (expectsContinue) {
+            bufferLine("HTTP/1.1 100 Continue");
+            bufferLine("");
+            if (!flush()) {
+                return false;
+            }
+        }
+    }
+
+    if (bodyHandler) {
+        return beginStreamingBody(bodyHandler);
     }
-    if (_request->contentLength() == 0) {
+    if (!_chunkedBody && _request->contentLength() == 0) {
         return handlePageRequest();
     }
     _state = State::BUFFERING_POST_DATA;
@@ -947,11 +2065,12 @@ bool Connection::handlePageRequest() {
     if (!response && _request->verb() == Request::Verb::WebSocket) {
         _webSocketHandler = _server.getWebSocketHandler(uri.c_str());
         int webSocketVersion{0};
+        const auto versionHeader = _request->getHeaderView(KnownHeader::SecWebSocketVersion);
         try {
-            webSocketVersion = std::stoi(_request->getHeader("Sec-WebSocket-Version"));
+            webSocketVersion = std::stoi(std::string(versionHeader));
         } catch (const std::logic_error& ex) {
             (void) ex;
-            LS_WARNING(_logger, "Invalid Sec-WebSocket-Version '" << _request->getHeader("Sec-WebSocket-Version") << "'");
+            LS_WARNING(_logger, "Invalid Sec-WebSocket-Version '" << versionHeader << "'");
             return sendError(ResponseCode::UpgradeRequired, "Invalid Sec-WebSocket-Version received");
         }
         if (!_webSocketHandler) {
@@ -963,7 +2082,7 @@ bool Connection::handlePageRequest() {
             _state = State::READING_WEBSOCKET_KEY3;
             return true;
         }
-        auto hybiKey = _request->getHeader("Sec-WebSocket-Key");
+        auto hybiKey = std::string(_request->getHeaderView(KnownHeader::SecWebSocketKey));
         return handleHybiHandshake(webSocketVersion, hybiKey);
     }
     return sendResponse(response);
@@ -1006,7 +2125,17 @@ void Connection::begin(ResponseCode responseCode, TransferEncoding encoding) {
         return;
     }
     _state = State::SENDING_RESPONSE_HEADERS;
+    _responseCode = responseCode;
+    _responseContentType.clear();
+    _responseContentLength = NoContentLength;
+    _responseEncoded = false;
     bufferResponseAndCommonHeaders(responseCode);
+    if (_http10 && encoding == TransferEncoding::Chunked) {
+        // HTTP/1.0 clients don't understand chunks: the end of the response
+        // is marked by closing the connection instead.
+        encoding = TransferEncoding::Raw;
+        _keepAlive = false;
+    }
     _transferEncoding = encoding;
     if (_transferEncoding == TransferEncoding::Chunked) {
         bufferLine("Transfer-encoding: chunked");
@@ -1019,41 +2148,122 @@ void Connection::header(const std::string& header, const std::string& value) {
         LS_ERROR(_logger, "header() called when in wrong state");
         return;
     }
-    bufferLine(header + ": " + value);
+    // We write these ourselves, as whether the connection stays open depends
+    // on the request and on our own limits too.
+    if (compareCaseInsensitive(header, "Connection")) {
+        if (!hasConnectionType(value, "keep-alive")) {
+            _keepAlive = false;
+        }
+        return;
+    }
+    if (compareCaseInsensitive(header, "Keep-Alive")) {
+        return;
+    }
+    if (compareCaseInsensitive(header, "Content-Type")) {
+        _responseContentType = value;
+    } else if (compareCaseInsensitive(header, "Content-Encoding")) {
+        _responseEncoded = true;
+    } else if (compareCaseInsensitive(header, "Content-Length")) {
+        size_t length = 0;
+        auto result = std::from_chars(value.data(), value.data() + value.size(), length);
+        if (result.ec == std::errc() && result.ptr == value.data() + value.size()) {
+            // Held back: it's wrong if we end up compressing the body.
+            _responseContentLength = length;
+            return;
+        }
+    }
+    bufferHeader(header, value);
+}
+
+void Connection::header(const std::string& header, size_t value) {
+    _server.checkThread();
+    if (_state != State::SENDING_RESPONSE_HEADERS) {
+        LS_ERROR(_logger, "header() called when in wrong state");
+        return;
+    }
+    if (compareCaseInsensitive(header, "Content-Length")) {
+        _responseContentLength = value;
+        return;
+    }
+    if (compareCaseInsensitive(header, "Keep-Alive")) {
+        return;
+    }
+    bufferHeader(header, value);
+}
+
+void Connection::endResponseHeaders() {
+    const auto length = _responseContentLength;
+    const auto code = static_cast<int>(_responseCode);
+    if (code >= 200 && code <= 203 && !_responseEncoded
+        && bufferContentEncodingHeaders(_responseContentType, length)) {
+        if (_transferEncoding == TransferEncoding::Raw) {
+            bufferCompressedFraming();
+        }
+    } else if (_responseContentLength != NoContentLength) {
+        bufferHeader("Content-Length", _responseContentLength);
+    }
+    bufferKeepAliveHeaders();
+    bufferLine("");
 }
 void Connection::payload(const void* data, size_t size, bool flush) {
     _server.checkThread();
     if (_state == State::SENDING_RESPONSE_HEADERS) {
-        bufferLine("");
+        endResponseHeaders();
         _state = State::SENDING_RESPONSE_BODY;
     } else if (_state != State::SENDING_RESPONSE_BODY) {
         LS_ERROR(_logger, "payload() called when in wrong state");
         return;
     }
+    writeBody(data, size, flush, flush);
+}
+
+bool Connection::writeBody(const void* data, size_t size, bool flushSocket, bool syncEncoder, bool last) {
+    if (_compressingBody) {
+        _encodedBody.clear();
+        _contentEncoder->encode(data, size, syncEncoder, _encodedBody);
+        if (last) {
+            _contentEncoder->finish(_encodedBody);
+            _compressingBody = false;
+        }
+        data = _encodedBody.data();
+        size = _encodedBody.size();
+    }
     if (size && _transferEncoding == TransferEncoding::Chunked) {
         writeChunkHeader(size);
     }
-    write(data, size, flush);
+    return write(data, size, flushSocket);
 }
 
 void Connection::writeChunkHeader(size_t size) {
-    std::ostringstream lengthStr;
-    if (_chunk)
-        lengthStr << "\r\n";
-    lengthStr << std::hex << size << "\r\n";
-    auto length = lengthStr.str();
+    // At most a CRLF, 16 hex digits and another CRLF.
+    char header[20];
+    size_t headerLength = 0;
+    if (_chunk) {
+        header[headerLength++] = '\r';
+        header[headerLength++] = '\n';
+    }
+    auto result = std::to_chars(header + headerLength, header + sizeof(header), size, 16);
+    headerLength = static_cast<size_t>(result.ptr - header);
+    header[headerLength++] = '\r';
+    header[headerLength++] = '\n';
     _chunk++;
-    write(length.c_str(), length.size(), false);
+    write(header, headerLength, false);
 }
 
 void Connection::finish(bool keepConnectionOpen) {
     _server.checkThread();
     if (_state == State::SENDING_RESPONSE_HEADERS) {
-        bufferLine("");
+        if (!keepConnectionOpen) {
+            _keepAlive = false;
+        }
+        endResponseHeaders();
     } else if (_state != State::SENDING_RESPONSE_BODY) {
         LS_ERROR(_logger, "finish() called when in wrong state");
         return;
     }
+    if (_compressingBody) {
+        writeBody(nullptr, 0, false, false, true);
+    }
     if (_transferEncoding == TransferEncoding::Chunked) {
         writeChunkHeader(0);
         write("\r\n", 2, false);
@@ -1061,12 +2271,17 @@ void Connection::finish(bool keepConnectionOpen) {
 
     flush();
 
-    if (!keepConnectionOpen) {
+    if (!keepConnectionOpen || !_keepAlive) {
         closeWhenEmpty();
     }
 
     _state = State::READING_HEADERS;
     _response.reset();
+    _lastActivity = std::chrono::steady_clock::now();
+    if (!_inBuf.empty()) {
+        // Pipelined requests have been waiting on this response.
+        handleNewData();
+    }
 }
 
 bool Connection::handleHybiHandshake(
@@ -1082,31 +2297,46 @@ bool Connection::handleHybiHandshake(
     bufferResponseAndCommonHeaders(ResponseCode::WebSocketProtocolHandshake);
     bufferLine("Upgrade: websocket");
     bufferLine("Connection: Upgrade");
-    bufferLine("Sec-WebSocket-Accept: " + getAcceptKey(webSocketKey));
+    bufferHeader("Sec-WebSocket-Accept", getAcceptKey(webSocketKey));
     if (_perMessageDeflate)
-        bufferLine("Sec-WebSocket-Extensions: permessage-deflate");
+        bufferHeader("Sec-WebSocket-Extensions", _perMessageDeflateResponse);
     pickProtocol();
     bufferLine("");
+    startFraming();
     flush();
 
     if (_webSocketHandler) {
         _webSocketHandler->onConnect(this);
     }
     _state = State::HANDLING_HYBI_WEBSOCKET;
+    _lastPingSent = std::chrono::steady_clock::now();
     return true;
 }
 
 void Connection::parsePerMessageDeflateHeader(const std::string& header) {
-    for (auto& extField : seasocks::split(header, ';')) {
-        while (!extField.empty() && isspace(extField[0])) {
-            extField = extField.substr(1);
-        }
-
-        if (seasocks::caseInsensitiveSame(extField, "permessage-deflate")) {
-            LS_INFO(_logger, "Enabling per-message deflate");
-            _perMessageDeflate = true;
-            zlibContext.initialise();
-        }
+    const auto& options = _server.server().getPerMessageDeflateOptions();
+    DeflateParameters parameters;
+    if (!negotiatePerMessageDeflate(header, options, parameters, _compressionPolicy.dictionaryId)) {
+        LS_DEBUG(_logger, "No acceptable per-message deflate offer in '" << header << "'");
+        return;
+    }
+    _perMessageDeflateResponse = parameters.responseHeader();
+    LS_INFO(_logger, "Enabling per-message deflate: " << _perMessageDeflateResponse);
+    _perMessageDeflate = true;
+    _deflateNoContextTakeover = parameters.serverNoContextTakeover;
+    _deflateWindowBits = parameters.serverMaxWindowBits;
+    _deflateState = std::make_shared<DeflateState>();
+    _deflateState->connection = this;
+    auto& zlibContext = _deflateState->zlib;
+    zlibContext.initialise(parameters.serverMaxWindowBits, parameters.clientMaxWindowBits,
+                           options.memLevel,
+                           parameters.serverNoContextTakeover, parameters.clientNoContextTakeover);
+    zlibContext.setCompression(_compressionPolicy.level, _compressionPolicy.strategy);
+    _offloadThreshold = _server.compressionOffloadThreshold();
+    if (!parameters.dictionaryId.empty()) {
+        _deflateDictionaryId = parameters.dictionaryId;
+        const auto& dictionary = _compressionPolicy.dictionary;
+        zlibContext.setDictionary(reinterpret_cast<const uint8_t*>(dictionary.data()), dictionary.size());
     }
 }
 
@@ -1157,20 +2387,21 @@ bool Connection::parseRanges(const std::string& range, std::list<Range>& ranges)
 }
 
 // Sends HTTP 200 or 206, content-length, and range info as needed. Returns the actual file ranges
-// needing sending.
-std::list<Connection::Range> Connection::processRangesForStaticData(const std::list<Range>& origRanges, long fileSize) {
+// needing sending, or an empty list (having buffered nothing) if the ranges can't be satisfied.
+std::list<Connection::Range> Connection::processRangesForStaticData(const std::list<Range>& origRanges, long fileSize,
+                                                                    std::string_view contentType) {
     if (origRanges.empty()) {
-        // Easy case: a non-range request.
+        // Easy case: a non-range request, which we may compress. If so, the
+        // caller sends the length or framing, depending on the file's source.
         bufferResponseAndCommonHeaders(ResponseCode::Ok);
-        bufferLine("Content-Length: " + toString(fileSize));
+        if (!bufferContentEncodingHeaders(contentType, static_cast<size_t>(fileSize))) {
+            bufferHeader("Content-Length", static_cast<size_t>(fileSize));
+        }
         return {Range{0, fileSize - 1}};
     }
 
-    // Partial content request.
-    bufferResponseAndCommonHeaders(ResponseCode::PartialContent);
-    size_t contentLength = 0;
-    std::ostringstream rangeLine;
-    rangeLine << "Content-Range: bytes ";
+    // Partial content request. Clamp everything to the file before sending a
+    // byte, as the body is read straight from these offsets.
     std::list<Range> sendRanges;
     for (auto actualRange : origRanges) {
         if (actualRange.start < 0) {
@@ -1179,16 +2410,29 @@ std::list<Connection::Range> Connection::processRangesForStaticData(const std::l
         if (actualRange.start >= fileSize) {
             actualRange.start = fileSize - 1;
         }
+        if (actualRange.start < 0) {
+            actualRange.start = 0;
+        }
         if (actualRange.end >= fileSize) {
             actualRange.end = fileSize - 1;
         }
-        contentLength += actualRange.length();
+        if (actualRange.end < actualRange.start) {
+            return {};
+        }
         sendRanges.push_back(actualRange);
+    }
+
+    bufferResponseAndCommonHeaders(ResponseCode::PartialContent);
+    size_t contentLength = 0;
+    std::ostringstream rangeLine;
+    rangeLine << "Content-Range: bytes ";
+    for (const auto& actualRange : sendRanges) {
+        contentLength += static_cast<size_t>(actualRange.length());
         rangeLine << actualRange.start << "-" << actualRange.end;
     }
     rangeLine << "/" << fileSize;
     bufferLine(rangeLine.str());
-    bufferLine("Content-Length: " + toString(contentLength));
+    bufferHeader("Content-Length", contentLength);
     return sendRanges;
 }
 
@@ -1198,7 +2442,7 @@ std::list<Connection::Range> Connection::processRangesForStaticData(const std::l
 bool Connection::sendStaticData() {
     // TODO: fold this into the handler way of doing things.
     std::string path = _server.getStaticPath() + getRequestUri();
-    auto rangeHeader = getHeader("Range");
+    auto rangeHeader = std::string(_request->getHeaderView(KnownHeader::Range));
     // Trim any trailing queries.
     size_t queryPos = path.find('?');
     if (queryPos != std::string::npos) {
@@ -1207,11 +2451,16 @@ bool Connection::sendStaticData() {
     if (*path.rbegin() == '/') {
         path += "index.html";
     }
+    // Hot files are served straight from memory, if we're caching them.
+    std::shared_ptr<StaticFileCache::File> cached;
+    if (auto cache = _server.staticFileCache()) {
+        cached = cache->get(path);
+    }
 #ifndef O_BINARY
 #define O_BINARY 0x8000 // is this needed sometimes (mingw?)
 #endif
-    RaiiFd input{::open(path.c_str(), O_RDONLY | O_BINARY)};
-    if (!input.ok()) {
+    RaiiFd input{cached ? -1 : ::open(path.c_str(), O_RDONLY | O_BINARY)};
+    if (!cached && !input.ok()) {
         std::string s = seasocks::getLastError();
         std::cout << s << std::endl;
         std::cout << std::endl;
@@ -1220,29 +2469,68 @@ bool Connection::sendStaticData() {
     // Windows does not. So let's be explicit about this.
 
     struct stat fileStat;
-    if (!input.ok() || ::fstat(input, &fileStat) == -1) {
+    if (!cached && (!input.ok() || ::fstat(input, &fileStat) == -1)) {
         return send404();
     }
+    const long fileSize = cached ? static_cast<long>(cached->size()) : fileStat.st_size;
     std::list<Range> ranges;
     if (!rangeHeader.empty() && !parseRanges(rangeHeader, ranges)) {
         return sendBadRequest("Bad range header");
     }
-    ranges = processRangesForStaticData(ranges, fileStat.st_size);
-    bufferLine("Content-Type: " + getContentType(path));
-    bufferLine("Connection: keep-alive");
-    bufferLine("Accept-Ranges: bytes");
-    bufferLine("Last-Modified: " + webtime(fileStat.st_mtime));
+    _transferEncoding = TransferEncoding::Raw;
+    _chunk = 0;
+    ranges = processRangesForStaticData(ranges, fileSize, getContentType(path));
+    if (ranges.empty()) {
+        return sendError(ResponseCode::RangeNotSatisfiable, "Unsatisfiable range header");
+    }
+    const std::vector<uint8_t>* encodedBody = nullptr;
+    if (_compressingBody && cached) {
+        // Hot files are compressed once per coding, and sent with their
+        // real length.
+        encodedBody = cached->encoded(_acceptedEncoding);
+        if (!encodedBody) {
+            std::vector<uint8_t> body;
+            _contentEncoder->encode(cached->data(), cached->size(), false, body);
+            _contentEncoder->finish(body);
+            encodedBody = &_server.staticFileCache()->storeEncoded(*cached, _acceptedEncoding, std::move(body));
+        }
+        _compressingBody = false;
+        bufferHeader("Content-Length", encodedBody->size());
+    } else if (_compressingBody) {
+        bufferCompressedFraming();
+    }
+    if (cached && !cached->headers.empty()) {
+        write(cached->headers.data(), cached->headers.size(), false);
+    } else {
+        const auto start = _outBuf.size();
+        if (bufferStaticFileHeaders(path, cached ? cached->modified() : fileStat.st_mtime) && cached) {
+            // Keep a copy to send next time.
+            cached->headers.assign(_outBuf.begin() + static_cast<ptrdiff_t>(start), _outBuf.end());
+        }
+    }
     if (!isCacheable(path)) {
-        bufferLine("Cache-Control: no-store");
-        bufferLine("Pragma: no-cache");
-        bufferLine("Expires: " + now());
+        bufferHeader("Expires", _server.httpDate());
     }
+    bufferKeepAliveHeaders();
     bufferLine("");
     if (!flush()) {
         return false;
     }
 
     for (auto range : ranges) {
+        if (encodedBody) {
+            // The whole file, as it's not a range request.
+            if (!write(encodedBody->data(), encodedBody->size(), true)) {
+                return false;
+            }
+            continue;
+        }
+        if (cached) {
+            if (!writeBody(cached->data() + range.start, static_cast<size_t>(range.length()), true)) {
+                return false;
+            }
+            continue;
+        }
         if (::lseek(input, static_cast<long>(range.start), SEEK_SET) == -1) {
             // We've (probably) already sent data.
             return false;
@@ -1260,11 +2548,22 @@ bool Connection::sendStaticData() {
                 return false;
             }
             bytesLeft -= bytesRead;
-            if (!write(buf, bytesRead, true)) {
+            if (!writeBody(buf, static_cast<size_t>(bytesRead), true)) {
                 return false;
             }
         }
     }
+    if (_compressingBody && !writeBody(nullptr, 0, true, false, true)) {
+        return false;
+    }
+    if (_transferEncoding == TransferEncoding::Chunked) {
+        writeChunkHeader(0);
+        write("\r\n", 2, true);
+        _transferEncoding = TransferEncoding::Raw;
+    }
+    if (!_keepAlive) {
+        closeWhenEmpty();
+    }
     return true;
 }
 
@@ -1274,33 +2573,128 @@ bool Connection::sendStaticData() {
 
 bool Connection::sendHeader(const std::string& type, size_t size) {
     bufferResponseAndCommonHeaders(ResponseCode::Ok);
-    bufferLine("Content-Type: " + type);
-    bufferLine("Content-Length: " + toString(size));
-    bufferLine("Connection: keep-alive");
-    return bufferLine("");
+    bufferHeader("Content-Type", type);
+    bufferHeader("Content-Length", size);
+    bufferKeepAliveHeaders();
+    if (!bufferLine("")) {
+        return false;
+    }
+    if (!_keepAlive) {
+        closeWhenEmpty();
+    }
+    return true;
 }
 
 bool Connection::sendData(const std::string& type, const char* start, size_t size) {
     bufferResponseAndCommonHeaders(ResponseCode::Ok);
-    bufferLine("Content-Type: " + type);
-    bufferLine("Content-Length: " + toString(size));
-    bufferLine("Connection: keep-alive");
+    bufferHeader("Content-Type", type);
+    if (bufferContentEncodingHeaders(type, size)) {
+        // It's all here, so compress it up front and send its real length.
+        _encodedBody.clear();
+        _contentEncoder->encode(start, size, false, _encodedBody);
+        _contentEncoder->finish(_encodedBody);
+        _compressingBody = false;
+        start = reinterpret_cast<const char*>(_encodedBody.data());
+        size = _encodedBody.size();
+    }
+    bufferHeader("Content-Length", size);
+    bufferKeepAliveHeaders();
     bufferLine("");
     bool result = write(start, size, true);
+    if (result && !_keepAlive) {
+        closeWhenEmpty();
+    }
     return result;
 }
 
 void Connection::bufferResponseAndCommonHeaders(ResponseCode code) {
-    auto responseCodeInt = static_cast<int>(code);
-    auto responseCodeName = ::name(code);
-    auto response = std::string("HTTP/1.1 " + toString(responseCodeInt) + " " + responseCodeName);
-    LS_ACCESS(_logger, "Response: " << response);
-    bufferLine(response);
-    bufferLine("Server: " + std::string(Config::version));
-    bufferLine("Date: " + now());
+    auto response = statusLine(code);
+    std::string unknownResponse;
+    if (response.empty()) {
+        unknownResponse = "HTTP/1.1 " + toString(static_cast<int>(code)) + " " + ::name(code) + "\r\n";
+        response = unknownResponse;
+    }
+    LS_ACCESS(_logger, "Response: " << response.substr(0, response.size() - 2));
+    write(response.data(), response.size(), false);
+    static const std::string serverHeader = std::string("Server: ") + Config::version + "\r\n";
+    write(serverHeader.data(), serverHeader.size(), false);
+    bufferHeader("Date", _server.httpDate());
     bufferLine("Access-Control-Allow-Origin: *");
 }
 
+bool Connection::bufferContentEncodingHeaders(std::string_view contentType, size_t length) {
+    _compressingBody = false;
+    const auto& options = _server.httpCompressionOptions();
+    if (!options.enabled || length < options.minimumSize || !matchesContentType(contentType, options.contentTypes)) {
+        return false;
+    }
+    // Other clients may well get it compressed, even if this one doesn't.
+    bufferLine("Vary: Accept-Encoding");
+    if (_acceptedEncoding == ContentEncoding::Identity) {
+        return false;
+    }
+    if (!_contentEncoder) {
+        _contentEncoder = std::make_unique<ContentEncoder>();
+    }
+    _contentEncoder->begin(_acceptedEncoding, options.level);
+    bufferHeader("Content-Encoding", contentEncodingName(_acceptedEncoding));
+    _compressingBody = true;
+    return true;
+}
+
+void Connection::bufferCompressedFraming() {
+    if (_http10) {
+        _keepAlive = false;
+        return;
+    }
+    _transferEncoding = TransferEncoding::Chunked;
+    bufferLine("Transfer-encoding: chunked");
+}
+
+void Connection::bufferKeepAliveHeaders() {
+    if (!_keepAlive) {
+        bufferLine("Connection: close");
+        return;
+    }
+    bufferLine("Connection: keep-alive");
+    const auto timeout = _server.httpKeepAliveTimeoutSeconds();
+    const auto maxRequests = _server.httpKeepAliveMaxRequests();
+    if (timeout <= 0 && maxRequests <= 0) {
+        return;
+    }
+    write("Keep-Alive: ", 12, false);
+    if (timeout > 0) {
+        write("timeout=", 8, false);
+        bufferNumber(static_cast<size_t>(timeout));
+    }
+    if (maxRequests > 0) {
+        if (timeout > 0) {
+            write(", ", 2, false);
+        }
+        write("max=", 4, false);
+        bufferNumber(static_cast<size_t>(maxRequests) - _requestsReceived);
+    }
+    write("\r\n", 2, false);
+}
+
+// The headers describing a static file, other than its length and Expires.
+bool Connection::bufferStaticFileHeaders(const std::string& path, time_t modified) {
+    char lastModified[64];
+    const auto lastModifiedLength = webtime(modified, lastModified, sizeof(lastModified));
+    if (!bufferHeader("Content-Type", getContentType(path))
+        || !bufferLine("Accept-Ranges: bytes")
+        || !bufferHeader("Last-Modified", std::string_view(lastModified, lastModifiedLength))) {
+        return false;
+    }
+    return isCacheable(path) || (bufferLine("Cache-Control: no-store") && bufferLine("Pragma: no-cache"));
+}
+
+bool Connection::httpKeepAliveExpired(std::chrono::steady_clock::time_point now,
+                                      std::chrono::seconds timeout) const {
+    return !_client && _state == State::READING_HEADERS && _bytesReceived > 0
+           && _outBuf.empty() && !closed() && now - _lastActivity >= timeout;
+}
+
 void Connection::setLinger() {
     if (_fd == -1) {
         return;
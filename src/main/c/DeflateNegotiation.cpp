@@ -0,0 +1,184 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/DeflateNegotiation.h"
+
+#include "seasocks/StringUtil.h"
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+constexpr int MinWindowBits = 8;
+constexpr int MaxWindowBits = 15;
+// zlib refuses to create raw deflate streams with an 8 bit window.
+constexpr int MinDeflateWindowBits = 9;
+
+std::string unquote(const std::string& value) {
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+        return value.substr(1, value.size() - 2);
+    }
+    return value;
+}
+
+// Parses a window bits value, which may be quoted (RFC 7692 section 7.1.2).
+bool parseWindowBits(std::string value, int& bits) {
+    value = unquote(value);
+    if (value.empty() || value.size() > 2
+        || !std::all_of(value.begin(), value.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+        return false;
+    }
+    bits = std::atoi(value.c_str());
+    return bits >= MinWindowBits && bits <= MaxWindowBits;
+}
+
+struct Offer {
+    bool serverNoContextTakeover = false;
+    bool clientNoContextTakeover = false;
+    int serverMaxWindowBits = 0;
+    bool clientMaxWindowBits = false;
+    int clientMaxWindowBitsValue = 0;
+    std::string dictionaryId;
+};
+
+// Parses the parameters of a single permessage-deflate offer. Unknown, duplicate
+// or malformed parameters make the whole offer unacceptable.
+bool parseOffer(const std::vector<std::string>& params, Offer& offer) {
+    bool seenServerMaxWindowBits = false;
+    for (size_t i = 1; i < params.size(); ++i) {
+        auto param = seasocks::trimWhitespace(params[i]);
+        std::string name = param;
+        std::string value;
+        bool hasValue = false;
+        auto equals = param.find('=');
+        if (equals != std::string::npos) {
+            name = seasocks::trimWhitespace(param.substr(0, equals));
+            value = seasocks::trimWhitespace(param.substr(equals + 1));
+            hasValue = true;
+        }
+        if (seasocks::caseInsensitiveSame(name, "server_no_context_takeover")) {
+            if (hasValue || offer.serverNoContextTakeover)
+                return false;
+            offer.serverNoContextTakeover = true;
+        } else if (seasocks::caseInsensitiveSame(name, "client_no_context_takeover")) {
+            if (hasValue || offer.clientNoContextTakeover)
+                return false;
+            offer.clientNoContextTakeover = true;
+        } else if (seasocks::caseInsensitiveSame(name, "server_max_window_bits")) {
+            if (!hasValue || seenServerMaxWindowBits || !parseWindowBits(value, offer.serverMaxWindowBits))
+                return false;
+            seenServerMaxWindowBits = true;
+        } else if (seasocks::caseInsensitiveSame(name, "client_max_window_bits")) {
+            if (offer.clientMaxWindowBits)
+                return false;
+            if (hasValue && !parseWindowBits(value, offer.clientMaxWindowBitsValue))
+                return false;
+            offer.clientMaxWindowBits = true;
+        } else if (seasocks::caseInsensitiveSame(name, "seasocks_dictionary")) {
+            if (!hasValue || !offer.dictionaryId.empty())
+                return false;
+            offer.dictionaryId = unquote(value);
+            if (offer.dictionaryId.empty())
+                return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+namespace seasocks {
+
+std::string DeflateParameters::responseHeader() const {
+    std::string header = "permessage-deflate";
+    if (serverNoContextTakeover) {
+        header += "; server_no_context_takeover";
+    }
+    if (clientNoContextTakeover) {
+        header += "; client_no_context_takeover";
+    }
+    if (sendServerMaxWindowBits) {
+        header += "; server_max_window_bits=" + std::to_string(serverMaxWindowBits);
+    }
+    if (sendClientMaxWindowBits) {
+        header += "; client_max_window_bits=" + std::to_string(clientMaxWindowBits);
+    }
+    if (!dictionaryId.empty()) {
+        header += "; seasocks_dictionary=" + dictionaryId;
+    }
+    return header;
+}
+
+bool negotiatePerMessageDeflate(const std::string& extensionsHeader,
+                                const PerMessageDeflateOptions& options,
+                                DeflateParameters& result,
+                                const std::string& dictionaryId) {
+    auto serverPolicyBits = std::clamp(options.serverMaxWindowBits, MinDeflateWindowBits, MaxWindowBits);
+    auto clientPolicyBits = std::clamp(options.clientMaxWindowBits, MinWindowBits, MaxWindowBits);
+    for (auto& extension : split(extensionsHeader, ',')) {
+        auto params = split(extension, ';');
+        if (params.empty() || !caseInsensitiveSame(trimWhitespace(params[0]), "permessage-deflate")) {
+            continue;
+        }
+        Offer offer;
+        if (!parseOffer(params, offer)) {
+            continue;
+        }
+        if (!offer.dictionaryId.empty() && offer.dictionaryId != dictionaryId) {
+            // We don't have that dictionary; the client may offer plain deflate next.
+            continue;
+        }
+        DeflateParameters negotiated;
+        negotiated.serverMaxWindowBits = serverPolicyBits;
+        if (offer.serverMaxWindowBits) {
+            if (offer.serverMaxWindowBits < MinDeflateWindowBits) {
+                // We can't honour an 8 bit window; try the next offer.
+                continue;
+            }
+            negotiated.serverMaxWindowBits = std::min(serverPolicyBits, offer.serverMaxWindowBits);
+        }
+        negotiated.sendServerMaxWindowBits = negotiated.serverMaxWindowBits < MaxWindowBits
+                                             || offer.serverMaxWindowBits != 0;
+        negotiated.serverNoContextTakeover = offer.serverNoContextTakeover || options.serverNoContextTakeover;
+        negotiated.clientNoContextTakeover = offer.clientNoContextTakeover || options.clientNoContextTakeover;
+        if (offer.clientMaxWindowBits) {
+            // The client has told us it can limit its window: it'll use at most
+            // its own hint, or whatever we reply with if that's smaller.
+            negotiated.clientMaxWindowBits = offer.clientMaxWindowBitsValue
+                                                 ? std::min(clientPolicyBits, offer.clientMaxWindowBitsValue)
+                                                 : clientPolicyBits;
+            negotiated.sendClientMaxWindowBits = negotiated.clientMaxWindowBits < MaxWindowBits;
+        }
+        negotiated.dictionaryId = offer.dictionaryId;
+        result = negotiated;
+        return true;
+    }
+    return false;
+}
+
+}
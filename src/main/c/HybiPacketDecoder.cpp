@@ -86,15 +86,15 @@ HybiPacketDecoder::MessageState HybiPacketDecoder::decodeNextMessage(
         payloadLength = __bswap_64(raw_length);
         ptr += 8;
     }
-    uint32_t mask = 0;
+    // The mask repeated to fill a 64 bit word, so we can unmask a word at a time.
+    uint8_t mask[8] = {};
     if (maskBit) {
         // MASK is set.
         if (_buffer.size() < ptr + 4) {
             return MessageState::NoMessage;
         }
-        uint32_t raw_length;
-        memcpy(&raw_length, &_buffer[ptr], sizeof(raw_length));
-        mask = htonl(raw_length);
+        memcpy(mask, &_buffer[ptr], 4);
+        memcpy(mask + 4, mask, 4);
         ptr += 4;
     }
     auto bytesLeftInBuffer = _buffer.size() - ptr;
@@ -102,13 +102,23 @@ HybiPacketDecoder::MessageState HybiPacketDecoder::decodeNextMessage(
         return MessageState::NoMessage;
     }
 
-    messageOut.clear();
-    messageOut.reserve(static_cast<size_t>(payloadLength));
-    for (auto i = 0u; i < payloadLength; ++i) {
-        auto byteShift = (3 - (i & 3)) * 8;
-        messageOut.push_back(static_cast<uint8_t>((_buffer[ptr++] ^ (mask >> byteShift)) & 0xff));
+    auto length = static_cast<size_t>(payloadLength);
+    messageOut.resize(length);
+    const uint8_t* in = _buffer.data() + ptr;
+    uint8_t* out = messageOut.data();
+    size_t i = 0;
+    uint64_t mask64;
+    memcpy(&mask64, mask, sizeof(mask64));
+    for (; i + sizeof(mask64) <= length; i += sizeof(mask64)) {
+        uint64_t word;
+        memcpy(&word, in + i, sizeof(word));
+        word ^= mask64;
+        memcpy(out + i, &word, sizeof(word));
+    }
+    for (; i < length; ++i) {
+        out[i] = in[i] ^ mask[i & 3];
     }
-    _messageStart = ptr;
+    _messageStart = ptr + length;
     switch (opcode) {
         default:
             LS_WARNING(&_logger, "Received hybi frame with unknown opcode "
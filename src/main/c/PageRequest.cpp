@@ -25,6 +25,7 @@
 
 #include "internal/PageRequest.h"
 
+#include <charconv>
 #include <cstdlib>
 #include <cstring>
 #include <algorithm>
@@ -36,14 +37,14 @@ PageRequest::PageRequest(
     const std::string& requestUri,
     Server& server,
     Verb verb,
-    HeaderMap&& headers)
+    RequestHeaders&& headers)
         : _credentials(std::make_shared<Credentials>()),
           _remoteAddress(remoteAddress),
           _requestUri(requestUri),
           _server(server),
           _verb(verb),
           _headers(std::move(headers)),
-          _contentLength(getUintHeader("Content-Length")) {
+          _contentLength(getUintHeader(KnownHeader::ContentLength)) {
 }
 
 bool PageRequest::consumeContent(std::vector<uint8_t>& buffer) {
@@ -59,16 +60,13 @@ bool PageRequest::consumeContent(std::vector<uint8_t>& buffer) {
     return true;
 }
 
-size_t PageRequest::getUintHeader(const std::string& name) const {
-    const auto iter = _headers.find(name);
-    if (iter == _headers.end()) {
-        return 0u;
-    }
-    try {
-        return std::max(std::stoi(iter->second), 0);
-    } catch (const std::logic_error&) {
+size_t PageRequest::getUintHeader(KnownHeader header) const {
+    const auto value = _headers.get(header);
+    int result = 0;
+    if (std::from_chars(value.data(), value.data() + value.size(), result).ec != std::errc()) {
         return 0u;
     }
+    return static_cast<size_t>(std::max(result, 0));
 }
 
 } // namespace seasocks
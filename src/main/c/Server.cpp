@@ -24,18 +24,25 @@
 // POSSIBILITY OF SUCH DAMAGE.
 
 #include "internal/Config.h"
+#include "internal/HybiPacketDecoder.h"
 #include "internal/LogStream.h"
+#include "internal/StaticFileCache.h"
+#include "internal/TopicRegistry.h"
+#include "internal/WorkerPool.h"
 
 #include "seasocks/Connection.h"
 #include "seasocks/Logger.h"
 #include "seasocks/Server.h"
 #include "seasocks/PageHandler.h"
+#include "seasocks/RequestBodyHandler.h"
 #include "seasocks/StringUtil.h"
 #include "seasocks/util/Json.h"
 #include <cassert>
 #ifdef _WIN32
 #include "seasocks/win32/winsock_includes.h"
+#include <ws2tcpip.h>
 #else
+#include <netdb.h>
 #include <netinet/tcp.h>
 #include <netinet/in.h>
 #endif
@@ -52,6 +59,7 @@
 #include <sys/types.h>
 #endif
 
+#include <chrono>
 #include <memory>
 #include <stdexcept>
 #include <cstring>
@@ -106,6 +114,9 @@ std::ostream& operator<<(std::ostream& o, const EventBits& b) {
 
 constexpr int EpollTimeoutMillis = 500; // Twice a second is ample.
 constexpr int DefaultLameConnectionTimeoutSeconds = 10;
+constexpr int DefaultWebSocketPongTimeoutSeconds = 10;
+constexpr int DefaultWebSocketCloseTimeoutSeconds = 5;
+constexpr int DefaultHttpKeepAliveTimeoutSeconds = 60;
 
 }
 
@@ -146,13 +157,20 @@ Server::Server(std::shared_ptr<Logger> logger)
         : _logger(logger), _listenSock(InvalidSocket), _epollFd(EpollBadHandle), _eventFd(EpollBadHandle),
           _maxKeepAliveDrops(0),
           _lameConnectionTimeoutSeconds(DefaultLameConnectionTimeoutSeconds),
+          _webSocketPingIntervalSeconds(0),
+          _webSocketPongTimeoutSeconds(DefaultWebSocketPongTimeoutSeconds),
+          _webSocketCloseTimeoutSeconds(DefaultWebSocketCloseTimeoutSeconds),
+          _httpKeepAliveTimeoutSeconds(DefaultHttpKeepAliveTimeoutSeconds),
+          _httpKeepAliveMaxRequests(0),
           _clientBufferSize(DefaultClientBufferSize),
-          _nextDeadConnectionCheck(0), _threadId(0), _terminate(false),
+          _nextDeadConnectionCheck(0), _topics(std::make_unique<TopicRegistry>()),
+          _threadId(0), _terminate(false),
           _expectedTerminate(false) {
 
 #ifdef _WIN32
     init_winsock();
 #endif
+    updateHttpDate(time(nullptr));
 
     _epollFd = epoll_create(10);
     if (_epollFd == EpollBadHandle) {
@@ -181,6 +199,9 @@ Server::Server(std::shared_ptr<Logger> logger)
 
 Server::~Server() {
     LS_INFO(_logger, "Server destruction");
+    // Let any compression jobs finish while everything they hand back to is
+    // still here.
+    _compressionWorkers.reset();
     shutdown();
 // Only shut the eventfd and epoll at the very end
 #ifndef _WIN32
@@ -431,6 +452,8 @@ void Server::checkAndDispatchEpoll(int epollMillis) {
         }
         return;
     }
+    // We may have slept a while: make sure responses to these events are dated now.
+    updateHttpDate(time(nullptr));
     if (numEvents == maxEvents) {
         static time_t lastWarnTime = 0;
         time_t now = time(nullptr);
@@ -546,10 +569,16 @@ Server::PollResult Server::poll(int millis) {
 }
 
 void Server::processEventQueue() {
-    runExecutables();
     time_t now = time(nullptr);
+    updateHttpDate(now);
+    runExecutables();
     if (now < _nextDeadConnectionCheck)
         return;
+    auto steadyNow = std::chrono::steady_clock::now();
+    std::chrono::seconds pingInterval(_webSocketPingIntervalSeconds);
+    std::chrono::seconds pongTimeout(_webSocketPongTimeoutSeconds);
+    std::chrono::seconds closeTimeout(_webSocketCloseTimeoutSeconds);
+    std::chrono::seconds keepAliveTimeout(_httpKeepAliveTimeoutSeconds);
     std::list<Connection*> toRemove;
     for (auto _connection : _connections) {
         time_t numSecondsSinceConnection = now - _connection.second;
@@ -559,6 +588,21 @@ void Server::processEventQueue() {
                                  << " : Killing lame connection - no bytes received after "
                                  << numSecondsSinceConnection << "s");
             toRemove.push_back(connection);
+        } else if (connection->closeHandshakeExpired(steadyNow, closeTimeout)) {
+            LS_INFO(_logger, formatAddress(connection->getRemoteAddress())
+                                 << " : Killing WebSocket - close handshake not completed after "
+                                 << _webSocketCloseTimeoutSeconds << "s");
+            toRemove.push_back(connection);
+        } else if (_webSocketPingIntervalSeconds > 0 && !connection->checkKeepAlive(steadyNow, pingInterval, pongTimeout)) {
+            LS_INFO(_logger, formatAddress(connection->getRemoteAddress())
+                                 << " : Killing unresponsive WebSocket - no pong after "
+                                 << _webSocketPongTimeoutSeconds << "s");
+            toRemove.push_back(connection);
+        } else if (_httpKeepAliveTimeoutSeconds > 0 && connection->httpKeepAliveExpired(steadyNow, keepAliveTimeout)) {
+            LS_DEBUG(_logger, formatAddress(connection->getRemoteAddress())
+                                  << " : Closing idle keep-alive connection after "
+                                  << _httpKeepAliveTimeoutSeconds << "s");
+            toRemove.push_back(connection);
         }
     }
     for (auto& it : toRemove) {
@@ -566,6 +610,15 @@ void Server::processEventQueue() {
     }
 }
 
+void Server::updateHttpDate(time_t now) {
+    // Formatting the date is surprisingly expensive, and every response needs
+    // it: do it at most once a second rather than once per response.
+    if (now != _httpDateTime) {
+        _httpDate = webtime(now);
+        _httpDateTime = now;
+    }
+}
+
 void Server::runExecutables() {
     decltype(_pendingExecutables) copy;
     std::unique_lock<decltype(_pendingExecutableMutex)> lock(_pendingExecutableMutex);
@@ -609,6 +662,69 @@ void Server::handleAccept() {
     _connections.insert(std::make_pair(newConnection, time(nullptr)));
 }
 
+WebSocket* Server::connectWebSocket(const std::string& host, int port, const std::string& path,
+                                    std::shared_ptr<WebSocket::Handler> handler) {
+    checkThread();
+    auto port16 = static_cast<uint16_t>(port);
+    if (port != port16) {
+        LS_ERROR(_logger, "Invalid port: " << port);
+        return nullptr;
+    }
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* resolved = nullptr;
+    if (getaddrinfo(host.c_str(), nullptr, &hints, &resolved) != 0 || resolved == nullptr) {
+        LS_ERROR(_logger, "Unable to resolve " << host);
+        return nullptr;
+    }
+    sockaddr_in address;
+    memcpy(&address, resolved->ai_addr, sizeof(address));
+    freeaddrinfo(resolved);
+    address.sin_port = htons(port16);
+
+    NativeSocketType fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == InvalidSocket) {
+        LS_ERROR(_logger, "Unable to create socket: " << getLastError());
+        return nullptr;
+    }
+    auto closeFd = [fd] {
+#ifdef _WIN32
+        ::closesocket(fd);
+#else
+        ::close(fd);
+#endif
+    };
+    if (!configureSocket(fd)) {
+        closeFd();
+        return nullptr;
+    }
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == -1) {
+#ifdef _WIN32
+        bool inProgress = WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+        bool inProgress = errno == EINPROGRESS;
+#endif
+        if (!inProgress) {
+            LS_ERROR(_logger, "Unable to connect to " << formatAddress(address) << ": " << getLastError());
+            closeFd();
+            return nullptr;
+        }
+    }
+    LS_INFO(_logger, formatAddress(address) << " : Connecting on descriptor " << fd);
+    Connection* newConnection = new Connection(_logger, *this, fd, address);
+    epoll_event event = {EPOLLIN, {newConnection}};
+    if (epoll_ctl(_epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        LS_ERROR(_logger, "Unable to add socket to epoll: " << getLastError());
+        delete newConnection; // Closes the socket.
+        return nullptr;
+    }
+    _connections.insert(std::make_pair(newConnection, time(nullptr)));
+    newConnection->startClientHandshake(host + ":" + std::to_string(port), path, handler);
+    return newConnection;
+}
+
 void Server::remove(Connection* connection) {
     checkThread();
     epoll_event event = {0, {connection}};
@@ -616,10 +732,11 @@ void Server::remove(Connection* connection) {
         LS_ERROR(_logger, "Unable to remove from epoll: " << getLastError());
     }
     _connections.erase(connection);
+    _topics->unsubscribeAll(connection);
 }
 
 bool Server::subscribeToWriteEvents(Connection* connection) {
-    epoll_event event = {EPOLLIN | EPOLLOUT, {connection}};
+    epoll_event event = {(connection->readingPaused() ? 0u : EPOLLIN) | EPOLLOUT, {connection}};
     if (epoll_ctl(_epollFd, EPOLL_CTL_MOD, connection->getFd(), &event) == -1) {
         LS_ERROR(_logger, "Unable to subscribe to write events: " << getLastError());
         return false;
@@ -628,7 +745,7 @@ bool Server::subscribeToWriteEvents(Connection* connection) {
 }
 
 bool Server::unsubscribeFromWriteEvents(Connection* connection) {
-    epoll_event event = {EPOLLIN, {connection}};
+    epoll_event event = {connection->readingPaused() ? 0u : EPOLLIN, {connection}};
     if (epoll_ctl(_epollFd, EPOLL_CTL_MOD, connection->getFd(), &event) == -1) {
         LS_ERROR(_logger, "Unable to unsubscribe from write events: " << getLastError());
         return false;
@@ -636,11 +753,33 @@ bool Server::unsubscribeFromWriteEvents(Connection* connection) {
     return true;
 }
 
+bool Server::subscribeToReadEvents(Connection* connection) {
+    epoll_event event = {EPOLLIN | (connection->registeredForWriteEvents() ? EPOLLOUT : 0u), {connection}};
+    if (epoll_ctl(_epollFd, EPOLL_CTL_MOD, connection->getFd(), &event) == -1) {
+        LS_ERROR(_logger, "Unable to subscribe to read events: " << getLastError());
+        return false;
+    }
+    return true;
+}
+
+bool Server::unsubscribeFromReadEvents(Connection* connection) {
+    epoll_event event = {connection->registeredForWriteEvents() ? EPOLLOUT : 0u, {connection}};
+    if (epoll_ctl(_epollFd, EPOLL_CTL_MOD, connection->getFd(), &event) == -1) {
+        LS_ERROR(_logger, "Unable to unsubscribe from read events: " << getLastError());
+        return false;
+    }
+    return true;
+}
+
 void Server::addWebSocketHandler(const char* endpoint, std::shared_ptr<WebSocket::Handler> handler,
                                  bool allowCrossOriginRequests) {
     _webSocketHandlerMap[endpoint] = {handler, allowCrossOriginRequests};
 }
 
+void Server::addRequestBodyHandler(const char* endpoint, std::shared_ptr<RequestBodyHandler> handler) {
+    _requestBodyHandlers[endpoint] = handler;
+}
+
 void Server::addPageHandler(std::shared_ptr<PageHandler> handler) {
     _pageHandlers.emplace_back(handler);
 }
@@ -654,6 +793,15 @@ bool Server::isCrossOriginAllowed(const std::string& endpoint) const {
     return iter->second.allowCrossOrigin;
 }
 
+const CompressionPolicy& Server::getCompressionPolicy(const std::string& endpoint) const {
+    auto splits = split(endpoint, '?');
+    auto iter = _compressionPolicies.find(splits[0]);
+    if (iter == _compressionPolicies.end()) {
+        return _defaultCompressionPolicy;
+    }
+    return iter->second;
+}
+
 std::shared_ptr<WebSocket::Handler> Server::getWebSocketHandler(const char* endpoint) const {
     auto splits = split(endpoint, '?');
     auto iter = _webSocketHandlerMap.find(splits[0]);
@@ -663,6 +811,15 @@ std::shared_ptr<WebSocket::Handler> Server::getWebSocketHandler(const char* endp
     return iter->second.handler;
 }
 
+std::shared_ptr<RequestBodyHandler> Server::getRequestBodyHandler(const char* endpoint) const {
+    auto splits = split(endpoint, '?');
+    auto iter = _requestBodyHandlers.find(splits[0]);
+    if (iter == _requestBodyHandlers.end()) {
+        return std::shared_ptr<RequestBodyHandler>();
+    }
+    return iter->second;
+}
+
 void Server::execute(std::shared_ptr<Runnable> runnable) {
     execute([runnable] { runnable->run(); });
 }
@@ -687,12 +844,144 @@ void Server::execute(std::function<void()> toExecute) {
 #endif
 }
 
+void Server::broadcast(const std::vector<WebSocket*>& sockets, const char* data) {
+    broadcast(sockets, static_cast<uint8_t>(HybiPacketDecoder::Opcode::Text),
+              reinterpret_cast<const uint8_t*>(data), strlen(data));
+}
+
+void Server::broadcast(const std::vector<WebSocket*>& sockets, std::string_view data) {
+    broadcast(sockets, static_cast<uint8_t>(HybiPacketDecoder::Opcode::Text),
+              reinterpret_cast<const uint8_t*>(data.data()), data.size());
+}
+
+void Server::broadcast(const std::vector<WebSocket*>& sockets, const uint8_t* data, size_t length) {
+    broadcast(sockets, static_cast<uint8_t>(HybiPacketDecoder::Opcode::Binary), data, length);
+}
+
+bool Server::subscribe(WebSocket* socket, const std::string& topic) {
+    checkThread();
+    auto* subscribed = _topics->subscribe(socket, topic);
+    if (!subscribed) {
+        return false;
+    }
+    if (subscribed->hasRetained) {
+        if (subscribed->retainedIsText) {
+            socket->send(std::string_view(subscribed->retained));
+        } else {
+            socket->send(reinterpret_cast<const uint8_t*>(subscribed->retained.data()), subscribed->retained.size());
+        }
+    }
+    return true;
+}
+
+bool Server::unsubscribe(WebSocket* socket, const std::string& topic) {
+    checkThread();
+    return _topics->unsubscribe(socket, topic);
+}
+
+void Server::publish(const std::string& topic, const char* data, bool retain) {
+    publish(topic, static_cast<uint8_t>(HybiPacketDecoder::Opcode::Text),
+            reinterpret_cast<const uint8_t*>(data), strlen(data), retain);
+}
+
+void Server::publish(const std::string& topic, std::string_view data, bool retain) {
+    publish(topic, static_cast<uint8_t>(HybiPacketDecoder::Opcode::Text),
+            reinterpret_cast<const uint8_t*>(data.data()), data.size(), retain);
+}
+
+void Server::publish(const std::string& topic, const uint8_t* data, size_t length, bool retain) {
+    publish(topic, static_cast<uint8_t>(HybiPacketDecoder::Opcode::Binary), data, length, retain);
+}
+
+void Server::publish(const std::string& topic, uint8_t opcode, const uint8_t* data, size_t length, bool retain) {
+    checkThread();
+    auto* published = retain ? &_topics->findOrCreate(topic) : _topics->find(topic);
+    if (!published) {
+        return;
+    }
+    if (retain) {
+        published->hasRetained = true;
+        published->retainedIsText = opcode == static_cast<uint8_t>(HybiPacketDecoder::Opcode::Text);
+        published->retained.assign(reinterpret_cast<const char*>(data), length);
+    }
+    if (!published->subscribers.empty()) {
+        broadcast(published->subscribers, opcode, data, length);
+    }
+}
+
+void Server::clearRetained(const std::string& topic) {
+    checkThread();
+    _topics->clearRetained(topic);
+}
+
+size_t Server::numSubscribers(const std::string& topic) const {
+    checkThread();
+    auto* found = _topics->find(topic);
+    return found ? found->subscribers.size() : 0;
+}
+
+void Server::broadcast(const std::vector<WebSocket*>& sockets, uint8_t opcode, const uint8_t* data, size_t length) {
+    checkThread();
+    // Group the connections that can share a compressed frame by everything that
+    // affects the compressed output. Everyone else gets the message individually.
+    using GroupKey = std::tuple<int, int, CompressionPolicy::Strategy, std::string>;
+    std::map<GroupKey, std::vector<Connection*>> groups;
+    for (auto* socket : sockets) {
+        auto* connection = dynamic_cast<Connection*>(socket);
+        if (connection && connection->canShareCompressedFrames() && connection->shouldCompress(data, length)) {
+            const auto& policy = connection->compressionPolicy();
+            groups[GroupKey(connection->deflateWindowBits(), policy.level, policy.strategy,
+                            connection->deflateDictionaryId())]
+                .push_back(connection);
+        } else if (opcode == static_cast<uint8_t>(HybiPacketDecoder::Opcode::Text)) {
+            socket->send(std::string_view(reinterpret_cast<const char*>(data), length));
+        } else {
+            socket->send(data, length);
+        }
+    }
+    std::vector<uint8_t> compressed;
+    for (auto& group : groups) {
+        auto& connections = group.second;
+        auto& compressor = broadcastCompressor(std::get<0>(group.first), connections.front()->compressionPolicy(),
+                                               !std::get<3>(group.first).empty());
+        compressed.clear();
+        compressor.deflate(data, length, compressed);
+        LS_DEBUG(_logger, "Broadcast compression result: " << length << " bytes -> " << compressed.size()
+                                                           << " bytes, shared by " << connections.size() << " connections");
+        for (auto* connection : connections) {
+            if (compressed.size() < length) {
+                connection->sendCompressed(opcode, compressed.data(), compressed.size(), length);
+            } else {
+                connection->sendUncompressed(opcode, data, length);
+            }
+        }
+    }
+}
+
+ZlibContext& Server::broadcastCompressor(int windowBits, const CompressionPolicy& policy, bool useDictionary) {
+    auto memLevel = _perMessageDeflateOptions.memLevel;
+    auto dictionaryId = useDictionary ? policy.dictionaryId : std::string();
+    auto& compressor = _broadcastCompressors[BroadcastCompressorKey(windowBits, memLevel, policy.level, policy.strategy,
+                                                                    dictionaryId)];
+    if (!compressor) {
+        compressor = std::make_unique<ZlibContext>();
+        compressor->initialise(windowBits, windowBits, memLevel, true, true);
+        compressor->setCompression(policy.level, policy.strategy);
+        if (useDictionary) {
+            compressor->setDictionary(reinterpret_cast<const uint8_t*>(policy.dictionary.data()),
+                                      policy.dictionary.size());
+        }
+    }
+    return *compressor;
+}
+
 std::string Server::getStatsDocument() const {
     std::ostringstream doc;
     doc << "clear();\n";
     for (auto _connection : _connections) {
         doc << "connection({";
         auto connection = _connection.first;
+        const auto& stats = connection->compressionStats();
         jsonKeyPairToStream(doc,
                             "since", EpochTimeAsLocal(_connection.second),
                             "fd", connection->getFd(),
@@ -703,7 +992,14 @@ std::string Server::getStatsDocument() const {
                             "input", connection->inputBufferSize(),
                             "read", connection->bytesReceived(),
                             "output", connection->outputBufferSize(),
-                            "written", connection->bytesSent());
+                            "written", connection->bytesSent(),
+                            "deflateSaved", static_cast<int64_t>(stats.bytesBeforeCompression) - static_cast<int64_t>(stats.bytesAfterCompression),
+                            "deflateMicros", std::chrono::duration_cast<std::chrono::microseconds>(stats.timeCompressing).count(),
+                            "rtt", connection->lastRoundTripTime().count(),
+                            "rttAvg", connection->averageRoundTripTime().count(),
+                            "queued", connection->queuedMessageCount(),
+                            "conflated", connection->messagesConflated(),
+                            "expired", connection->messagesExpired());
         doc << "});\n";
     }
     return doc.str();
@@ -714,11 +1010,41 @@ void Server::setLameConnectionTimeoutSeconds(int seconds) {
     _lameConnectionTimeoutSeconds = seconds;
 }
 
+void Server::setWebSocketPingIntervalSeconds(int seconds) {
+    LS_INFO(_logger, "Setting WebSocket ping interval to " << seconds);
+    _webSocketPingIntervalSeconds = seconds;
+}
+
+void Server::setWebSocketPongTimeoutSeconds(int seconds) {
+    LS_INFO(_logger, "Setting WebSocket pong timeout to " << seconds);
+    _webSocketPongTimeoutSeconds = seconds;
+}
+
+void Server::setWebSocketCloseTimeoutSeconds(int seconds) {
+    LS_INFO(_logger, "Setting WebSocket close timeout to " << seconds);
+    _webSocketCloseTimeoutSeconds = seconds;
+}
+
+void Server::setHttpKeepAliveTimeoutSeconds(int seconds) {
+    LS_INFO(_logger, "Setting HTTP keep-alive timeout to " << seconds);
+    _httpKeepAliveTimeoutSeconds = seconds;
+}
+
+void Server::setHttpKeepAliveMaxRequests(int maxRequests) {
+    LS_INFO(_logger, "Setting HTTP keep-alive max requests to " << maxRequests);
+    _httpKeepAliveMaxRequests = maxRequests;
+}
+
 void Server::setMaxKeepAliveDrops(int maxKeepAliveDrops) {
     LS_INFO(_logger, "Setting max keep alive drops to " << maxKeepAliveDrops);
     _maxKeepAliveDrops = maxKeepAliveDrops;
 }
 
+void Server::setUtf8ValidationEnabled(bool enabled) {
+    LS_INFO(_logger, "Setting UTF-8 validation to " << (enabled ? "enabled" : "disabled"));
+    _utf8ValidationEnabled = enabled;
+}
+
 void Server::setPerMessageDeflateEnabled(bool enabled) {
     if (!Config::deflateEnabled) {
         LS_ERROR(_logger, "Ignoring request to enable deflate as Seasocks was compiled without support");
@@ -728,6 +1054,62 @@ void Server::setPerMessageDeflateEnabled(bool enabled) {
     _perMessageDeflateEnabled = enabled;
 }
 
+void Server::setHttpCompressionOptions(const HttpCompressionOptions& options) {
+    if (options.enabled && !Config::deflateEnabled) {
+        LS_ERROR(_logger, "Ignoring request to enable HTTP compression as Seasocks was compiled without support");
+        return;
+    }
+    LS_INFO(_logger, "Setting HTTP compression to " << (options.enabled ? "enabled" : "disabled")
+                                                     << ", minimum size " << options.minimumSize
+                                                     << ", level " << options.level);
+    _httpCompressionOptions = options;
+}
+
+void Server::setStaticFileCacheOptions(const StaticFileCacheOptions& options) {
+    LS_INFO(_logger, "Setting static file cache to " << (options.enabled ? "enabled" : "disabled")
+                                                      << ", budget " << options.memoryBudget << " bytes");
+    _staticFileCache = options.enabled ? std::make_unique<StaticFileCache>(options) : nullptr;
+}
+
+void Server::setPerMessageDeflateOptions(const PerMessageDeflateOptions& options) {
+    LS_INFO(_logger, "Setting per-message deflate options: server window bits " << options.serverMaxWindowBits
+                                                                                  << ", client window bits " << options.clientMaxWindowBits
+                                                                                  << ", memLevel " << options.memLevel);
+    _perMessageDeflateOptions = options;
+}
+
+void Server::setCompressionPolicy(const CompressionPolicy& policy) {
+    _defaultCompressionPolicy = policy;
+}
+
+void Server::setCompressionPolicy(const char* endpoint, const CompressionPolicy& policy) {
+    _compressionPolicies[endpoint] = policy;
+}
+
+void Server::setCompressionOffload(size_t thresholdBytes, size_t numThreads) {
+    LS_INFO(_logger, "Setting compression offload threshold to " << thresholdBytes << " bytes, with "
+                                                                   << numThreads << " worker threads");
+    _compressionOffloadThreshold = numThreads > 0 ? thresholdBytes : 0;
+    if (_compressionOffloadThreshold == 0) {
+        _compressionWorkers.reset();
+    } else if (!_compressionWorkers || _compressionWorkers->numThreads() != numThreads) {
+        _compressionWorkers = std::make_unique<WorkerPool>(numThreads);
+    }
+}
+
+void Server::offload(std::function<void()> work, std::function<void()> done) {
+    if (!_compressionWorkers) {
+        // Offloading was turned off after the connection decided to use it.
+        work();
+        execute(std::move(done));
+        return;
+    }
+    _compressionWorkers->submit([this, work = std::move(work), done = std::move(done)]() mutable {
+        work();
+        execute(std::move(done));
+    });
+}
+
 void Server::checkThread() const {
     auto thisTid = gettid();
     if (thisTid != _threadId) {
@@ -747,6 +1129,15 @@ std::shared_ptr<Response> Server::handle(const Request& request) {
     return Response::unhandled();
 }
 
+std::shared_ptr<Response> Server::checkRequestBody(const Request& request) {
+    for (const auto& handler : _pageHandlers) {
+        auto result = handler->checkRequestBody(request);
+        if (result != Response::unhandled())
+            return result;
+    }
+    return Response::unhandled();
+}
+
 void Server::setClientBufferSize(size_t bytesToBuffer) {
     LS_INFO(_logger, "Setting client buffer size to " << bytesToBuffer << " bytes");
     _clientBufferSize = bytesToBuffer;
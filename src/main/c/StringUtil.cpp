@@ -139,6 +139,11 @@ bool caseInsensitiveSame(const std::string& lhs, const std::string& rhs) {
 
 
 std::string webtime(time_t time) {
+    char buf[1024];
+    return std::string(buf, webtime(time, buf, sizeof(buf)));
+}
+
+size_t webtime(time_t time, char* buf, size_t size) {
     struct tm timeValue;
 #ifdef _WIN32
     gmtime_s(&timeValue, &time);
@@ -146,14 +151,20 @@ std::string webtime(time_t time) {
     gmtime_r(&time, &timeValue);
 #endif
 
-    char buf[1024];
     // Wed, 20 Apr 2011 17:31:28 GMT
-    strftime(buf, sizeof(buf) - 1, "%a, %d %b %Y %H:%M:%S %Z", &timeValue);
-    return buf;
+    return strftime(buf, size, "%a, %d %b %Y %H:%M:%S %Z", &timeValue);
 }
 
-std::string now() {
-    return webtime(time(nullptr));
+const std::string& now() {
+    // Only reformat the date when the second ticks over.
+    thread_local time_t cachedTime = -1;
+    thread_local std::string cached;
+    auto timeNow = time(nullptr);
+    if (timeNow != cachedTime) {
+        cached = webtime(timeNow);
+        cachedTime = timeNow;
+    }
+    return cached;
 }
 
 std::string getWorkingDir() {
@@ -0,0 +1,122 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/TopicRegistry.h"
+
+#include <algorithm>
+
+namespace seasocks {
+
+TopicRegistry::Topic* TopicRegistry::subscribe(WebSocket* socket, const std::string& name) {
+    auto& subscriptions = _topicsBySocket[socket];
+    if (findSubscription(subscriptions, name) != subscriptions.end()) {
+        return nullptr;
+    }
+    auto& topic = findOrCreate(name);
+    subscriptions.push_back(Subscription{name, topic.subscribers.size()});
+    topic.subscribers.push_back(socket);
+    return &topic;
+}
+
+bool TopicRegistry::unsubscribe(WebSocket* socket, const std::string& name) {
+    auto it = _topicsBySocket.find(socket);
+    if (it == _topicsBySocket.end()) {
+        return false;
+    }
+    auto& subscriptions = it->second;
+    auto subscriptionIt = findSubscription(subscriptions, name);
+    if (subscriptionIt == subscriptions.end()) {
+        return false;
+    }
+    auto index = subscriptionIt->index;
+    *subscriptionIt = std::move(subscriptions.back());
+    subscriptions.pop_back();
+    if (subscriptions.empty()) {
+        _topicsBySocket.erase(it);
+    }
+    removeSubscriber(name, index);
+    return true;
+}
+
+void TopicRegistry::unsubscribeAll(WebSocket* socket) {
+    auto it = _topicsBySocket.find(socket);
+    if (it == _topicsBySocket.end()) {
+        return;
+    }
+    for (const auto& subscription : it->second) {
+        removeSubscriber(subscription.topic, subscription.index);
+    }
+    _topicsBySocket.erase(it);
+}
+
+TopicRegistry::Topic* TopicRegistry::find(const std::string& name) {
+    auto it = _topics.find(name);
+    return it == _topics.end() ? nullptr : &it->second;
+}
+
+TopicRegistry::Topic& TopicRegistry::findOrCreate(const std::string& name) {
+    return _topics[name];
+}
+
+void TopicRegistry::clearRetained(const std::string& name) {
+    auto it = _topics.find(name);
+    if (it == _topics.end()) {
+        return;
+    }
+    if (it->second.subscribers.empty()) {
+        _topics.erase(it);
+        return;
+    }
+    it->second.hasRetained = false;
+    it->second.retained.clear();
+}
+
+TopicRegistry::Subscriptions::iterator TopicRegistry::findSubscription(Subscriptions& subscriptions,
+                                                                       const std::string& name) {
+    // Each socket is only on a handful of topics, so a scan is cheapest.
+    return std::find_if(subscriptions.begin(), subscriptions.end(),
+                        [&name](const Subscription& subscription) { return subscription.topic == name; });
+}
+
+void TopicRegistry::removeSubscriber(const std::string& name, size_t index) {
+    auto it = _topics.find(name);
+    if (it == _topics.end()) {
+        return;
+    }
+    // Order doesn't matter, so move the last into the gap and tell it where it went.
+    auto& subscribers = it->second.subscribers;
+    if (index + 1 < subscribers.size()) {
+        auto moved = subscribers.back();
+        subscribers[index] = moved;
+        auto& movedSubscriptions = _topicsBySocket[moved];
+        findSubscription(movedSubscriptions, name)->index = index;
+    }
+    subscribers.pop_back();
+    if (subscribers.empty() && !it->second.hasRetained) {
+        _topics.erase(it);
+    }
+}
+
+}
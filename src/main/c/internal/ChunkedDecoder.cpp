@@ -0,0 +1,147 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/ChunkedDecoder.h"
+
+#include <cstring>
+#include <limits>
+
+namespace {
+
+int hexValue(uint8_t c) {
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
+}
+
+namespace seasocks {
+
+ChunkedDecoder::Result ChunkedDecoder::decode(uint8_t* data, size_t length, size_t& consumed, size_t& decoded) {
+    size_t in = 0;
+    size_t out = 0;
+    auto finish = [&](Result result) {
+        consumed = in;
+        decoded = out;
+        return result;
+    };
+    while (in < length && _state != State::Done) {
+        const auto c = data[in];
+        switch (_state) {
+            case State::Size: {
+                auto digit = hexValue(c);
+                if (digit >= 0) {
+                    if (_chunkRemaining > (std::numeric_limits<size_t>::max() >> 4)) {
+                        return finish(Result::Error);
+                    }
+                    _chunkRemaining = (_chunkRemaining << 4) | static_cast<size_t>(digit);
+                    _sawDigit = true;
+                } else if (!_sawDigit) {
+                    return finish(Result::Error);
+                } else if (c == ';' || c == ' ' || c == '\t') {
+                    _state = State::Extension;
+                } else if (c == '\r') {
+                    _state = State::SizeLf;
+                } else {
+                    return finish(Result::Error);
+                }
+                ++in;
+                break;
+            }
+            case State::Extension:
+                if (c == '\r') {
+                    _state = State::SizeLf;
+                } else if (c == '\n') {
+                    return finish(Result::Error);
+                }
+                ++in;
+                break;
+            case State::SizeLf:
+                if (c != '\n') {
+                    return finish(Result::Error);
+                }
+                ++in;
+                _sawDigit = false;
+                _state = _chunkRemaining ? State::Data : State::Trailer;
+                break;
+            case State::Data: {
+                auto available = length - in;
+                auto toCopy = available < _chunkRemaining ? available : _chunkRemaining;
+                memmove(data + out, data + in, toCopy);
+                in += toCopy;
+                out += toCopy;
+                _chunkRemaining -= toCopy;
+                if (_chunkRemaining == 0) {
+                    _state = State::DataCr;
+                }
+                break;
+            }
+            case State::DataCr:
+                if (c != '\r') {
+                    return finish(Result::Error);
+                }
+                ++in;
+                _state = State::DataLf;
+                break;
+            case State::DataLf:
+                if (c != '\n') {
+                    return finish(Result::Error);
+                }
+                ++in;
+                _state = State::Size;
+                break;
+            case State::Trailer:
+                if (c == '\r') {
+                    _state = State::TrailerLf;
+                } else {
+                    _trailerLineEmpty = false;
+                }
+                ++in;
+                break;
+            case State::TrailerLf:
+                if (c != '\n') {
+                    return finish(Result::Error);
+                }
+                ++in;
+                if (_trailerLineEmpty) {
+                    _state = State::Done;
+                } else {
+                    _trailerLineEmpty = true;
+                    _state = State::Trailer;
+                }
+                break;
+            case State::Done:
+                break;
+        }
+    }
+    return finish(_state == State::Done ? Result::Done : Result::NeedMore);
+}
+
+}
@@ -0,0 +1,72 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace seasocks {
+
+// Incrementally decodes a request body sent with "Transfer-Encoding: chunked"
+// (RFC 7230 section 4.1). Chunk extensions and trailers are skipped.
+class ChunkedDecoder {
+public:
+    enum class Result {
+        NeedMore,
+        Done,
+        Error,
+    };
+
+    // Decodes as much of data as possible, in place: afterwards the first
+    // decoded bytes of data are body, taken from the first consumed bytes of
+    // the input. Anything after consumed is either an incomplete chunk header
+    // (NeedMore) or belongs to the next request (Done).
+    Result decode(uint8_t* data, size_t length, size_t& consumed, size_t& decoded);
+
+    void reset() {
+        *this = ChunkedDecoder();
+    }
+
+private:
+    enum class State {
+        Size,
+        Extension,
+        SizeLf,
+        Data,
+        DataCr,
+        DataLf,
+        Trailer,
+        TrailerLf,
+        Done,
+    };
+
+    State _state = State::Size;
+    size_t _chunkRemaining = 0;
+    bool _sawDigit = false;
+    bool _trailerLineEmpty = true;
+};
+
+}
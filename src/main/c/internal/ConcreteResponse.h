@@ -66,6 +66,10 @@ public:
     virtual Headers getAdditionalHeaders() const override {
         return _headers;
     }
+
+    virtual const Headers* storedAdditionalHeaders() const override {
+        return &_headers;
+    }
 };
 
 }
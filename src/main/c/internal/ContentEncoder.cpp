@@ -0,0 +1,108 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/ContentEncoding.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <zlib.h>
+
+namespace seasocks {
+
+struct ContentEncoder::Impl {
+    z_stream stream{};
+    ContentEncoding encoding = ContentEncoding::Identity;
+    int level = Z_DEFAULT_COMPRESSION;
+
+    ~Impl() {
+        if (encoding != ContentEncoding::Identity)
+            ::deflateEnd(&stream);
+    }
+
+    void begin(ContentEncoding newEncoding, int newLevel) {
+        if (newEncoding == encoding) {
+            // Same framing: far cheaper to reuse the existing state.
+            ::deflateReset(&stream);
+            if (newLevel != level && ::deflateParams(&stream, newLevel, Z_DEFAULT_STRATEGY) != Z_OK) {
+                throw std::runtime_error("error setting zlib compression level");
+            }
+            level = newLevel;
+            return;
+        }
+        if (encoding != ContentEncoding::Identity) {
+            ::deflateEnd(&stream);
+            encoding = ContentEncoding::Identity;
+        }
+        if (newEncoding == ContentEncoding::Identity)
+            return;
+        stream = z_stream{};
+        // 16 more window bits asks zlib for a gzip wrapper rather than a zlib one.
+        int windowBits = newEncoding == ContentEncoding::Gzip ? 15 + 16 : 15;
+        if (::deflateInit2(&stream, newLevel, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            throw std::runtime_error("error initialising zlib deflater");
+        }
+        encoding = newEncoding;
+        level = newLevel;
+    }
+
+    void run(const void* input, size_t length, int flush, std::vector<uint8_t>& output) {
+        stream.next_in = const_cast<z_const Bytef*>(static_cast<const Bytef*>(input));
+        stream.avail_in = static_cast<uInt>(length);
+        auto chunk = static_cast<uInt>(::deflateBound(&stream, static_cast<uLong>(length)) + 16);
+        do {
+            auto used = output.size();
+            output.resize(used + chunk);
+            stream.next_out = output.data() + used;
+            stream.avail_out = chunk;
+            if (::deflate(&stream, flush) == Z_STREAM_ERROR) {
+                throw std::runtime_error("error compressing response");
+            }
+            output.resize(output.size() - stream.avail_out);
+        } while (stream.avail_out == 0);
+    }
+};
+
+ContentEncoder::ContentEncoder()
+        : _impl(std::make_unique<Impl>()) {
+}
+
+ContentEncoder::~ContentEncoder() = default;
+
+void ContentEncoder::begin(ContentEncoding encoding, int level) {
+    _impl->begin(encoding, level);
+}
+
+void ContentEncoder::encode(const void* input, size_t length, bool flush, std::vector<uint8_t>& output) {
+    if (length == 0 && !flush)
+        return;
+    _impl->run(input, length, flush ? Z_SYNC_FLUSH : Z_NO_FLUSH, output);
+}
+
+void ContentEncoder::finish(std::vector<uint8_t>& output) {
+    _impl->run(nullptr, 0, Z_FINISH, output);
+}
+
+}
@@ -0,0 +1,131 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/ContentEncoding.h"
+
+#include "seasocks/StrCompare.h"
+
+namespace {
+
+std::string_view trim(std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t'))
+        text.remove_prefix(1);
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t'))
+        text.remove_suffix(1);
+    return text;
+}
+
+// Parses a qvalue ("0", "0.5", "1.000" etc) into thousandths. Anything
+// malformed counts as 0, so is never chosen.
+int parseQuality(std::string_view value) {
+    if (value.empty() || (value[0] != '0' && value[0] != '1'))
+        return 0;
+    int quality = (value[0] - '0') * 1000;
+    if (value.size() == 1)
+        return quality;
+    if (value[1] != '.' || value.size() > 5)
+        return 0;
+    int scale = 100;
+    for (auto c : value.substr(2)) {
+        if (c < '0' || c > '9')
+            return 0;
+        quality += (c - '0') * scale;
+        scale /= 10;
+    }
+    return quality > 1000 ? 0 : quality;
+}
+
+}
+
+namespace seasocks {
+
+ContentEncoding negotiateContentEncoding(std::string_view acceptEncoding) {
+    // -1 for codings the client didn't mention.
+    int gzip = -1;
+    int deflate = -1;
+    int any = -1;
+    while (!acceptEncoding.empty()) {
+        auto comma = acceptEncoding.find(',');
+        auto item = acceptEncoding.substr(0, comma);
+        acceptEncoding.remove_prefix(comma == std::string_view::npos ? acceptEncoding.size() : comma + 1);
+
+        auto semicolon = item.find(';');
+        auto coding = trim(item.substr(0, semicolon));
+        int quality = 1000;
+        while (semicolon != std::string_view::npos) {
+            item.remove_prefix(semicolon + 1);
+            semicolon = item.find(';');
+            auto parameter = trim(item.substr(0, semicolon));
+            if (parameter.size() >= 2 && (parameter[0] == 'q' || parameter[0] == 'Q') && parameter[1] == '=') {
+                quality = parseQuality(parameter.substr(2));
+            }
+        }
+        if (compareCaseInsensitive(coding, "gzip") || compareCaseInsensitive(coding, "x-gzip")) {
+            gzip = quality;
+        } else if (compareCaseInsensitive(coding, "deflate")) {
+            deflate = quality;
+        } else if (coding == "*") {
+            any = quality;
+        }
+    }
+    if (gzip < 0)
+        gzip = any;
+    if (deflate < 0)
+        deflate = any;
+    if (gzip > 0 && gzip >= deflate)
+        return ContentEncoding::Gzip;
+    if (deflate > 0)
+        return ContentEncoding::Deflate;
+    return ContentEncoding::Identity;
+}
+
+const char* contentEncodingName(ContentEncoding encoding) {
+    switch (encoding) {
+        case ContentEncoding::Gzip:
+            return "gzip";
+        case ContentEncoding::Deflate:
+            return "deflate";
+        case ContentEncoding::Identity:
+            break;
+    }
+    return "identity";
+}
+
+bool matchesContentType(std::string_view contentType, const std::vector<std::string>& types) {
+    contentType = trim(contentType.substr(0, contentType.find(';')));
+    for (const auto& type : types) {
+        if (!type.empty() && type.back() == '/') {
+            if (contentType.size() > type.size()
+                && compareCaseInsensitive(contentType.substr(0, type.size()), type)) {
+                return true;
+            }
+        } else if (compareCaseInsensitive(contentType, type)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
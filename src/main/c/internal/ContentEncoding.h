@@ -0,0 +1,81 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace seasocks {
+
+// Content codings we can apply to HTTP responses (RFC 7231 section 3.1.2.1).
+enum class ContentEncoding : uint8_t {
+    Identity,
+    Gzip,
+    Deflate,
+};
+
+// Picks the coding to use for a request with the given Accept-Encoding
+// header, preferring gzip where the client doesn't mind.
+ContentEncoding negotiateContentEncoding(std::string_view acceptEncoding);
+
+// The name used for the coding in Content-Encoding.
+const char* contentEncodingName(ContentEncoding encoding);
+
+// Whether contentType (which may have parameters) matches one of types, where
+// an entry ending in '/' matches a whole family. Case insensitive.
+bool matchesContentType(std::string_view contentType, const std::vector<std::string>& types);
+
+// Compresses a response body as it's sent. One encoder can be reused for any
+// number of responses, saving zlib's sizeable allocations each time.
+class ContentEncoder {
+public:
+    ContentEncoder();
+    ~ContentEncoder();
+
+    ContentEncoder(const ContentEncoder&) = delete;
+    ContentEncoder& operator=(const ContentEncoder&) = delete;
+
+    // Starts a new body. Throws if zlib can't be set up.
+    void begin(ContentEncoding encoding, int level);
+
+    // Compresses input, appending whatever compressed data is ready to
+    // output. With flush, everything so far is made decodable, at a small
+    // cost in size.
+    void encode(const void* input, size_t length, bool flush, std::vector<uint8_t>& output);
+
+    // Ends the body, appending the rest of it to output.
+    void finish(std::vector<uint8_t>& output);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> _impl;
+};
+
+}
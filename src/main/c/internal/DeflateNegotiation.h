@@ -0,0 +1,58 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "seasocks/PerMessageDeflate.h"
+
+#include <string>
+
+namespace seasocks {
+
+// The outcome of negotiating permessage-deflate with a client.
+struct DeflateParameters {
+    bool serverNoContextTakeover = false;
+    bool clientNoContextTakeover = false;
+    int serverMaxWindowBits = 15;
+    int clientMaxWindowBits = 15;
+    bool sendServerMaxWindowBits = false;
+    bool sendClientMaxWindowBits = false;
+    // Empty unless both sides are using the endpoint's preset dictionary.
+    std::string dictionaryId;
+
+    // The value to send back in our Sec-WebSocket-Extensions header.
+    std::string responseHeader() const;
+};
+
+// Picks the first acceptable permessage-deflate offer from a client's
+// Sec-WebSocket-Extensions header, applying the server's options. Offers of a
+// preset dictionary are only acceptable if they name dictionaryId. Returns
+// false if there was no offer we could accept.
+bool negotiatePerMessageDeflate(const std::string& extensionsHeader,
+                                const PerMessageDeflateOptions& options,
+                                DeflateParameters& result,
+                                const std::string& dictionaryId = "");
+
+}
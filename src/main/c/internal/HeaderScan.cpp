@@ -0,0 +1,53 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/HeaderScan.h"
+
+#include <cstring>
+
+namespace seasocks {
+
+size_t findHeaderTerminator(const uint8_t* data, size_t length, size_t alreadySearched) {
+    constexpr size_t TerminatorLength = 4;
+    size_t start = alreadySearched >= TerminatorLength - 1 ? alreadySearched - (TerminatorLength - 1) : 0;
+    // Every terminator ends with a '\n', and memchr() skips over everything
+    // else a vector at a time. Each '\n' found is then checked for the "\r\n\r"
+    // before it.
+    while (start + TerminatorLength <= length) {
+        auto* lastByte = static_cast<const uint8_t*>(
+            memchr(data + start + TerminatorLength - 1, '\n', length - start - (TerminatorLength - 1)));
+        if (!lastByte) {
+            break;
+        }
+        auto candidate = static_cast<size_t>(lastByte - data) - (TerminatorLength - 1);
+        if (memcmp(data + candidate, "\r\n\r", TerminatorLength - 1) == 0) {
+            return candidate;
+        }
+        start = candidate + 1;
+    }
+    return NoHeaderTerminator;
+}
+
+}
@@ -0,0 +1,105 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/KnownHeaders.h"
+
+#include "seasocks/StrCompare.h"
+
+#include <cctype>
+
+namespace {
+
+using seasocks::KnownHeader;
+
+constexpr std::string_view names[] = {
+    "Accept-Encoding",
+    "Connection",
+    "Content-Length",
+    "Expect",
+    "Host",
+    "Origin",
+    "Range",
+    "Sec-WebSocket-Accept",
+    "Sec-WebSocket-Extensions",
+    "Sec-WebSocket-Key",
+    "Sec-WebSocket-Key1",
+    "Sec-WebSocket-Key2",
+    "Sec-WebSocket-Protocol",
+    "Sec-WebSocket-Version",
+    "Transfer-Encoding",
+    "Upgrade",
+};
+static_assert(sizeof(names) / sizeof(names[0]) == seasocks::NumKnownHeaders);
+
+KnownHeader confirm(std::string_view name, KnownHeader candidate) {
+    return compareCaseInsensitive(name, seasocks::knownHeaderName(candidate)) ? candidate : KnownHeader::Unknown;
+}
+
+char lower(char c) {
+    return static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+}
+
+}
+
+namespace seasocks {
+
+std::string_view knownHeaderName(KnownHeader header) {
+    return header == KnownHeader::Unknown ? std::string_view() : names[static_cast<size_t>(header)];
+}
+
+KnownHeader knownHeader(std::string_view name) {
+    switch (name.size()) {
+        case 4:
+            return confirm(name, KnownHeader::Host);
+        case 5:
+            return confirm(name, KnownHeader::Range);
+        case 6:
+            return confirm(name, lower(name[0]) == 'e' ? KnownHeader::Expect : KnownHeader::Origin);
+        case 7:
+            return confirm(name, KnownHeader::Upgrade);
+        case 10:
+            return confirm(name, KnownHeader::Connection);
+        case 14:
+            return confirm(name, KnownHeader::ContentLength);
+        case 15:
+            return confirm(name, KnownHeader::AcceptEncoding);
+        case 17:
+            return confirm(name, lower(name[0]) == 't' ? KnownHeader::TransferEncoding : KnownHeader::SecWebSocketKey);
+        case 18:
+            return confirm(name, name[17] == '1' ? KnownHeader::SecWebSocketKey1 : KnownHeader::SecWebSocketKey2);
+        case 20:
+            return confirm(name, KnownHeader::SecWebSocketAccept);
+        case 21:
+            return confirm(name, KnownHeader::SecWebSocketVersion);
+        case 22:
+            return confirm(name, KnownHeader::SecWebSocketProtocol);
+        case 24:
+            return confirm(name, KnownHeader::SecWebSocketExtensions);
+        default:
+            return KnownHeader::Unknown;
+    }
+}
+
+}
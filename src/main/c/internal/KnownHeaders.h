@@ -0,0 +1,67 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace seasocks {
+
+// Headers seasocks itself looks at. They're recognised once while a request
+// is parsed, and from then on can be fetched by index rather than by name.
+enum class KnownHeader : uint8_t {
+    AcceptEncoding,
+    Connection,
+    ContentLength,
+    Expect,
+    Host,
+    Origin,
+    Range,
+    SecWebSocketAccept,
+    SecWebSocketExtensions,
+    SecWebSocketKey,
+    SecWebSocketKey1,
+    SecWebSocketKey2,
+    SecWebSocketProtocol,
+    SecWebSocketVersion,
+    TransferEncoding,
+    Upgrade,
+    Unknown
+};
+
+constexpr size_t NumKnownHeaders = static_cast<size_t>(KnownHeader::Unknown);
+
+// Returns the canonical spelling of the header, e.g. "Sec-WebSocket-Key".
+std::string_view knownHeaderName(KnownHeader header);
+
+// Matches a header name case-insensitively, returning KnownHeader::Unknown for
+// anything not in the table. Candidates are picked by a switch on the length
+// (and a distinguishing character where two names share a length), so there's
+// at most one string comparison.
+KnownHeader knownHeader(std::string_view name);
+
+}
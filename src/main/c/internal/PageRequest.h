@@ -25,10 +25,9 @@
 
 #pragma once
 
-#include "internal/HeaderMap.h"
+#include "internal/RequestHeaders.h"
 #include "seasocks/Request.h"
 
-#include <unordered_map>
 #include <vector>
 
 namespace seasocks {
@@ -40,8 +39,8 @@ class PageRequest : public Request {
     Server& _server;
     const Verb _verb;
     std::vector<uint8_t> _content;
-    HeaderMap _headers;
-    const size_t _contentLength;
+    RequestHeaders _headers;
+    size_t _contentLength;
 
 public:
     PageRequest(
@@ -49,7 +48,7 @@ public:
         const std::string& requestUri,
         Server& server,
         Verb verb,
-        HeaderMap&& headers);
+        RequestHeaders&& headers);
 
     virtual Server& server() const override {
         return _server;
@@ -80,17 +79,35 @@ public:
     }
 
     virtual bool hasHeader(const std::string& name) const override {
-        return _headers.find(name) != _headers.end();
+        return _headers.has(name);
     }
 
     virtual std::string getHeader(const std::string& name) const override {
-        auto iter = _headers.find(name);
-        return iter == _headers.end() ? std::string() : iter->second;
+        return std::string(_headers.get(name));
+    }
+
+    // Returns the value of the named header without copying it, or an empty
+    // view if there's no such header. Only valid for the lifetime of the request.
+    std::string_view getHeaderView(std::string_view name) const {
+        return _headers.get(name);
+    }
+
+    bool hasHeader(KnownHeader header) const {
+        return _headers.has(header);
+    }
+
+    std::string_view getHeaderView(KnownHeader header) const {
+        return _headers.get(header);
     }
 
     bool consumeContent(std::vector<uint8_t>& buffer);
+    // For bodies whose length wasn't known up front, i.e. chunked ones.
+    void setContent(std::vector<uint8_t>&& content) {
+        _content = std::move(content);
+        _contentLength = _content.size();
+    }
 
-    size_t getUintHeader(const std::string& name) const;
+    size_t getUintHeader(KnownHeader header) const;
 };
 
 } // namespace seasocks
@@ -0,0 +1,144 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "internal/KnownHeaders.h"
+#include "seasocks/StrCompare.h"
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace seasocks {
+
+// The headers of a request, kept as a single copy of the raw header block
+// plus the offsets of each name and value within it. Compared with a
+// HeaderMap this costs two allocations per request rather than two per
+// header, and with the couple of dozen headers browsers send a linear scan
+// is quicker than hashing the name. Well-known headers are recognised as
+// they're added, and kept in fixed slots so looking them up needs no string
+// comparisons at all. The first of any duplicated headers wins.
+class RequestHeaders {
+public:
+    RequestHeaders() = default;
+
+    // Takes a copy of the header block, ready to be parsed in place through
+    // block(). Names and values passed to add() must point into it.
+    RequestHeaders(const uint8_t* first, const uint8_t* last)
+            : _block(first, last) {
+        _entries.reserve(TypicalCount);
+    }
+
+    uint8_t* block() {
+        return _block.data();
+    }
+
+    size_t blockSize() const {
+        return _block.size();
+    }
+
+    void add(std::string_view name, std::string_view value) {
+        auto known = knownHeader(name);
+        if (known != KnownHeader::Unknown && !_known[static_cast<size_t>(known)]) {
+            _known[static_cast<size_t>(known)] = static_cast<uint16_t>(_entries.size() + 1);
+        }
+        _entries.push_back({offsetOf(name), static_cast<uint32_t>(name.size()),
+                            offsetOf(value), static_cast<uint32_t>(value.size())});
+    }
+
+    size_t size() const {
+        return _entries.size();
+    }
+
+    bool has(KnownHeader header) const {
+        return find(header) != nullptr;
+    }
+
+    bool has(std::string_view name) const {
+        return find(name) != nullptr;
+    }
+
+    std::string_view get(KnownHeader header) const {
+        return value(find(header));
+    }
+
+    // Returns an empty view for missing headers. The view remains valid for
+    // as long as this object does.
+    std::string_view get(std::string_view name) const {
+        return value(find(name));
+    }
+
+private:
+    static constexpr size_t TypicalCount = 32;
+
+    struct Entry {
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        uint32_t valueOffset;
+        uint32_t valueLength;
+    };
+
+    uint32_t offsetOf(std::string_view str) const {
+        return static_cast<uint32_t>(reinterpret_cast<const uint8_t*>(str.data()) - _block.data());
+    }
+
+    std::string_view view(uint32_t offset, uint32_t length) const {
+        return std::string_view(reinterpret_cast<const char*>(_block.data()) + offset, length);
+    }
+
+    std::string_view value(const Entry* entry) const {
+        return entry ? view(entry->valueOffset, entry->valueLength) : std::string_view();
+    }
+
+    const Entry* find(KnownHeader header) const {
+        auto slot = header == KnownHeader::Unknown ? 0 : _known[static_cast<size_t>(header)];
+        return slot ? &_entries[slot - 1u] : nullptr;
+    }
+
+    const Entry* find(std::string_view name) const {
+        auto known = knownHeader(name);
+        if (known != KnownHeader::Unknown) {
+            return find(known);
+        }
+        for (const auto& entry : _entries) {
+            if (entry.nameLength == name.size()
+                && compareCaseInsensitive(view(entry.nameOffset, entry.nameLength), name)) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    std::vector<uint8_t> _block;
+    std::vector<Entry> _entries;
+    // One more than the index in _entries of each well-known header, or zero
+    // if the request doesn't have it. The header block is at most 64KB, so
+    // there can't be more headers than this can index.
+    std::array<uint16_t, NumKnownHeaders> _known{};
+};
+
+}
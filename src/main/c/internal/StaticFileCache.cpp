@@ -0,0 +1,132 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/StaticFileCache.h"
+
+#include "internal/RaiiFd.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+namespace seasocks {
+
+StaticFileCache::StaticFileCache(const StaticFileCacheOptions& options)
+        : _options(options) {
+}
+
+std::shared_ptr<StaticFileCache::File> StaticFileCache::get(const std::string& path) {
+    auto now = std::chrono::steady_clock::now();
+    auto it = _entries.find(path);
+    if (it != _entries.end()) {
+        auto& entry = it->second;
+        bool fresh = now - entry.lastChecked < _options.revalidateInterval;
+        if (!fresh) {
+            // Replacing a file by renaming another over it changes its inode,
+            // even if the size and (whole second) modification time match.
+            const auto& file = *entry.file;
+            struct stat fileStat;
+            fresh = ::stat(path.c_str(), &fileStat) == 0 && fileStat.st_mtime == file._modified
+                    && fileStat.st_ino == file._inode && static_cast<size_t>(fileStat.st_size) == file.size();
+            entry.lastChecked = now;
+        }
+        if (fresh) {
+            _recency.splice(_recency.begin(), _recency, entry.recency);
+            return entry.file;
+        }
+        evict(it);
+    }
+    return load(path, now);
+}
+
+std::shared_ptr<StaticFileCache::File> StaticFileCache::load(const std::string& path,
+                                                             std::chrono::steady_clock::time_point now) {
+    RaiiFd input{::open(path.c_str(), O_RDONLY | O_BINARY)};
+    struct stat fileStat;
+    if (!input.ok() || ::fstat(input, &fileStat) == -1 || !S_ISREG(fileStat.st_mode)) {
+        return nullptr;
+    }
+    auto size = static_cast<size_t>(fileStat.st_size);
+    if (size > _options.maxFileSize || size > _options.memoryBudget) {
+        return nullptr;
+    }
+
+    auto file = std::make_shared<File>();
+    file->_modified = fileStat.st_mtime;
+    file->_inode = fileStat.st_ino;
+    file->_contents.resize(size);
+    size_t done = 0;
+    while (done < size) {
+        auto bytesRead = ::read(input, file->_contents.data() + done, static_cast<unsigned int>(size - done));
+        if (bytesRead <= 0) {
+            return nullptr;
+        }
+        done += static_cast<size_t>(bytesRead);
+    }
+
+    _recency.push_front(path);
+    _entries[path] = Entry{file, now, _recency.begin()};
+    file->_memoryUsed = size;
+    file->_cached = true;
+    _memoryUsed += size;
+    trim();
+    return file;
+}
+
+const std::vector<uint8_t>& StaticFileCache::storeEncoded(File& file, ContentEncoding encoding,
+                                                          std::vector<uint8_t> body) {
+    body.shrink_to_fit();
+    auto& stored = file._encoded[static_cast<size_t>(encoding)];
+    // Only count it if the file's still ours to evict.
+    if (file._cached) {
+        file._memoryUsed += body.size() - stored.size();
+        _memoryUsed += body.size() - stored.size();
+    }
+    stored = std::move(body);
+    if (file._cached) {
+        trim();
+    }
+    return stored;
+}
+
+void StaticFileCache::evict(Entries::iterator entry) {
+    // Anyone still sending the file holds their own reference to it.
+    auto& file = *entry->second.file;
+    _memoryUsed -= file._memoryUsed;
+    file._cached = false;
+    _recency.erase(entry->second.recency);
+    _entries.erase(entry);
+}
+
+void StaticFileCache::trim() {
+    while (_memoryUsed > _options.memoryBudget) {
+        evict(_entries.find(_recency.back()));
+    }
+}
+
+}
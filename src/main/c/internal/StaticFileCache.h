@@ -0,0 +1,127 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "internal/ContentEncoding.h"
+#include "seasocks/StaticFileCacheOptions.h"
+
+#include <sys/types.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace seasocks {
+
+// Keeps the contents of recently served static files in memory, so hot
+// assets can be sent without opening, stat()ing and reading them every time.
+// Only used on the seasocks thread.
+class StaticFileCache {
+public:
+    class File {
+    public:
+        File() = default;
+        File(const File&) = delete;
+        File& operator=(const File&) = delete;
+
+        const uint8_t* data() const {
+            return _contents.data();
+        }
+        size_t size() const {
+            return _contents.size();
+        }
+        time_t modified() const {
+            return _modified;
+        }
+        // The file compressed with the given coding, or null if nobody has
+        // stored it yet.
+        const std::vector<uint8_t>* encoded(ContentEncoding encoding) const {
+            const auto& body = _encoded[static_cast<size_t>(encoding)];
+            return body.empty() ? nullptr : &body;
+        }
+
+        // Response headers describing the file, rendered by whoever first
+        // serves it and reused after that.
+        std::string headers;
+
+    private:
+        friend class StaticFileCache;
+        // Read into memory rather than mapped: a mapping faults if the file
+        // is truncated while we're sending it.
+        std::vector<uint8_t> _contents;
+        time_t _modified = 0;
+        ino_t _inode = 0;
+        // Indexed by ContentEncoding.
+        std::array<std::vector<uint8_t>, 3> _encoded;
+        size_t _memoryUsed = 0;
+        bool _cached = false;
+    };
+
+    explicit StaticFileCache(const StaticFileCacheOptions& options);
+
+    // The file at path, loading it if need be. Returns null if it can't be
+    // opened, isn't a regular file or is too big to cache: the caller should
+    // then read it from disk as usual.
+    std::shared_ptr<File> get(const std::string& path);
+
+    // Keeps a compressed copy of file, so it needn't be compressed again for
+    // clients accepting the same coding. Returns the stored copy.
+    const std::vector<uint8_t>& storeEncoded(File& file, ContentEncoding encoding, std::vector<uint8_t> body);
+
+    size_t memoryUsed() const {
+        return _memoryUsed;
+    }
+    size_t numFiles() const {
+        return _entries.size();
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<File> file;
+        std::chrono::steady_clock::time_point lastChecked;
+        std::list<std::string>::iterator recency;
+    };
+    using Entries = std::unordered_map<std::string, Entry>;
+
+    std::shared_ptr<File> load(const std::string& path, std::chrono::steady_clock::time_point now);
+    void evict(Entries::iterator entry);
+    void trim();
+
+    StaticFileCacheOptions _options;
+    Entries _entries;
+    // Paths of cached files, most recently used first.
+    std::list<std::string> _recency;
+    size_t _memoryUsed = 0;
+};
+
+}
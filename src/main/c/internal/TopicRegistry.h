@@ -0,0 +1,79 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace seasocks {
+
+class WebSocket;
+
+// Book-keeping behind Server::subscribe() and Server::publish(). Each topic
+// keeps its subscribers in a flat vector so a publication is a single pass
+// over contiguous memory, and each socket remembers its topics, along with its
+// position in each, so that it can be dropped from any of them in constant time.
+class TopicRegistry {
+public:
+    struct Topic {
+        std::vector<WebSocket*> subscribers;
+        // The last message published with retain set, sent to new subscribers.
+        bool hasRetained = false;
+        bool retainedIsText = false;
+        std::string retained;
+    };
+
+    // Returns the topic, or nullptr if the socket was already subscribed.
+    Topic* subscribe(WebSocket* socket, const std::string& topic);
+    // Returns false if the socket wasn't subscribed to the topic.
+    bool unsubscribe(WebSocket* socket, const std::string& topic);
+    void unsubscribeAll(WebSocket* socket);
+
+    // Returns nullptr if nobody is subscribed and nothing is retained.
+    Topic* find(const std::string& topic);
+    Topic& findOrCreate(const std::string& topic);
+    void clearRetained(const std::string& topic);
+
+    size_t numTopics() const {
+        return _topics.size();
+    }
+
+private:
+    struct Subscription {
+        std::string topic;
+        size_t index; // Into the topic's subscribers.
+    };
+    using Subscriptions = std::vector<Subscription>;
+
+    static Subscriptions::iterator findSubscription(Subscriptions& subscriptions, const std::string& name);
+    void removeSubscriber(const std::string& name, size_t index);
+
+    std::unordered_map<std::string, Topic> _topics;
+    std::unordered_map<WebSocket*, Subscriptions> _topicsBySocket;
+};
+
+}
@@ -0,0 +1,117 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/Utf8.h"
+
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Returns the position of the first non-ASCII byte at or after pos, or length.
+size_t skipAscii(const uint8_t* data, size_t pos, size_t length) {
+#if defined(__SSE2__)
+    while (pos + 16 <= length) {
+        auto block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+        auto highBits = _mm_movemask_epi8(block);
+        if (highBits != 0) {
+            return pos + static_cast<size_t>(__builtin_ctz(static_cast<unsigned>(highBits)));
+        }
+        pos += 16;
+    }
+#endif
+    while (pos + 8 <= length) {
+        uint64_t word;
+        memcpy(&word, data + pos, sizeof(word));
+        if (word & 0x8080808080808080ull) {
+            break;
+        }
+        pos += 8;
+    }
+    while (pos < length && data[pos] < 0x80) {
+        ++pos;
+    }
+    return pos;
+}
+
+bool isContinuation(uint8_t byte) {
+    return (byte & 0xc0) == 0x80;
+}
+
+}
+
+namespace seasocks {
+
+bool isValidUtf8(const uint8_t* data, size_t length) {
+    size_t pos = 0;
+    for (;;) {
+        pos = skipAscii(data, pos, length);
+        if (pos == length) {
+            return true;
+        }
+        // Well-formed byte sequences, per table 3-7 of the Unicode standard.
+        auto lead = data[pos];
+        size_t numContinuations;
+        uint8_t secondMin = 0x80;
+        uint8_t secondMax = 0xbf;
+        if (lead >= 0xc2 && lead <= 0xdf) {
+            numContinuations = 1;
+        } else if (lead >= 0xe0 && lead <= 0xef) {
+            numContinuations = 2;
+            if (lead == 0xe0) {
+                secondMin = 0xa0; // Overlong.
+            } else if (lead == 0xed) {
+                secondMax = 0x9f; // Surrogates.
+            }
+        } else if (lead >= 0xf0 && lead <= 0xf4) {
+            numContinuations = 3;
+            if (lead == 0xf0) {
+                secondMin = 0x90; // Overlong.
+            } else if (lead == 0xf4) {
+                secondMax = 0x8f; // Beyond U+10FFFF.
+            }
+        } else {
+            return false;
+        }
+        if (length - pos <= numContinuations) {
+            return false;
+        }
+        auto second = data[pos + 1];
+        if (second < secondMin || second > secondMax) {
+            return false;
+        }
+        for (size_t i = 2; i <= numContinuations; ++i) {
+            if (!isContinuation(data[pos + i])) {
+                return false;
+            }
+        }
+        pos += numContinuations + 1;
+    }
+}
+
+}
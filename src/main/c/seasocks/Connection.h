@@ -25,6 +25,7 @@
 
 #pragma once
 
+#include "seasocks/PerMessageDeflate.h"
 #include "seasocks/ResponseCode.h"
 #include "seasocks/WebSocket.h"
 #include "seasocks/ResponseWriter.h"
@@ -40,18 +41,26 @@
 #define MSG_NOSIGNAL 0
 #endif
 
+#include <chrono>
 #include <cinttypes>
+#include <deque>
 #include <list>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 
 namespace seasocks {
 
+class ChunkedDecoder;
+class ContentEncoder;
+enum class ContentEncoding : uint8_t;
 class Logger;
 class ServerImpl;
 class PageRequest;
+class RequestBodyHandler;
 class Response;
 
 class Connection : public WebSocket {
@@ -73,8 +82,21 @@ public:
 
     // From WebSocket.
     virtual void send(const char* webSocketResponse) override;
+    virtual void send(std::string_view webSocketResponse) override;
     virtual void send(const uint8_t* webSocketResponse, size_t length) override;
+    virtual void send(std::string_view webSocketResponse, std::chrono::milliseconds timeToLive) override;
+    virtual void send(const uint8_t* webSocketResponse, size_t length,
+                      std::chrono::milliseconds timeToLive) override;
     virtual void close() override;
+    virtual void close(CloseCode code, const std::string& reason) override;
+    virtual void sendConflated(const std::string& key, const char* webSocketResponse) override;
+    virtual void sendConflated(const std::string& key, const uint8_t* webSocketResponse, size_t length) override;
+    virtual std::chrono::microseconds lastRoundTripTime() const override {
+        return _lastRoundTripTime;
+    }
+    virtual std::chrono::microseconds averageRoundTripTime() const override {
+        return _averageRoundTripTime;
+    }
 
     // From Request.
     virtual std::shared_ptr<Credentials> credentials() const override;
@@ -101,7 +123,7 @@ public:
         return _inBuf.size();
     }
     size_t outputBufferSize() const {
-        return _outBuf.size();
+        return _outBuf.size() + _controlBuf.size();
     }
 
     size_t bytesReceived() const {
@@ -110,6 +132,79 @@ public:
     size_t bytesSent() const {
         return _bytesSent;
     }
+    const CompressionStats& compressionStats() const {
+        return _compressionStats;
+    }
+    // Number of queued messages replaced by newer ones with the same key.
+    size_t messagesConflated() const {
+        return _messagesConflated;
+    }
+    size_t queuedMessageCount() const {
+        return _sendQueue.size();
+    }
+    // Messages sent with a time to live that were dropped unsent, and how many
+    // bytes that saved sending.
+    size_t messagesExpired() const {
+        return _messagesExpired;
+    }
+    size_t bytesExpired() const {
+        return _bytesExpired;
+    }
+
+    // Used by Server::broadcast(). Connections that reset their compressor after
+    // every message produce identical compressed frames for identical input, so
+    // a single compressed frame can be shared between them.
+    bool canShareCompressedFrames() const;
+    int deflateWindowBits() const {
+        return _deflateWindowBits;
+    }
+    // Empty unless the client agreed to use the endpoint's preset dictionary.
+    const std::string& deflateDictionaryId() const {
+        return _deflateDictionaryId;
+    }
+    const CompressionPolicy& compressionPolicy() const {
+        return _compressionPolicy;
+    }
+    bool shouldCompress(const uint8_t* webSocketResponse, size_t messageLength) const;
+    void sendCompressed(uint8_t opcode, const uint8_t* compressed, size_t compressedLength,
+                        size_t originalLength);
+    void sendUncompressed(uint8_t opcode, const uint8_t* webSocketResponse, size_t messageLength);
+
+    // Client mode: sends the WebSocket upgrade request for path to the server
+    // at the other end of the (possibly still connecting) socket. The handler
+    // gets onConnect() once the server's response checks out. Messages we send
+    // are masked, as RFC 6455 requires of clients. See Server::connectWebSocket.
+    void startClientHandshake(const std::string& host, const std::string& path,
+                              std::shared_ptr<WebSocket::Handler> handler);
+    bool isClient() const {
+        return _client;
+    }
+
+    // Set while a RequestBodyHandler has paused the flow of a request body.
+    bool readingPaused() const {
+        return _readingPaused;
+    }
+    bool registeredForWriteEvents() const {
+        return _registeredForWriteEvents;
+    }
+
+    // Called periodically by the Server on WebSocket connections. Sends a ping
+    // once pingInterval has passed since the last one was answered, and returns
+    // false if an outstanding ping has gone unanswered for pongTimeout.
+    bool checkKeepAlive(std::chrono::steady_clock::time_point now,
+                        std::chrono::seconds pingInterval,
+                        std::chrono::seconds pongTimeout);
+
+    // True if we sent a Close frame at least timeout ago and the connection is
+    // still open, either because the client never replied or because the data
+    // queued ahead of it hasn't drained.
+    bool closeHandshakeExpired(std::chrono::steady_clock::time_point now,
+                               std::chrono::seconds timeout) const;
+
+    // True if this is an HTTP connection sitting between requests, and nothing
+    // has been read or written for at least timeout.
+    bool httpKeepAliveExpired(std::chrono::steady_clock::time_point now,
+                              std::chrono::seconds timeout) const;
 
     // For testing:
     std::vector<uint8_t>& getInputBuffer() {
@@ -121,6 +216,7 @@ public:
         _webSocketHandler = handler;
     }
     void handleNewData();
+    void handleNewDataForState();
 
 
     Connection(Connection& other) = delete;
@@ -135,14 +231,23 @@ private:
     void closeInternal();
 
     void handleHeaders();
+    void handleUpgradeResponse();
+    bool processUpgradeResponse(uint8_t* first, uint8_t* last);
     void handleWebSocketKey3();
-    void handleWebSocketTextMessage(const char* message);
-    void handleWebSocketBinaryMessage(const std::vector<uint8_t>& message);
+    // Returns false, having failed the connection, if the message is invalid.
+    bool handleWebSocketDataMessage(bool isText, const uint8_t* message, size_t length);
+    void handleWebSocketTextMessage(const uint8_t* message, size_t length);
+    void handleWebSocketBinaryMessage(const uint8_t* message, size_t length);
+    void deliverReceivedMessages();
     void handleBufferingPostData();
+    // Drops a buffered request body that's been refused.
+    void discardPostData();
     bool handlePageRequest();
 
-    bool bufferLine(const char* line);
-    bool bufferLine(const std::string& line);
+    bool bufferLine(std::string_view line);
+    bool bufferHeader(std::string_view name, std::string_view value);
+    bool bufferHeader(std::string_view name, size_t value);
+    bool bufferNumber(size_t value);
     bool flush();
 
     bool handleHybiHandshake(int webSocketVersion, const std::string& webSocketKey);
@@ -156,9 +261,54 @@ private:
     bool sendBadRequest(const std::string& reason);
     bool sendISE(const std::string& error);
 
+    using Deadline = std::chrono::steady_clock::time_point;
+    static constexpr Deadline NoDeadline = Deadline::max();
+
+    void sendText(std::string_view webSocketResponse, Deadline deadline);
+    void sendBinary(const uint8_t* webSocketResponse, size_t length, Deadline deadline);
     void sendHybi(uint8_t opcode, const uint8_t* webSocketResponse,
-                  size_t messageLength);
-    void sendHybiData(const uint8_t* webSocketResponse, size_t messageLength);
+                  size_t messageLength, Deadline deadline = NoDeadline);
+    void writeHybi(uint8_t opcode, const uint8_t* webSocketResponse, size_t messageLength,
+                   Deadline deadline = NoDeadline);
+    bool shouldOffload(size_t length) const {
+        return _offloadThreshold != 0 && length >= _offloadThreshold;
+    }
+    void deflateOffloaded(uint8_t opcode, const uint8_t* webSocketResponse, size_t messageLength,
+                          Deadline deadline);
+    void inflateOffloaded(bool isText, std::vector<uint8_t>& compressed);
+    // Fails the WebSocket after inflate() fails with the given zlib error.
+    void failInflate(int zlibError);
+    void resumeAfterOffload();
+    // Drops frames which have passed their deadline without any of them
+    // having been written, closing up the gaps they leave in _outBuf.
+    void dropExpiredFrames(Deadline now);
+    // Control frames jump the queue: they're sent at the next frame
+    // boundary in _outBuf, ahead of any bulk data waiting behind it.
+    void sendHybiData(uint8_t firstByte, const uint8_t* webSocketResponse, size_t messageLength,
+                      bool jumpQueue = false);
+    void queueControlFrame(const uint8_t* header, size_t headerLength, const uint8_t* payload,
+                           size_t payloadLength);
+    bool flushControlFrames();
+    // Removes numSent bytes from the front of _outBuf, keeping track of frames.
+    void consumeOutBuf(size_t numSent);
+    void spliceControlFrames();
+    void startFraming();
+    void discardUnsentData();
+    void sendConflated(const std::string& key, uint8_t opcode, const uint8_t* webSocketResponse,
+                       size_t messageLength);
+    void queueMessage(const std::string& key, uint8_t opcode, const uint8_t* webSocketResponse,
+                      size_t messageLength, Deadline deadline = NoDeadline);
+    // Moves queued messages to the output buffer, by default only while the
+    // client is keeping up.
+    void sendQueuedMessages(bool evenIfBackedUp);
+    void handlePong(const std::vector<uint8_t>& payload);
+    void handleClose(const std::vector<uint8_t>& payload);
+    // An urgent Close drops any data that hasn't started going out, and is
+    // sent at the next frame boundary.
+    void sendClose(CloseCode code, const std::string& reason, bool urgent = false);
+    // Sends an urgent Close frame with the given code, then drops the
+    // connection once it has been written.
+    void failWebSocket(CloseCode code, const std::string& reason);
 
 
     bool sendResponse(std::shared_ptr<Response> response);
@@ -171,10 +321,20 @@ private:
     struct Writer;
     void begin(ResponseCode responseCode, TransferEncoding encoding);
     void header(const std::string& header, const std::string& value);
+    void header(const std::string& header, size_t value);
     void payload(const void* data, size_t size, bool flush);
     void finish(bool keepConnectionOpen);
     void error(ResponseCode responseCode, const std::string& payload);
 
+    // Streaming request bodies to a RequestBodyHandler.
+    struct BodyFlow;
+    bool beginStreamingBody(std::shared_ptr<RequestBodyHandler> handler);
+    void handleStreamingRequestBody();
+    bool finishStreamingBody();
+    void endStreamingBody();
+    void pauseReading();
+    void resumeReading();
+
     struct Range {
         long start;
         long end;
@@ -190,9 +350,28 @@ private:
     ssize_t safeSend(const void* data, size_t size);
 
     void bufferResponseAndCommonHeaders(ResponseCode code);
+    // Connection and Keep-Alive headers reflecting _keepAlive.
+    void bufferKeepAliveHeaders();
+    bool bufferStaticFileHeaders(const std::string& path, time_t modified);
 
     std::list<Range> processRangesForStaticData(const std::list<Range>& ranges,
-                                                long fileSize);
+                                                long fileSize, std::string_view contentType);
+
+    // Decides whether to compress a response body of the given type and
+    // length (SIZE_MAX if unknown), buffering Vary and Content-Encoding to
+    // suit. Returns true, with _contentEncoder ready, if it's to be compressed.
+    bool bufferContentEncodingHeaders(std::string_view contentType, size_t length);
+    // A compressed body's length isn't known up front, so it's either chunked
+    // or, for HTTP/1.0 clients, ended by closing the connection.
+    void bufferCompressedFraming();
+    // Ends the headers of a page handler's response.
+    void endResponseHeaders();
+    // Writes part of a response body, compressing and chunking it as needed.
+    // flushSocket sends it on now; syncEncoder also makes everything
+    // compressed so far decodable, which costs some compression so is only
+    // for streaming responses that ask for it. The last part finishes off
+    // any compressed stream.
+    bool writeBody(const void* data, size_t size, bool flushSocket, bool syncEncoder = false, bool last = false);
 
     std::shared_ptr<Logger> _logger;
     ServerImpl& _server;
@@ -205,7 +384,41 @@ private:
     size_t _bytesSent;
     size_t _bytesReceived;
     std::vector<uint8_t> _inBuf;
+    // How much of _inBuf has already been searched for the end of the headers.
+    size_t _headerBytesSearched = 0;
+    bool _handlingNewData = false;
+    // Set while dispatching pipelined requests, so their responses are sent
+    // together rather than with a system call each.
+    bool _corked = false;
     std::vector<uint8_t> _outBuf;
+    // Once WebSocket frames are being written, the offset in _outBuf of the
+    // first frame that hasn't started going out yet.
+    bool _framing = false;
+    size_t _nextFrameBoundary = 0;
+    // Control frames waiting to jump the queue at _nextFrameBoundary. Only
+    // used while there's data after it to overtake.
+    std::vector<uint8_t> _controlBuf;
+    // WebSocket messages waiting for _outBuf to drain. Only used once a
+    // conflatable message has had to wait; keyed messages replace any queued
+    // message with the same key.
+    struct QueuedMessage {
+        std::string key;
+        uint8_t opcode;
+        std::vector<uint8_t> payload;
+        Deadline deadline;
+    };
+    std::list<QueuedMessage> _sendQueue;
+    std::unordered_map<std::string, std::list<QueuedMessage>::iterator> _sendQueueByKey;
+    size_t _sendQueueBytes = 0;
+    size_t _messagesConflated = 0;
+    // Frames in _outBuf that have a deadline and haven't started going out.
+    struct ExpiringFrame {
+        size_t offset;
+        Deadline deadline;
+    };
+    std::deque<ExpiringFrame> _expiringFrames;
+    size_t _messagesExpired = 0;
+    size_t _bytesExpired = 0;
     std::shared_ptr<WebSocket::Handler> _webSocketHandler;
     bool _shutdownByUser;
     std::unique_ptr<PageRequest> _request;
@@ -216,17 +429,103 @@ private:
 
     void parsePerMessageDeflateHeader(const std::string& header);
     bool _perMessageDeflate = false;
-    ZlibContext zlibContext;
+    bool _deflateNoContextTakeover = false;
+    int _deflateWindowBits = 15;
+    std::string _deflateDictionaryId;
+    std::string _perMessageDeflateResponse;
+    CompressionPolicy _compressionPolicy;
+    CompressionStats _compressionStats;
+    // Reused for every compressed message, so sending doesn't allocate.
+    std::vector<uint8_t> _deflateBuffer;
+    // Messages decoded from the current read, handed to onDataBatch together.
+    struct ReceivedMessage {
+        bool isText;
+        size_t offset;
+        size_t length;
+    };
+    std::vector<ReceivedMessage> _receivedMessages;
+    std::vector<uint8_t> _receivedData;
+    std::vector<MessageView> _receivedViews;
+    std::vector<uint8_t> _decodedMessage;
+    // The zlib streams live apart from us, so that a job on the server's
+    // worker pool can finish with them even if we've gone by then.
+    struct DeflateState {
+        ZlibContext zlib;
+        // Cleared when we go. Only used on the seasocks thread.
+        Connection* connection;
+    };
+    std::shared_ptr<DeflateState> _deflateState;
+    size_t _offloadThreshold = 0;
+    // Set while a worker has our zlib streams: sends queue up behind the
+    // message it's working on, and input waits.
+    bool _offloadBusy = false;
+
+    bool _validateUtf8 = false;
+
+    // Request body state. Chunked bodies are decoded into _chunkedContent,
+    // unless they're being streamed to _bodyHandler.
+    bool _chunkedBody = false;
+    std::unique_ptr<ChunkedDecoder> _chunkedDecoder;
+    std::vector<uint8_t> _chunkedContent;
+    std::shared_ptr<RequestBodyHandler> _bodyHandler;
+    std::shared_ptr<BodyFlow> _bodyFlow;
+    size_t _bodyRemaining = 0;
+    bool _readingPaused = false;
+
+    // Response compression. _acceptedEncoding is the best coding the client
+    // will take for the current request. The _response* fields track a page
+    // handler's headers until we know whether to compress its response.
+    ContentEncoding _acceptedEncoding{};
+    std::unique_ptr<ContentEncoder> _contentEncoder;
+    bool _compressingBody = false;
+    std::vector<uint8_t> _encodedBody;
+    ResponseCode _responseCode = ResponseCode::Ok;
+    std::string _responseContentType;
+    // SIZE_MAX until the handler gives a Content-Length.
+    static constexpr size_t NoContentLength = SIZE_MAX;
+    size_t _responseContentLength = NoContentLength;
+    bool _responseEncoded = false;
+
+    // HTTP keep-alive state. _keepAlive says whether the connection stays open
+    // after the response to the current request.
+    bool _http10 = false;
+    bool _keepAlive = true;
+    size_t _requestsReceived = 0;
+    std::chrono::steady_clock::time_point _lastActivity = std::chrono::steady_clock::now();
+
+    // Keepalive state. Each ping carries the time it was sent, so a matching
+    // pong tells us the round trip time.
+    std::chrono::steady_clock::time_point _lastPingSent;
+    bool _awaitingPong = false;
+    std::chrono::microseconds _lastRoundTripTime{0};
+    std::chrono::microseconds _averageRoundTripTime{0};
+
+    // Closing handshake state. The code and reason are those of whichever side
+    // started the handshake, and are passed to Handler::onDisconnect().
+    bool _closeSent = false;
+    std::chrono::steady_clock::time_point _closeStarted;
+    CloseCode _closeCode = CloseCode::Abnormal;
+    std::string _closeReason;
+
+    // Client mode state.
+    bool _client = false;
+    std::string _clientKey;
+    std::string _clientPath;
+    uint64_t _maskState = 0;
+    std::vector<uint8_t> _maskBuffer;
+    uint32_t nextMask();
 
     void pickProtocol();
 
     enum class State {
         INVALID,
         READING_HEADERS,
+        READING_UPGRADE_RESPONSE,
         READING_WEBSOCKET_KEY3,
         HANDLING_HIXIE_WEBSOCKET,
         HANDLING_HYBI_WEBSOCKET,
         BUFFERING_POST_DATA,
+        STREAMING_REQUEST_BODY,
         AWAITING_RESPONSE_BEGIN,
         SENDING_RESPONSE_HEADERS,
         SENDING_RESPONSE_BODY
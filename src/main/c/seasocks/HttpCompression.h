@@ -0,0 +1,59 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace seasocks {
+
+// Controls gzip/deflate compression of HTTP responses, for clients that say
+// in Accept-Encoding that they can take it. See
+// Server::setHttpCompressionOptions(). Responses that are compressed for some
+// clients carry "Vary: Accept-Encoding", so caches keep the versions apart.
+struct HttpCompressionOptions {
+    bool enabled = false;
+    // Responses known to be smaller than this are sent as they are: the gzip
+    // framing alone costs 18 bytes. Responses of unknown length (streamed
+    // without a Content-Length) are always candidates.
+    size_t minimumSize = 1024;
+    // zlib compression level: 1 (fastest) to 9 (best), or -1 for zlib's default.
+    int level = 6;
+    // Content types worth compressing, ignoring any parameters. An entry
+    // ending in '/' matches every subtype, so "text/" covers "text/html".
+    // Images, video and archives are almost always compressed already.
+    std::vector<std::string> contentTypes = {
+        "text/",
+        "application/json",
+        "application/javascript",
+        "application/xml",
+        "application/xhtml+xml",
+        "image/svg+xml",
+    };
+};
+
+}
@@ -40,6 +40,15 @@ public:
     virtual ~PageHandler() = default;
 
     virtual std::shared_ptr<Response> handle(const Request& request) = 0;
+
+    // Called when a request with a body has arrived, before any of the body
+    // is read. Return a response (say a 401 or 413) to refuse the request
+    // without transferring the body; the connection is then closed. Return
+    // Response::unhandled() to let it through. Clients that sent "Expect:
+    // 100-continue" are only told to go ahead once every handler has.
+    virtual std::shared_ptr<Response> checkRequestBody(const Request& /*request*/) {
+        return Response::unhandled();
+    }
 };
 
 }
@@ -0,0 +1,98 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+
+namespace seasocks {
+
+// Server-side policy used when negotiating the permessage-deflate extension
+// (RFC 7692). The defaults match what seasocks has always done: full 32KB
+// windows in both directions with context takeover. Shrinking the windows and
+// memLevel, or disabling context takeover, trades compression ratio for a much
+// smaller per-connection zlib footprint.
+struct PerMessageDeflateOptions {
+    // Largest window (log2 of its size) the server compresses with. zlib can't
+    // produce raw deflate streams with 8 bit windows, so this is clamped to 9..15.
+    int serverMaxWindowBits = 15;
+    // Largest window we ask clients to compress with. Only applied if the client
+    // advertised client_max_window_bits in its offer. 8..15.
+    int clientMaxWindowBits = 15;
+    // zlib memLevel for the server's compressor, 1..9. Each step halves or doubles
+    // the size of the compressor's hash tables.
+    int memLevel = 6;
+    // Reset the server's compressor after every message, even if the client
+    // didn't ask us to.
+    bool serverNoContextTakeover = false;
+    // Ask clients to reset their compressor after every message.
+    bool clientNoContextTakeover = false;
+};
+
+// Decides which outgoing WebSocket messages get compressed once per-message
+// deflate has been negotiated, and how hard zlib works at it. Each message
+// carries its own RSV1 bit, so messages that aren't worth compressing are
+// simply sent raw.
+struct CompressionPolicy {
+    enum class Strategy {
+        Default,
+        Filtered,
+        HuffmanOnly,
+        Rle,
+        Fixed,
+    };
+
+    // Messages smaller than this many bytes are sent uncompressed. Tiny messages
+    // like heartbeats usually grow when deflated.
+    size_t minimumSize = 0;
+    // zlib compression level: 0 (none) to 9 (best), or -1 for zlib's default.
+    int level = -1;
+    Strategy strategy = Strategy::Default;
+    // Look at the first few bytes of each message, and send it uncompressed if
+    // it is already in a compressed format (gzip, zip, PNG, JPEG etc).
+    bool skipCompressedContent = false;
+    // A preset dictionary for endpoints whose messages share a lot of
+    // structure, such as small JSON objects that all have the same keys. Even
+    // without context takeover these then compress well. It's only used with
+    // clients that offer permessage-deflate with a seasocks_dictionary=<id>
+    // parameter matching dictionaryId, and which compress with the same
+    // dictionary. The id must be a token, and should change whenever the
+    // dictionary does.
+    std::string dictionaryId;
+    std::string dictionary;
+};
+
+// Per-connection counters describing what compression has bought us.
+struct CompressionStats {
+    size_t messagesCompressed = 0;
+    size_t messagesUncompressed = 0;
+    size_t bytesBeforeCompression = 0;
+    size_t bytesAfterCompression = 0;
+    std::chrono::nanoseconds timeCompressing{0};
+};
+
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#pragma once
+
+#include "seasocks/Response.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace seasocks {
+
+class Request;
+
+// Handles requests for an endpoint whose bodies shouldn't be buffered in full
+// before anything sees them, such as large uploads. The body is passed on as
+// it arrives (chunked bodies having been decoded), so memory use doesn't grow
+// with its size. See Server::addRequestBodyHandler(). All calls are made on
+// the Seasocks thread; the Request is the same object for every call about a
+// given request, and stays valid until onBodyEnd() or onAbort().
+class RequestBodyHandler {
+public:
+    // Lets the handler hold back the rest of the body while it catches up:
+    // while paused, no more is read from the client. Safe to use after the
+    // connection has gone, when it does nothing.
+    class Flow {
+    public:
+        virtual ~Flow() = default;
+        virtual void pause() = 0;
+        virtual void resume() = 0;
+    };
+
+    virtual ~RequestBodyHandler() = default;
+
+    // As PageHandler::checkRequestBody(): return a response to refuse the
+    // request before any of its body is read, or Response::unhandled().
+    virtual std::shared_ptr<Response> checkRequestBody(const Request& /*request*/) {
+        return Response::unhandled();
+    }
+    // The request's headers have arrived. Keep hold of flow to pause the body.
+    virtual void onBegin(const Request& /*request*/, std::shared_ptr<Flow> /*flow*/) {
+    }
+    // The next part of the body. data is only valid during the call.
+    virtual void onBodyData(const Request& request, const uint8_t* data, size_t length) = 0;
+    // The whole body has arrived: returns the response, as a PageHandler would.
+    virtual std::shared_ptr<Response> onBodyEnd(const Request& request) = 0;
+    // The connection closed before the whole body arrived.
+    virtual void onAbort(const Request& /*request*/) {
+    }
+};
+
+}
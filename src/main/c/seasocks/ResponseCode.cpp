@@ -42,3 +42,15 @@ const char* name(ResponseCode code) {
     }
     return "Unknown";
 }
+
+std::string_view statusLine(ResponseCode code) {
+    switch (code) {
+#define SEASOCKS_DEFINE_RESPONSECODE(CODE, SYMBOLICNAME, STRINGNAME) \
+    case ResponseCode::SYMBOLICNAME:                                 \
+        return "HTTP/1.1 " #CODE " " STRINGNAME "\r\n";
+#include "seasocks/ResponseCodeDefs.h"
+
+#undef SEASOCKS_DEFINE_RESPONSECODE
+    }
+    return {};
+}
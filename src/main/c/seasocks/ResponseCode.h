@@ -26,6 +26,7 @@
 #pragma once
 
 #include <string>
+#include <string_view>
 
 namespace seasocks {
 
@@ -39,4 +40,7 @@ enum class ResponseCode {
 }
 
 const char* name(seasocks::ResponseCode code);
+// The whole "HTTP/1.1 200 OK\r\n" line for a response, or empty for codes
+// we don't know.
+std::string_view statusLine(seasocks::ResponseCode code);
 bool isOk(seasocks::ResponseCode code);
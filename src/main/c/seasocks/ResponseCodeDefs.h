@@ -61,6 +61,11 @@ SEASOCKS_DEFINE_RESPONSECODE(403, Forbidden, "Forbidden")
 SEASOCKS_DEFINE_RESPONSECODE(404, NotFound, "Not Found")
 SEASOCKS_DEFINE_RESPONSECODE(405, MethodNotAllowed, "Method Not Allowed")
 // more here...
+SEASOCKS_DEFINE_RESPONSECODE(413, PayloadTooLarge, "Payload Too Large")
+// more here...
+SEASOCKS_DEFINE_RESPONSECODE(416, RangeNotSatisfiable, "Range Not Satisfiable")
+SEASOCKS_DEFINE_RESPONSECODE(417, ExpectationFailed, "Expectation Failed")
+// more here...
 SEASOCKS_DEFINE_RESPONSECODE(426, UpgradeRequired, "Upgrade Required")
 // more here...
 
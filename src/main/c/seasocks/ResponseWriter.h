@@ -50,6 +50,11 @@ public:
     // Add a header. Must be called after 'begin' and before 'payload'. May be
     // called as many times as needed.
     virtual void header(const std::string& header, const std::string& value) = 0;
+    // Add a header with a numeric value, such as Content-Length. Writers may
+    // format it straight into their output.
+    virtual void header(const std::string& header, size_t value) {
+        this->header(header, std::to_string(value));
+    }
     // Add some payload data. Must be called after 'begin' and any 'header' calls.
     // May be called multiple times. The flush parameter controls whether the
     // data should be sent immediately, or buffered to be sent with a subsequent
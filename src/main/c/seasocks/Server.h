@@ -25,8 +25,12 @@
 
 #pragma once
 
+#include "seasocks/HttpCompression.h"
+#include "seasocks/PerMessageDeflate.h"
 #include "seasocks/ServerImpl.h"
+#include "seasocks/StaticFileCacheOptions.h"
 #include "seasocks/WebSocket.h"
+#include "seasocks/ZlibContext.h"
 
 #include <sys/types.h>
 
@@ -38,7 +42,10 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <unordered_map>
+#include <vector>
 #ifdef _WIN32
 #include "seasocks/win32/winsock_includes.h"
 #define ioctl ioctlsocket
@@ -67,6 +74,9 @@ class Logger;
 class PageHandler;
 class Request;
 class Response;
+class StaticFileCache;
+class TopicRegistry;
+class WorkerPool;
 
 class Server : private ServerImpl {
 public:
@@ -78,6 +88,11 @@ public:
     void addWebSocketHandler(const char* endpoint, std::shared_ptr<WebSocket::Handler> handler,
                              bool allowCrossOriginRequests = false);
 
+    // Requests for the endpoint go to the handler rather than the page
+    // handlers, with their bodies streamed to it as they arrive instead of
+    // being buffered in full first.
+    void addRequestBodyHandler(const char* endpoint, std::shared_ptr<RequestBodyHandler> handler);
+
     // Serves static content from the given port on the current thread, until terminate is called.
     // Roughly equivalent to startListening(port); setStaticPath(staticPath); loop();
     // Returns whether exiting was expected.
@@ -127,6 +142,30 @@ public:
     // This is possibly caused by bad WebSocket implementation in Chrome.
     void setLameConnectionTimeoutSeconds(int seconds);
 
+    // Sends a WebSocket ping on each connection every this many seconds, and
+    // measures the round trip time from the pong. A value of 0 disables pings,
+    // which is the default. See WebSocket::lastRoundTripTime().
+    void setWebSocketPingIntervalSeconds(int seconds);
+
+    // If a ping goes unanswered for this long, the connection is assumed dead
+    // and closed. Only applies if pings are enabled.
+    void setWebSocketPongTimeoutSeconds(int seconds);
+
+    // How long to wait for a client to complete the WebSocket closing handshake
+    // (including draining any data queued ahead of our Close frame) before
+    // dropping the connection anyway.
+    void setWebSocketCloseTimeoutSeconds(int seconds);
+
+    // Closes HTTP connections kept alive between requests once they've been
+    // idle for this long, so clients that never hang up don't hold on to file
+    // descriptors for good. The default is 60 seconds; 0 disables the timeout.
+    void setHttpKeepAliveTimeoutSeconds(int seconds);
+
+    // The most requests served over a single HTTP connection: the response to
+    // the last one tells the client to go elsewhere and closes it. The default
+    // of 0 means no limit.
+    void setHttpKeepAliveMaxRequests(int maxRequests);
+
     // Sets the maximum number of TCP level keepalives that we can miss before
     // we let the OS consider the connection dead. We configure keepalives every second,
     // so this is also the minimum number of seconds it takes to notice a badly-behaved
@@ -147,6 +186,79 @@ public:
     bool getPerMessageDeflateEnabled() {
         return _perMessageDeflateEnabled;
     }
+    // Check that incoming WebSocket text messages are valid UTF-8 before they
+    // reach the handler, closing the connection (with status 1007) if not.
+    // Disabled by default.
+    void setUtf8ValidationEnabled(bool enabled);
+    bool getUtf8ValidationEnabled() const {
+        return _utf8ValidationEnabled;
+    }
+    // Sets the window sizes, memory level and context takeover policy used when
+    // negotiating per-message deflate. See PerMessageDeflateOptions.
+    void setPerMessageDeflateOptions(const PerMessageDeflateOptions& options);
+    const PerMessageDeflateOptions& getPerMessageDeflateOptions() const {
+        return _perMessageDeflateOptions;
+    }
+    // Sets which messages are compressed on deflate-enabled WebSocket connections,
+    // and at what level. The first overload sets the default for all endpoints,
+    // the second overrides it for a single endpoint.
+    void setCompressionPolicy(const CompressionPolicy& policy);
+    void setCompressionPolicy(const char* endpoint, const CompressionPolicy& policy);
+    // Deflates and inflates WebSocket messages of at least thresholdBytes on a
+    // pool of numThreads worker threads, rather than on the seasocks thread, so
+    // one huge message doesn't stall every other connection. Messages on each
+    // connection stay in order. A threshold of 0 (the default) keeps all
+    // compression on the seasocks thread. Call before startListening().
+    void setCompressionOffload(size_t thresholdBytes, size_t numThreads = 2);
+    // Compresses HTTP responses (from page handlers, static files and embedded
+    // content) with gzip or deflate for clients that accept it. Off by default.
+    // See HttpCompressionOptions.
+    void setHttpCompressionOptions(const HttpCompressionOptions& options);
+    const HttpCompressionOptions& httpCompressionOptions() const override {
+        return _httpCompressionOptions;
+    }
+    // Keeps recently served static files in memory. Off by default. See
+    // StaticFileCacheOptions.
+    void setStaticFileCacheOptions(const StaticFileCacheOptions& options);
+
+    // Sends the same message to many WebSockets. Must be called on the seasocks
+    // thread. Connections that negotiated server_no_context_takeover with the
+    // same compression settings share a single compressed frame, so the message
+    // is only deflated once per group rather than once per connection.
+    void broadcast(const std::vector<WebSocket*>& sockets, const char* data);
+    void broadcast(const std::vector<WebSocket*>& sockets, std::string_view data);
+    void broadcast(const std::vector<WebSocket*>& sockets, const std::string& data) {
+        broadcast(sockets, std::string_view(data));
+    }
+    void broadcast(const std::vector<WebSocket*>& sockets, const uint8_t* data, size_t length);
+
+    // Opens a client WebSocket connection to ws://host:port/path, run by this
+    // server's event loop alongside the connections it accepts. The handler
+    // gets the usual callbacks: onConnect() once the server accepts the
+    // upgrade, onData() for each message, and onDisconnect() when the
+    // connection closes or fails (in which case onConnect() is never called).
+    // The host is resolved synchronously. Must be called on the seasocks
+    // thread. Returns nullptr if the connection couldn't be started.
+    WebSocket* connectWebSocket(const std::string& host, int port, const std::string& path,
+                                std::shared_ptr<WebSocket::Handler> handler);
+
+    // Topic based publish/subscribe. A WebSocket subscribed to a topic receives
+    // every message published to it, until it unsubscribes or disconnects. Each
+    // publication is sent as with broadcast(). If retain is set the message is
+    // also kept, and sent to anyone subscribing to the topic later (until
+    // replaced by another retained message, or cleared). Must be called on the
+    // seasocks thread. subscribe() and unsubscribe() return false if the socket
+    // was already (or not) subscribed.
+    bool subscribe(WebSocket* socket, const std::string& topic);
+    bool unsubscribe(WebSocket* socket, const std::string& topic);
+    void publish(const std::string& topic, const char* data, bool retain = false);
+    void publish(const std::string& topic, std::string_view data, bool retain = false);
+    void publish(const std::string& topic, const std::string& data, bool retain = false) {
+        publish(topic, std::string_view(data), retain);
+    }
+    void publish(const std::string& topic, const uint8_t* data, size_t length, bool retain = false);
+    void clearRetained(const std::string& topic);
+    size_t numSubscribers(const std::string& topic) const;
 
     class Runnable {
     public:
@@ -163,26 +275,52 @@ private:
     virtual void remove(Connection* connection) override;
     virtual bool subscribeToWriteEvents(Connection* connection) override;
     virtual bool unsubscribeFromWriteEvents(Connection* connection) override;
+    virtual bool subscribeToReadEvents(Connection* connection) override;
+    virtual bool unsubscribeFromReadEvents(Connection* connection) override;
     virtual const std::string& getStaticPath() const override {
         return _staticPath;
     }
     virtual std::shared_ptr<WebSocket::Handler> getWebSocketHandler(const char* endpoint) const override;
+    virtual std::shared_ptr<RequestBodyHandler> getRequestBodyHandler(const char* endpoint) const override;
     virtual bool isCrossOriginAllowed(const std::string& endpoint) const override;
+    virtual const CompressionPolicy& getCompressionPolicy(const std::string& endpoint) const override;
     virtual std::shared_ptr<Response> handle(const Request& request) override;
+    virtual std::shared_ptr<Response> checkRequestBody(const Request& request) override;
     virtual std::string getStatsDocument() const override;
     virtual void checkThread() const override;
     virtual Server& server() override {
         return *this;
     }
+    virtual int httpKeepAliveTimeoutSeconds() const override {
+        return _httpKeepAliveTimeoutSeconds;
+    }
+    virtual int httpKeepAliveMaxRequests() const override {
+        return _httpKeepAliveMaxRequests;
+    }
+    virtual const std::string& httpDate() const override {
+        return _httpDate;
+    }
+    virtual StaticFileCache* staticFileCache() override {
+        return _staticFileCache.get();
+    }
+    virtual size_t compressionOffloadThreshold() const override {
+        return _compressionOffloadThreshold;
+    }
+    virtual void offload(std::function<void()> work, std::function<void()> done) override;
 
     bool makeNonBlocking(NativeSocketType fd) const;
     bool configureSocket(NativeSocketType fd) const;
     void handleAccept();
     void processEventQueue();
     void runExecutables();
+    void updateHttpDate(time_t now);
 
     void shutdown();
 
+    void broadcast(const std::vector<WebSocket*>& sockets, uint8_t opcode, const uint8_t* data, size_t length);
+    void publish(const std::string& topic, uint8_t opcode, const uint8_t* data, size_t length, bool retain);
+    ZlibContext& broadcastCompressor(int windowBits, const CompressionPolicy& policy, bool useDictionary);
+
     void checkAndDispatchEpoll(int epollMillis);
     void handlePipe();
     enum class NewState { KeepOpen,
@@ -198,11 +336,34 @@ private:
     EpollHandle _eventFd;
     int _maxKeepAliveDrops;
     int _lameConnectionTimeoutSeconds;
+    int _webSocketPingIntervalSeconds;
+    int _webSocketPongTimeoutSeconds;
+    int _webSocketCloseTimeoutSeconds;
+    int _httpKeepAliveTimeoutSeconds;
+    int _httpKeepAliveMaxRequests;
     size_t _clientBufferSize;
     time_t _nextDeadConnectionCheck;
+    time_t _httpDateTime = -1;
+    std::string _httpDate;
+
+    bool _utf8ValidationEnabled = false;
 
     // Compression settings
     bool _perMessageDeflateEnabled = false;
+    PerMessageDeflateOptions _perMessageDeflateOptions;
+    HttpCompressionOptions _httpCompressionOptions;
+    CompressionPolicy _defaultCompressionPolicy;
+    std::unordered_map<std::string, CompressionPolicy> _compressionPolicies;
+    // Compressors used by broadcast(), keyed on window bits, memLevel, level,
+    // strategy and preset dictionary.
+    using BroadcastCompressorKey = std::tuple<int, int, int, CompressionPolicy::Strategy, std::string>;
+    std::map<BroadcastCompressorKey, std::unique_ptr<ZlibContext>> _broadcastCompressors;
+
+    std::unique_ptr<TopicRegistry> _topics;
+    std::unique_ptr<StaticFileCache> _staticFileCache;
+
+    size_t _compressionOffloadThreshold = 0;
+    std::unique_ptr<WorkerPool> _compressionWorkers;
 
     struct WebSocketHandlerEntry {
         std::shared_ptr<WebSocket::Handler> handler;
@@ -210,6 +371,7 @@ private:
     };
     typedef std::unordered_map<std::string, WebSocketHandlerEntry> WebSocketHandlerMap;
     WebSocketHandlerMap _webSocketHandlerMap;
+    std::unordered_map<std::string, std::shared_ptr<RequestBodyHandler>> _requestBodyHandlers;
 
     std::list<std::shared_ptr<PageHandler>> _pageHandlers;
 
@@ -25,16 +25,21 @@
 
 #pragma once
 
+#include "seasocks/HttpCompression.h"
+#include "seasocks/PerMessageDeflate.h"
 #include "seasocks/WebSocket.h"
 
+#include <functional>
 #include <string>
 
 namespace seasocks {
 
 class Connection;
 class Request;
+class RequestBodyHandler;
 class Response;
 class Server;
+class StaticFileCache;
 
 // Internal implementation used to give access to internals to Connections.
 class ServerImpl {
@@ -44,14 +49,34 @@ public:
     virtual void remove(Connection* connection) = 0;
     virtual bool subscribeToWriteEvents(Connection* connection) = 0;
     virtual bool unsubscribeFromWriteEvents(Connection* connection) = 0;
+    virtual bool subscribeToReadEvents(Connection* connection) = 0;
+    virtual bool unsubscribeFromReadEvents(Connection* connection) = 0;
     virtual const std::string& getStaticPath() const = 0;
     virtual std::shared_ptr<WebSocket::Handler> getWebSocketHandler(const char* endpoint) const = 0;
+    virtual std::shared_ptr<RequestBodyHandler> getRequestBodyHandler(const char* endpoint) const = 0;
     virtual bool isCrossOriginAllowed(const std::string& endpoint) const = 0;
+    virtual const CompressionPolicy& getCompressionPolicy(const std::string& endpoint) const = 0;
+    virtual const HttpCompressionOptions& httpCompressionOptions() const = 0;
     virtual std::shared_ptr<Response> handle(const Request& request) = 0;
+    // Gives the page handlers a chance to refuse a request before its body is
+    // read. Response::unhandled() if none of them object.
+    virtual std::shared_ptr<Response> checkRequestBody(const Request& request) = 0;
     virtual std::string getStatsDocument() const = 0;
     virtual void checkThread() const = 0;
     virtual Server& server() = 0;
     virtual size_t clientBufferSize() const = 0;
+    // HTTP keep-alive settings; zero for no limit. See Server.
+    virtual int httpKeepAliveTimeoutSeconds() const = 0;
+    virtual int httpKeepAliveMaxRequests() const = 0;
+    // The Date header for responses, refreshed by the event loop.
+    virtual const std::string& httpDate() const = 0;
+    // Null unless static files are to be cached.
+    virtual StaticFileCache* staticFileCache() = 0;
+    // Compressed WebSocket messages at least this big are deflated or inflated
+    // with offload(). Zero if offloading is disabled.
+    virtual size_t compressionOffloadThreshold() const = 0;
+    // Runs work on a worker thread, then done back on the seasocks thread.
+    virtual void offload(std::function<void()> work, std::function<void()> done) = 0;
 };
 
 }
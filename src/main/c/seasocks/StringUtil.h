@@ -52,8 +52,11 @@ void replace(std::string& string, const std::string& find, const std::string& re
 bool caseInsensitiveSame(const std::string& lhs, const std::string& rhs);
 
 std::string webtime(time_t time);
+// As above, but into buf, returning the length written.
+size_t webtime(time_t time, char* buf, size_t size);
 
-std::string now();
+// The current time as an HTTP date. Only valid until the next call on this thread.
+const std::string& now();
 
 std::string getWorkingDir();
 
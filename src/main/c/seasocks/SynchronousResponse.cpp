@@ -24,11 +24,27 @@
 // POSSIBILITY OF SUCH DAMAGE.
 
 #include "seasocks/SynchronousResponse.h"
-#include "seasocks/ToString.h"
 #include "seasocks/StringUtil.h"
 
 using namespace seasocks;
 
+namespace {
+
+// Built once, rather than a temporary for each use in every response.
+const std::string ContentLength("Content-Length");
+const std::string ContentType("Content-Type");
+const std::string Connection("Connection");
+const std::string KeepAlive("keep-alive");
+const std::string Close("close");
+const std::string LastModified("Last-Modified");
+const std::string Pragma("Pragma");
+const std::string NoCache("no-cache");
+const std::string CacheControl("Cache-Control");
+const std::string NoStore("no-store");
+const std::string Expires("Expires");
+
+}
+
 void SynchronousResponse::handle(std::shared_ptr<ResponseWriter> writer) {
     auto rc = responseCode();
     if (!isOk(rc)) {
@@ -37,21 +53,27 @@ void SynchronousResponse::handle(std::shared_ptr<ResponseWriter> writer) {
     }
 
     writer->begin(responseCode());
+    const auto& date = now();
 
-    writer->header("Content-Length", toString(payloadSize()));
-    writer->header("Content-Type", contentType());
-    writer->header("Connection", keepConnectionAlive() ? "keep-alive" : "close");
-    writer->header("Last-Modified", now());
-    writer->header("Pragma", "no-cache");
+    writer->header(ContentLength, payloadSize());
+    writer->header(ContentType, contentType());
+    writer->header(Connection, keepConnectionAlive() ? KeepAlive : Close);
+    writer->header(LastModified, date);
+    writer->header(Pragma, NoCache);
 
-    auto headers = getAdditionalHeaders();
+    Headers copied;
+    auto* stored = storedAdditionalHeaders();
+    if (!stored) {
+        copied = getAdditionalHeaders();
+    }
+    const auto& headers = stored ? *stored : copied;
 
-    if (headers.find("Cache-Control") == headers.end()) {
-        writer->header("Cache-Control", "no-store");
+    if (headers.find(CacheControl) == headers.end()) {
+        writer->header(CacheControl, NoStore);
     }
 
-    if (headers.find("Expires") == headers.end()) {
-        writer->header("Expires", now());
+    if (headers.find(Expires) == headers.end()) {
+        writer->header(Expires, date);
     }
 
     for (auto& header : headers) {
@@ -47,6 +47,11 @@ public:
 
     typedef std::multimap<std::string, std::string> Headers;
     virtual Headers getAdditionalHeaders() const = 0;
+    // Responses that keep their headers can return them here, sparing handle()
+    // a copy. Defaults to nullptr, meaning getAdditionalHeaders() is used.
+    virtual const Headers* storedAdditionalHeaders() const {
+        return nullptr;
+    }
 };
 
 }
\ No newline at end of file
@@ -27,7 +27,9 @@
 
 #include "seasocks/Request.h"
 
+#include <chrono>
 #include <string>
+#include <string_view>
 #include <vector>
 #ifdef WIN32
 #include "seasocks/win32/win_unistd.h"
@@ -46,19 +48,64 @@ namespace seasocks {
 
 class WebSocket : public Request {
 public:
+    /**
+     * Status codes carried by WebSocket Close frames (RFC 6455 section 7.4).
+     * Applications may also use their own codes in the range 4000-4999.
+     */
+    enum class CloseCode : uint16_t {
+        Normal = 1000,
+        GoingAway = 1001,
+        ProtocolError = 1002,
+        UnsupportedData = 1003,
+        NoStatus = 1005, // Never sent: the peer's Close frame had no status code.
+        Abnormal = 1006, // Never sent: the connection dropped without a Close frame.
+        InvalidData = 1007,
+        PolicyViolation = 1008,
+        MessageTooBig = 1009,
+        MandatoryExtension = 1010,
+        InternalError = 1011,
+        ServiceRestart = 1012,
+        TryAgainLater = 1013,
+        BadGateway = 1014,
+    };
+
+    /**
+     * A complete message handed to Handler::onDataBatch. The data is only valid
+     * for the duration of that call. Text messages are also null terminated
+     * (not counted in length), so text() can be used as a C string.
+     */
+    struct MessageView {
+        bool isText;
+        const uint8_t* data;
+        size_t length;
+
+        const char* text() const {
+            return reinterpret_cast<const char*>(data);
+        }
+    };
+
     /**
      * Send the given text data. Must be called on the seasocks thread.
      * See Server::execute for how to run work on the seasocks
      * thread externally.
      */
     virtual void send(const char* data) = 0;
+    /**
+     * Send the given text data. Must be called on the seasocks thread.
+     * See Server::execute for how to run work on the seasocks
+     * thread externally. Once the connection is up and running this
+     * doesn't allocate. Defaults to send(const char*) on a copy.
+     */
+    virtual void send(std::string_view data) {
+        send(std::string(data).c_str());
+    }
     /**
      * Send the given text data. Must be called on the seasocks thread.
      * See Server::execute for how to run work on the seasocks
      * thread externally.
      */
     void send(const std::string& data) {
-        send(data.c_str());
+        send(std::string_view(data));
     }
     /**
      * Send the given binary data. Must be called on the seasocks thread.
@@ -66,12 +113,73 @@ public:
      * thread externally.
      */
     virtual void send(const uint8_t* data, size_t length) = 0;
+    /**
+     * Send the given text data, which is only worth delivering within
+     * timeToLive of now. If the client is so far behind that none of the
+     * message has been written by then, it's dropped rather than sent. See
+     * Connection::messagesExpired(). Must be called on the seasocks thread.
+     * Defaults to sending it regardless.
+     */
+    virtual void send(std::string_view data, std::chrono::milliseconds /*timeToLive*/) {
+        send(data);
+    }
+    /**
+     * Send the given binary data, dropping it if it's still wholly unsent
+     * after timeToLive. See above.
+     */
+    virtual void send(const uint8_t* data, size_t length, std::chrono::milliseconds /*timeToLive*/) {
+        send(data, length);
+    }
+    /**
+     * Send the given text data, tagged with a key. While the client keeps up
+     * this is just send(). Once it falls behind, messages wait in a queue where
+     * a newer message replaces any unsent one with the same key, so a slow
+     * client gets the latest value for each key with bounded memory rather than
+     * every stale update. Other messages sent meanwhile stay in order behind
+     * the queued ones. Must be called on the seasocks thread. Defaults to
+     * send().
+     */
+    virtual void sendConflated(const std::string& /*key*/, const char* data) {
+        send(data);
+    }
+    void sendConflated(const std::string& key, const std::string& data) {
+        sendConflated(key, data.c_str());
+    }
+    /**
+     * Send the given binary data, tagged with a key. See above.
+     */
+    virtual void sendConflated(const std::string& /*key*/, const uint8_t* data, size_t length) {
+        send(data, length);
+    }
     /**
      * Close the socket. It's invalid to access the socket after
      * calling close(). The Handler::onDisconnect() call may occur
-     * at a later time.
+     * at a later time. Equivalent to close(CloseCode::Normal, "").
      */
     virtual void close() = 0;
+    /**
+     * Start the closing handshake. Anything already sent is delivered first,
+     * followed by a Close frame with the given code and reason (truncated to
+     * 123 bytes). The connection is dropped once the client replies, or after
+     * Server::setWebSocketCloseTimeoutSeconds. As with close(), the socket must
+     * not be used afterwards. Defaults to close().
+     */
+    virtual void close(CloseCode /*code*/, const std::string& /*reason*/) {
+        close();
+    }
+
+    /**
+     * Round trip times measured from the server's keepalive pings: the most
+     * recent sample, and a smoothed (exponentially weighted) average of them.
+     * Both are zero until the first pong arrives, and by default. See
+     * Server::setWebSocketPingIntervalSeconds.
+     */
+    virtual std::chrono::microseconds lastRoundTripTime() const {
+        return std::chrono::microseconds(0);
+    }
+    virtual std::chrono::microseconds averageRoundTripTime() const {
+        return std::chrono::microseconds(0);
+    }
 
     /**
      * Interface to dealing with WebSocket connections.
@@ -94,10 +202,34 @@ public:
          */
         virtual void onData(WebSocket*, const uint8_t*, size_t) {
         }
+        /**
+         * Called on the seasocks thread once per read with every complete message
+         * that read produced, in order. Override this to handle messages in bulk,
+         * e.g. taking a lock once rather than per message. Defaults to calling
+         * the appropriate onData for each message.
+         */
+        virtual void onDataBatch(WebSocket* connection, const MessageView* messages, size_t count) {
+            for (size_t i = 0; i < count; ++i) {
+                if (messages[i].isText) {
+                    onData(connection, messages[i].text());
+                } else {
+                    onData(connection, messages[i].data, messages[i].length);
+                }
+            }
+        }
         /**
          * Called on the seasocks thread when the socket has been
          */
         virtual void onDisconnect(WebSocket* connection) = 0;
+        /**
+         * Called on the seasocks thread when the socket has been closed, with the
+         * status code and reason from the closing handshake, whichever side started
+         * it. The code is CloseCode::Abnormal if the connection dropped without one.
+         * Defaults to calling onDisconnect(connection).
+         */
+        virtual void onDisconnect(WebSocket* connection, CloseCode /*code*/, const std::string& /*reason*/) {
+            onDisconnect(connection);
+        }
         /**
          * Choose a protocol before accepting a connection: return < 0 to reject the connection, else return the ordinal
          * in the vector of string protocols.
@@ -25,6 +25,10 @@
 
 #include "seasocks/ZlibContext.h"
 
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
 #include <memory>
 #include <stdexcept>
 
@@ -32,18 +36,69 @@
 
 namespace seasocks {
 
+namespace {
+
+// Size of the scratch buffer inflate() decompresses through.
+constexpr size_t InflateChunk = 16 * 1024;
+
+int toZlibStrategy(seasocks::CompressionPolicy::Strategy strategy) {
+    using Strategy = seasocks::CompressionPolicy::Strategy;
+    switch (strategy) {
+        case Strategy::Filtered:
+            return Z_FILTERED;
+        case Strategy::HuffmanOnly:
+            return Z_HUFFMAN_ONLY;
+        case Strategy::Rle:
+            return Z_RLE;
+        case Strategy::Fixed:
+            return Z_FIXED;
+        case Strategy::Default:
+            break;
+    }
+    return Z_DEFAULT_STRATEGY;
+}
+
+}
+
 struct ZlibContext::Impl {
     z_stream deflateStream;
     z_stream inflateStream;
     bool streamsInitialised = false;
-    uint8_t buffer[16384] = {0};
+    bool deflateNoContextTakeover;
+    bool inflateNoContextTakeover;
+    std::vector<uint8_t> dictionary;
+    size_t bytesAllocated = 0;
+
+    // zlib allocator hooks, used to keep track of how much memory each context
+    // costs. Each block is prefixed with its size so zfree() can account for it.
+    static voidpf allocate(voidpf opaque, uInt items, uInt size) {
+        auto bytes = static_cast<size_t>(items) * size;
+        auto block = static_cast<uint8_t*>(std::malloc(bytes + sizeof(std::max_align_t)));
+        if (!block) {
+            return Z_NULL;
+        }
+        memcpy(block, &bytes, sizeof(bytes));
+        static_cast<Impl*>(opaque)->bytesAllocated += bytes;
+        return block + sizeof(std::max_align_t);
+    }
+
+    static void release(voidpf opaque, voidpf address) {
+        auto block = static_cast<uint8_t*>(address) - sizeof(std::max_align_t);
+        size_t bytes;
+        memcpy(&bytes, block, sizeof(bytes));
+        static_cast<Impl*>(opaque)->bytesAllocated -= bytes;
+        std::free(block);
+    }
 
-    Impl(int deflateBits, int inflateBits, int memLevel) {
+    Impl(int deflateBits, int inflateBits, int memLevel,
+         bool deflateNoContextTakeover_, bool inflateNoContextTakeover_)
+            : deflateNoContextTakeover(deflateNoContextTakeover_),
+              inflateNoContextTakeover(inflateNoContextTakeover_) {
         int ret;
 
-        deflateStream.zalloc = Z_NULL;
-        deflateStream.zfree = Z_NULL;
-        deflateStream.opaque = Z_NULL;
+        deflateStream.zalloc = &Impl::allocate;
+        deflateStream.zfree = &Impl::release;
+        deflateStream.opaque = this;
 
         ret = ::deflateInit2(
             &deflateStream,
@@ -57,9 +112,9 @@ struct ZlibContext::Impl {
             throw std::runtime_error("error initialising zlib deflater");
         }
 
-        inflateStream.zalloc = Z_NULL;
-        inflateStream.zfree = Z_NULL;
-        inflateStream.opaque = Z_NULL;
+        inflateStream.zalloc = &Impl::allocate;
+        inflateStream.zfree = &Impl::release;
+        inflateStream.opaque = this;
         inflateStream.avail_in = 0;
         inflateStream.next_in = Z_NULL;
 
@@ -82,6 +137,34 @@ struct ZlibContext::Impl {
         ::inflateEnd(&inflateStream);
     }
 
+    void setCompression(int level, CompressionPolicy::Strategy strategy) {
+        if (::deflateParams(&deflateStream, level, toZlibStrategy(strategy)) != Z_OK) {
+            throw std::runtime_error("error setting zlib compression parameters");
+        }
+    }
+
+    void setDictionary(const uint8_t* data, size_t length) {
+        dictionary.assign(data, data + length);
+        applyDeflateDictionary();
+        applyInflateDictionary();
+    }
+
+    void applyDeflateDictionary() {
+        if (!dictionary.empty()
+            && ::deflateSetDictionary(&deflateStream, dictionary.data(), static_cast<uInt>(dictionary.size())) != Z_OK) {
+            throw std::runtime_error("error setting zlib deflate dictionary");
+        }
+    }
+
+    void applyInflateDictionary() {
+        // Raw inflate streams take their dictionary up front, rather than
+        // waiting to be asked for it with Z_NEED_DICT.
+        if (!dictionary.empty()
+            && ::inflateSetDictionary(&inflateStream, dictionary.data(), static_cast<uInt>(dictionary.size())) != Z_OK) {
+            throw std::runtime_error("error setting zlib inflate dictionary");
+        }
+    }
+
     void deflate(const uint8_t* input, size_t inputLen, std::vector<uint8_t>& output) {
 
         // These strange casts prevent compiler warnings, and therefore build failure
@@ -90,9 +173,14 @@ struct ZlibContext::Impl {
         deflateStream.avail_in = static_cast<uInt>(inputLen);
 
         if (inputLen > 0) {
+            // Compress straight into the output: deflateBound() is almost always
+            // enough, and we loop in the rare case it isn't.
+            auto chunk = ::deflateBound(&deflateStream, static_cast<uLong>(inputLen)) + 16;
             do {
-                deflateStream.next_out = buffer;
-                deflateStream.avail_out = sizeof(buffer);
+                auto used = output.size();
+                output.resize(used + chunk);
+                deflateStream.next_out = output.data() + used;
+                deflateStream.avail_out = static_cast<uInt>(chunk);
 
                 int ret = ::deflate(&deflateStream, Z_SYNC_FLUSH);
 
@@ -100,7 +188,7 @@ struct ZlibContext::Impl {
                     throw std::runtime_error("error deflating message");
                 }
 
-                output.insert(output.end(), buffer, buffer + sizeof(buffer) - deflateStream.avail_out);
+                output.resize(output.size() - deflateStream.avail_out);
             } while (deflateStream.avail_out == 0);
         }
 
@@ -112,9 +200,14 @@ struct ZlibContext::Impl {
         } else {
             output.resize(output.size() - 4);
         }
+
+        if (deflateNoContextTakeover) {
+            ::deflateReset(&deflateStream);
+            applyDeflateDictionary();
+        }
     }
 
-    bool inflate(std::vector<uint8_t>& input, std::vector<uint8_t>& output, int& zlibError) {
+    bool inflate(std::vector<uint8_t>& input, std::vector<uint8_t>& output, int& zlibError, size_t maxOutputSize) {
         // Append 4 octets prior to decompression (see RFC 7692, section 7.2.2)
         uint8_t tail_end[4] = {0x00, 0x00, 0xff, 0xff};
         input.insert(input.end(), tail_end, tail_end + 4);
@@ -123,6 +216,9 @@ struct ZlibContext::Impl {
         // uInt is some zlib type.
         inflateStream.avail_in = static_cast<uInt>(input.size());
 
+        // Go through a fixed buffer, letting the output grow only as data
+        // actually arrives rather than guessing (and zero filling) up front.
+        uint8_t buffer[InflateChunk];
         do {
             inflateStream.next_out = buffer;
             inflateStream.avail_out = sizeof(buffer);
@@ -134,9 +230,18 @@ struct ZlibContext::Impl {
                 return false;
             }
 
-            output.insert(output.end(), buffer, buffer + sizeof(buffer) - inflateStream.avail_out);
+            auto produced = sizeof(buffer) - inflateStream.avail_out;
+            if (output.size() + produced > maxOutputSize) {
+                zlibError = Z_OK;
+                return false;
+            }
+            output.insert(output.end(), buffer, buffer + produced);
         } while (inflateStream.avail_out == 0);
 
+        if (inflateNoContextTakeover) {
+            ::inflateReset(&inflateStream);
+            applyInflateDictionary();
+        }
         return true;
     }
 };
@@ -145,16 +250,31 @@ ZlibContext::ZlibContext() = default;
 
 ZlibContext::~ZlibContext() = default;
 
-void ZlibContext::initialise(int deflateBits, int inflateBits, int memLevel) {
-    _impl = std::make_unique<Impl>(deflateBits, inflateBits, memLevel);
+void ZlibContext::initialise(int deflateBits, int inflateBits, int memLevel,
+                             bool deflateNoContextTakeover, bool inflateNoContextTakeover) {
+    _impl = std::make_unique<Impl>(deflateBits, inflateBits, memLevel,
+                                   deflateNoContextTakeover, inflateNoContextTakeover);
+}
+
+void ZlibContext::setCompression(int level, CompressionPolicy::Strategy strategy) {
+    _impl->setCompression(level, strategy);
+}
+
+void ZlibContext::setDictionary(const uint8_t* dictionary, size_t length) {
+    _impl->setDictionary(dictionary, length);
 }
 
 void ZlibContext::deflate(const uint8_t* input, size_t inputLen, std::vector<uint8_t>& output) {
     return _impl->deflate(input, inputLen, output);
 }
 
-bool ZlibContext::inflate(std::vector<uint8_t>& input, std::vector<uint8_t>& output, int& zlibError) {
-    return _impl->inflate(input, output, zlibError);
+bool ZlibContext::inflate(std::vector<uint8_t>& input, std::vector<uint8_t>& output, int& zlibError,
+                          size_t maxOutputSize) {
+    return _impl->inflate(input, output, zlibError, maxOutputSize);
+}
+
+size_t ZlibContext::memoryUsage() const {
+    return _impl ? _impl->bytesAllocated : 0;
 }
 
 }
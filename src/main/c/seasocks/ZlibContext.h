@@ -1,5 +1,7 @@
 #pragma once
 
+#include "seasocks/PerMessageDeflate.h"
+
 #include <cstdint>
 #include <cstdlib>
 #include <memory>
@@ -14,12 +16,31 @@ public:
 
     ZlibContext();
     ~ZlibContext();
-    void initialise(int deflateBits = 15, int inflateBits = 15, int memLevel = 6);
+    // deflateBits and inflateBits are the log2 window sizes for each direction.
+    // If a *NoContextTakeover flag is set, the relevant stream is reset after
+    // every message as per RFC 7692 section 7.1.1.
+    void initialise(int deflateBits = 15, int inflateBits = 15, int memLevel = 6,
+                    bool deflateNoContextTakeover = false, bool inflateNoContextTakeover = false);
+
+    // Sets the compression level and strategy. Must be called after initialise().
+    void setCompression(int level, CompressionPolicy::Strategy strategy);
+
+    // Primes both directions with a preset dictionary, which the other end must
+    // use too. It's reapplied whenever a stream is reset, so it keeps helping
+    // without context takeover. Must be called after initialise() and before
+    // any data is compressed or decompressed.
+    void setDictionary(const uint8_t* dictionary, size_t length);
 
     void deflate(const uint8_t* input, size_t inputLen, std::vector<uint8_t>& output);
 
     // WARNING: inflate() alters input
-    bool inflate(std::vector<uint8_t>& input, std::vector<uint8_t>& output, int& zlibError);
+    // Fails with zlibError zero (Z_OK) if the output would grow past
+    // maxOutputSize.
+    bool inflate(std::vector<uint8_t>& input, std::vector<uint8_t>& output, int& zlibError,
+                 size_t maxOutputSize = SIZE_MAX);
+
+    // Bytes currently allocated by zlib on behalf of this context.
+    size_t memoryUsage() const;
 
 private:
     struct Impl;
@@ -38,7 +38,15 @@ ZlibContext::ZlibContext() {
 ZlibContext::~ZlibContext() {
 }
 
-void ZlibContext::initialise(int, int, int) {
+void ZlibContext::initialise(int, int, int, bool, bool) {
+    throw std::runtime_error("Not compiled with zlib support");
+}
+
+void ZlibContext::setCompression(int, CompressionPolicy::Strategy) {
+    throw std::runtime_error("Not compiled with zlib support");
+}
+
+void ZlibContext::setDictionary(const uint8_t*, size_t) {
     throw std::runtime_error("Not compiled with zlib support");
 }
 
@@ -46,8 +54,12 @@ void ZlibContext::deflate(const uint8_t*, size_t, std::vector<uint8_t>&) {
     throw std::runtime_error("Not compiled with zlib support");
 }
 
-bool ZlibContext::inflate(std::vector<uint8_t>&, std::vector<uint8_t>&, int&) {
+bool ZlibContext::inflate(std::vector<uint8_t>&, std::vector<uint8_t>&, int&, size_t) {
     throw std::runtime_error("Not compiled with zlib support");
 }
 
+size_t ZlibContext::memoryUsage() const {
+    return 0;
+}
+
 }
\ No newline at end of file
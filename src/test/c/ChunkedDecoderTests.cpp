@@ -0,0 +1,113 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/ChunkedDecoder.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+
+using namespace seasocks;
+
+namespace {
+
+struct Decoded {
+    ChunkedDecoder::Result result;
+    std::string body;
+    size_t consumed;
+};
+
+// Feeds input to the decoder in pieces of at most step bytes, carrying any
+// unconsumed input over as a Connection's input buffer would.
+Decoded decode(const std::string& input, size_t step = 0) {
+    ChunkedDecoder decoder;
+    std::vector<uint8_t> buffer;
+    std::string body;
+    size_t fed = 0;
+    size_t totalConsumed = 0;
+    auto result = ChunkedDecoder::Result::NeedMore;
+    while (result == ChunkedDecoder::Result::NeedMore && fed < input.size()) {
+        auto count = step ? std::min(step, input.size() - fed) : input.size();
+        buffer.insert(buffer.end(), input.begin() + static_cast<ptrdiff_t>(fed),
+                      input.begin() + static_cast<ptrdiff_t>(fed + count));
+        fed += count;
+        size_t consumed = 0;
+        size_t decoded = 0;
+        result = decoder.decode(buffer.data(), buffer.size(), consumed, decoded);
+        body.append(buffer.begin(), buffer.begin() + static_cast<ptrdiff_t>(decoded));
+        buffer.erase(buffer.begin(), buffer.begin() + static_cast<ptrdiff_t>(consumed));
+        totalConsumed += consumed;
+    }
+    return {result, body, totalConsumed};
+}
+
+const std::string wikipedia = "4\r\nWiki\r\n7\r\npedia i\r\nB\r\nn \r\nchunks.\r\n0\r\n\r\n";
+
+}
+
+TEST_CASE("decodes chunks", "[ChunkedDecoderTests]") {
+    auto decoded = decode(wikipedia);
+    CHECK(decoded.result == ChunkedDecoder::Result::Done);
+    CHECK(decoded.body == "Wikipedia in \r\nchunks.");
+    CHECK(decoded.consumed == wikipedia.size());
+}
+
+TEST_CASE("decodes input arriving a byte at a time", "[ChunkedDecoderTests]") {
+    for (size_t step : {1, 2, 3, 5, 8}) {
+        CAPTURE(step);
+        auto decoded = decode(wikipedia, step);
+        CHECK(decoded.result == ChunkedDecoder::Result::Done);
+        CHECK(decoded.body == "Wikipedia in \r\nchunks.");
+    }
+}
+
+TEST_CASE("stops at the end of the body", "[ChunkedDecoderTests]") {
+    auto decoded = decode("3\r\nabc\r\n0\r\n\r\nGET / HTTP/1.1\r\n");
+    CHECK(decoded.result == ChunkedDecoder::Result::Done);
+    CHECK(decoded.body == "abc");
+    CHECK(decoded.consumed == 13);
+}
+
+TEST_CASE("skips extensions and trailers", "[ChunkedDecoderTests]") {
+    auto decoded = decode("3;name=value\r\nabc\r\n0\r\nExpires: never\r\nX-Other: 1\r\n\r\n");
+    CHECK(decoded.result == ChunkedDecoder::Result::Done);
+    CHECK(decoded.body == "abc");
+}
+
+TEST_CASE("waits for the rest of the body", "[ChunkedDecoderTests]") {
+    auto decoded = decode("a\r\n01234");
+    CHECK(decoded.result == ChunkedDecoder::Result::NeedMore);
+    CHECK(decoded.body == "01234");
+    CHECK(decode("0\r\n\r").result == ChunkedDecoder::Result::NeedMore);
+}
+
+TEST_CASE("rejects malformed chunks", "[ChunkedDecoderTests]") {
+    CHECK(decode("x\r\n").result == ChunkedDecoder::Result::Error);
+    CHECK(decode("\r\n").result == ChunkedDecoder::Result::Error);
+    CHECK(decode("3\r\nabcd\r\n").result == ChunkedDecoder::Result::Error);
+    CHECK(decode("3\nabc\r\n").result == ChunkedDecoder::Result::Error);
+    CHECK(decode("fffffffffffffffff\r\n").result == ChunkedDecoder::Result::Error);
+}
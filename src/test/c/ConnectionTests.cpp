@@ -23,19 +23,204 @@
 // ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
 // POSSIBILITY OF SUCH DAMAGE.
 
+#include "AllocationCounter.h"
 #include "MockServerImpl.h"
+#include "internal/Config.h"
+#include "internal/HybiAccept.h"
+#include "internal/HybiPacketDecoder.h"
+#include "internal/StaticFileCache.h"
 #include "seasocks/Connection.h"
 #include "seasocks/IgnoringLogger.h"
+#include "seasocks/Request.h"
+#include "seasocks/RequestBodyHandler.h"
+#include "seasocks/Response.h"
+#include "seasocks/ResponseWriter.h"
+#include "seasocks/Server.h"
+#include "seasocks/ZlibContext.h"
 
 #include <catch2/catch_test_macros.hpp>
 
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <thread>
 #include <sstream>
 #include <cstring>
 #include <string>
+#include <vector>
 
 using namespace seasocks;
 
+namespace {
+
+sockaddr_in testAddress() {
+    sockaddr_in addr;
+    addr.sin_family = AF_INET;
+    addr.sin_port = 0x1234;
+    addr.sin_addr.s_addr = 0x01020304;
+    return addr;
+}
+
+#ifndef _WIN32
+// A connected pair of sockets: the Connection under test owns one end (and closes
+// it), and the test plays the part of the client on the other.
+struct SocketPair {
+    int server = -1;
+    int client = -1;
+    SocketPair() {
+        int fds[2];
+        REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        server = fds[0];
+        client = fds[1];
+    }
+    ~SocketPair() {
+        ::close(client);
+    }
+    void clientSend(const std::string& data) const {
+        REQUIRE(::send(client, data.data(), data.size(), 0) == static_cast<ssize_t>(data.size()));
+    }
+    void clientSend(const std::vector<uint8_t>& data) const {
+        REQUIRE(::send(client, data.data(), data.size(), 0) == static_cast<ssize_t>(data.size()));
+    }
+    std::vector<uint8_t> clientReceive() const {
+        std::vector<uint8_t> result;
+        uint8_t buf[16384];
+        ssize_t numRead;
+        while ((numRead = ::recv(client, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+            result.insert(result.end(), buf, buf + numRead);
+        }
+        return result;
+    }
+};
+
+struct Frame {
+    uint8_t firstByte;
+    std::vector<uint8_t> payload;
+    uint8_t opcode() const {
+        return firstByte & 0xf;
+    }
+    bool compressed() const {
+        return firstByte & 0x40;
+    }
+    std::string text() const {
+        return std::string(payload.begin(), payload.end());
+    }
+};
+
+// Splits the (unmasked) server to client stream into frames, skipping over the
+// HTTP upgrade response if present.
+std::vector<Frame> parseFrames(const std::vector<uint8_t>& data) {
+    size_t pos = 0;
+    static const std::string endOfHeaders = "\r\n\r\n";
+    auto headerEnd = std::search(data.begin(), data.end(), endOfHeaders.begin(), endOfHeaders.end());
+    if (data.size() > 4 && memcmp(data.data(), "HTTP", 4) == 0 && headerEnd != data.end()) {
+        pos = static_cast<size_t>(headerEnd - data.begin()) + endOfHeaders.size();
+    }
+    std::vector<Frame> frames;
+    while (pos + 2 <= data.size()) {
+        Frame frame;
+        frame.firstByte = data[pos];
+        uint64_t length = data[pos + 1] & 0x7f;
+        pos += 2;
+        if (length == 126) {
+            length = (uint64_t(data[pos]) << 8) | data[pos + 1];
+            pos += 2;
+        } else if (length == 127) {
+            length = 0;
+            for (int i = 0; i < 8; ++i) {
+                length = (length << 8) | data[pos + i];
+            }
+            pos += 8;
+        }
+        REQUIRE(pos + length <= data.size());
+        frame.payload.assign(data.begin() + pos, data.begin() + pos + length);
+        pos += length;
+        frames.push_back(frame);
+    }
+    return frames;
+}
+
+// Builds a masked client to server frame.
+std::vector<uint8_t> clientFrame(uint8_t firstByte, const std::string& payload) {
+    const uint8_t mask[4] = {0x12, 0x34, 0x56, 0x78};
+    std::vector<uint8_t> frame{firstByte};
+    if (payload.size() < 126) {
+        frame.push_back(static_cast<uint8_t>(0x80 | payload.size()));
+    } else {
+        frame.push_back(0x80 | 126);
+        frame.push_back(static_cast<uint8_t>(payload.size() >> 8));
+        frame.push_back(static_cast<uint8_t>(payload.size() & 0xff));
+    }
+    frame.insert(frame.end(), mask, mask + 4);
+    for (size_t i = 0; i < payload.size(); ++i) {
+        frame.push_back(static_cast<uint8_t>(payload[i] ^ mask[i % 4]));
+    }
+    return frame;
+}
+
+std::string upgradeRequest(const std::string& extensions = "") {
+    std::string request = "GET /ws HTTP/1.1\r\n"
+                          "Host: localhost\r\n"
+                          "Connection: Upgrade\r\n"
+                          "Upgrade: websocket\r\n"
+                          "Sec-WebSocket-Version: 13\r\n"
+                          "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n";
+    if (!extensions.empty()) {
+        request += "Sec-WebSocket-Extensions: " + extensions + "\r\n";
+    }
+    return request + "\r\n";
+}
+
+// A Connection that has completed a WebSocket handshake over a SocketPair.
+struct TestWebSocket {
+    SocketPair sockets;
+    Connection connection;
+    TestWebSocket(std::shared_ptr<Logger> logger, MockServerImpl& server, const std::string& extensions = "")
+            : connection(logger, server, sockets.server, testAddress()) {
+        sockets.clientSend(upgradeRequest(extensions));
+        connection.handleDataReadyForRead();
+        auto response = sockets.clientReceive();
+        REQUIRE(std::string(response.begin(), response.end()).find("101") != std::string::npos);
+    }
+    std::vector<Frame> receiveFrames() {
+        return parseFrames(sockets.clientReceive());
+    }
+};
+
+struct RecordingHandler : WebSocket::Handler {
+    std::vector<std::string> messages;
+    int connects = 0;
+    int disconnects = 0;
+    void onConnect(WebSocket*) override {
+        ++connects;
+    }
+    void onData(WebSocket*, const char* data) override {
+        messages.emplace_back(data);
+    }
+    WebSocket::CloseCode closeCode = WebSocket::CloseCode::Normal;
+    std::string closeReason;
+    void onDisconnect(WebSocket*) override {
+        ++disconnects;
+    }
+    void onDisconnect(WebSocket* connection, WebSocket::CloseCode code, const std::string& reason) override {
+        closeCode = code;
+        closeReason = reason;
+        onDisconnect(connection);
+    }
+};
+#endif
+
+}
+
 class TestHandler : public WebSocket::Handler {
 public:
     int _stage;
@@ -64,10 +249,7 @@ public:
 };
 
 TEST_CASE("Connection tests", "[ConnectionTests]") {
-    sockaddr_in addr;
-    addr.sin_family = AF_INET;
-    addr.sin_port = 0x1234;
-    addr.sin_addr.s_addr = 0x01020304;
+    auto addr = testAddress();
     auto logger = std::make_shared<IgnoringLogger>();
     MockServerImpl mockServer;
     Connection connection(logger, mockServer, InvalidSocket, addr);
@@ -85,3 +267,1523 @@ TEST_CASE("Connection tests", "[ConnectionTests]") {
         connection.handleNewData();
     }
 }
+
+#ifndef _WIN32
+TEST_CASE("Compression policy", "[ConnectionTests]") {
+    if (!Config::deflateEnabled) {
+        return;
+    }
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    server.setPerMessageDeflateEnabled(true);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    auto handler = std::make_shared<RecordingHandler>();
+    mockServer.handlers["/ws"] = handler;
+    mockServer.compressionPolicy.minimumSize = 64;
+    mockServer.compressionPolicy.skipCompressedContent = true;
+    TestWebSocket webSocket(logger, mockServer, "permessage-deflate; server_no_context_takeover");
+    REQUIRE(handler->connects == 1);
+    auto& connection = webSocket.connection;
+    auto& sockets = webSocket.sockets;
+
+    ZlibContext client;
+    client.initialise(15, 15, 6, false, true);
+
+    SECTION("small messages are sent raw") {
+        connection.send("ping");
+        auto frames = parseFrames(sockets.clientReceive());
+        REQUIRE(frames.size() == 1);
+        CHECK_FALSE(frames[0].compressed());
+        CHECK(frames[0].text() == "ping");
+        CHECK(connection.compressionStats().messagesUncompressed == 1);
+    }
+    SECTION("large messages are compressed") {
+        std::string message(1000, 'x');
+        connection.send(message.c_str());
+        auto frames = parseFrames(sockets.clientReceive());
+        REQUIRE(frames.size() == 1);
+        CHECK(frames[0].compressed());
+        CHECK(frames[0].payload.size() < message.size());
+        const auto& stats = connection.compressionStats();
+        CHECK(stats.messagesCompressed == 1);
+        CHECK(stats.bytesBeforeCompression == message.size());
+        CHECK(stats.bytesAfterCompression == frames[0].payload.size());
+        std::vector<uint8_t> decompressed;
+        int zlibError = 0;
+        REQUIRE(client.inflate(frames[0].payload, decompressed, zlibError));
+        CHECK(std::string(decompressed.begin(), decompressed.end()) == message);
+    }
+    SECTION("incompressible messages are sent raw without context takeover") {
+        std::vector<uint8_t> noise;
+        uint32_t seed = 12345;
+        for (int i = 0; i < 200; ++i) {
+            seed = seed * 1103515245 + 12345;
+            noise.push_back(static_cast<uint8_t>(seed >> 16));
+        }
+        connection.send(noise.data(), noise.size());
+        auto frames = parseFrames(sockets.clientReceive());
+        REQUIRE(frames.size() == 1);
+        CHECK_FALSE(frames[0].compressed());
+        CHECK(frames[0].payload == noise);
+    }
+    SECTION("already compressed content is sent raw when sniffing") {
+        std::vector<uint8_t> gzipped(200, 0);
+        gzipped[0] = 0x1f;
+        gzipped[1] = 0x8b;
+        connection.send(gzipped.data(), gzipped.size());
+        auto frames = parseFrames(sockets.clientReceive());
+        REQUIRE(frames.size() == 1);
+        CHECK_FALSE(frames[0].compressed());
+    }
+    SECTION("pongs are never compressed") {
+        connection.send(std::string(1000, 'y').c_str());
+        sockets.clientReceive();
+        sockets.clientSend(clientFrame(0x89, std::string(200, 'z')));
+        connection.handleDataReadyForRead();
+        auto frames = parseFrames(sockets.clientReceive());
+        REQUIRE(frames.size() == 1);
+        CHECK(frames[0].opcode() == 0xa);
+        CHECK_FALSE(frames[0].compressed());
+    }
+}
+#endif
+
+#ifndef _WIN32
+TEST_CASE("Broadcast compresses once for no context takeover connections", "[ConnectionTests]") {
+    if (!Config::deflateEnabled) {
+        return;
+    }
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    server.setPerMessageDeflateEnabled(true);
+    // Make this thread the server thread.
+    REQUIRE(server.startListening(0));
+    REQUIRE(server.poll(0) == Server::PollResult::Continue);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    mockServer.handlers["/ws"] = std::make_shared<RecordingHandler>();
+
+    TestWebSocket shared1(logger, mockServer, "permessage-deflate; server_no_context_takeover");
+    TestWebSocket shared2(logger, mockServer, "permessage-deflate; server_no_context_takeover");
+    TestWebSocket contextTakeover(logger, mockServer, "permessage-deflate");
+    TestWebSocket raw(logger, mockServer);
+    std::vector<WebSocket*> sockets{&shared1.connection, &shared2.connection,
+                                    &contextTakeover.connection, &raw.connection};
+
+    std::string message;
+    for (int i = 0; i < 50; ++i) {
+        message += R"({"instrument":"ABC","price":)" + std::to_string(i) + "}";
+    }
+    for (int i = 0; i < 2; ++i) {
+        server.broadcast(sockets, message);
+        auto frames1 = shared1.receiveFrames();
+        auto frames2 = shared2.receiveFrames();
+        auto frames3 = contextTakeover.receiveFrames();
+        auto frames4 = raw.receiveFrames();
+        REQUIRE(frames1.size() == 1);
+        REQUIRE(frames2.size() == 1);
+        REQUIRE(frames3.size() == 1);
+        REQUIRE(frames4.size() == 1);
+        CHECK(frames1[0].compressed());
+        CHECK(frames1[0].payload == frames2[0].payload);
+        CHECK(frames3[0].compressed());
+        CHECK_FALSE(frames4[0].compressed());
+        CHECK(frames4[0].text() == message);
+
+        // Each shared frame must stand on its own.
+        ZlibContext client;
+        client.initialise();
+        std::vector<uint8_t> decompressed;
+        int zlibError = 0;
+        REQUIRE(client.inflate(frames1[0].payload, decompressed, zlibError));
+        CHECK(std::string(decompressed.begin(), decompressed.end()) == message);
+    }
+    CHECK(shared1.connection.compressionStats().messagesCompressed == 2);
+}
+#endif
+
+#ifndef _WIN32
+TEST_CASE("Broadcast and publish send text of the given length", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    // Make this thread the server thread.
+    REQUIRE(server.startListening(0));
+    REQUIRE(server.poll(0) == Server::PollResult::Continue);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    mockServer.handlers["/ws"] = std::make_shared<RecordingHandler>();
+    TestWebSocket webSocket(logger, mockServer);
+    std::vector<WebSocket*> sockets{&webSocket.connection};
+
+    const std::string text("one\0two", 7);
+    server.broadcast(sockets, std::string_view(text).substr(0, 5));
+    server.broadcast(sockets, text);
+    server.publish("news", text, true);
+    REQUIRE(server.subscribe(&webSocket.connection, "news"));
+    auto frames = webSocket.receiveFrames();
+    REQUIRE(frames.size() == 3);
+    CHECK(frames[0].text() == text.substr(0, 5));
+    CHECK(frames[1].text() == text);
+    CHECK(frames[2].text() == text);
+    server.unsubscribe(&webSocket.connection, "news");
+}
+#endif
+
+#ifndef _WIN32
+TEST_CASE("Keepalive pings measure round trip time", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    auto handler = std::make_shared<RecordingHandler>();
+    mockServer.handlers["/ws"] = handler;
+    TestWebSocket webSocket(logger, mockServer);
+    auto& connection = webSocket.connection;
+    const std::chrono::seconds interval(5);
+    const std::chrono::seconds timeout(10);
+
+    CHECK(connection.checkKeepAlive(std::chrono::steady_clock::now(), interval, timeout));
+    CHECK(webSocket.receiveFrames().empty());
+
+    // Use a zero interval to ping straight away, so the measured RTT is real.
+    auto pingTime = std::chrono::steady_clock::now();
+    CHECK(connection.checkKeepAlive(pingTime, std::chrono::seconds(0), timeout));
+    auto frames = webSocket.receiveFrames();
+    REQUIRE(frames.size() == 1);
+    CHECK(frames[0].opcode() == 0x9);
+    // Only one ping is outstanding at a time.
+    CHECK(connection.checkKeepAlive(pingTime + interval, interval, timeout));
+    CHECK(webSocket.receiveFrames().empty());
+
+    SECTION("a matching pong records the round trip time") {
+        webSocket.sockets.clientSend(clientFrame(0x8a, "unsolicited"));
+        connection.handleDataReadyForRead();
+        CHECK(connection.lastRoundTripTime().count() == 0);
+
+        webSocket.sockets.clientSend(clientFrame(0x8a, frames[0].text()));
+        connection.handleDataReadyForRead();
+        CHECK(connection.lastRoundTripTime() > std::chrono::microseconds(0));
+        CHECK(connection.averageRoundTripTime() == connection.lastRoundTripTime());
+        CHECK(connection.checkKeepAlive(pingTime + timeout, interval, timeout));
+        CHECK(webSocket.receiveFrames().size() == 1);
+    }
+    SECTION("an unanswered ping times out") {
+        CHECK_FALSE(connection.checkKeepAlive(pingTime + timeout, interval, timeout));
+    }
+}
+#endif
+
+#ifndef _WIN32
+TEST_CASE("Closing handshake", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    auto handler = std::make_shared<RecordingHandler>();
+    mockServer.handlers["/ws"] = handler;
+    auto webSocket = std::make_unique<TestWebSocket>(logger, mockServer);
+    auto& connection = webSocket->connection;
+    auto& sockets = webSocket->sockets;
+    const std::chrono::seconds timeout(5);
+
+    SECTION("server close drains queued data then sends a Close frame") {
+        connection.send("queued");
+        connection.close(WebSocket::CloseCode::GoingAway, "bye");
+        connection.send("dropped");
+        auto frames = webSocket->receiveFrames();
+        REQUIRE(frames.size() == 2);
+        CHECK(frames[0].text() == "queued");
+        CHECK(frames[1].opcode() == 0x8);
+        CHECK(frames[1].text() == std::string("\x03\xe9" "bye"));
+        auto now = std::chrono::steady_clock::now();
+        CHECK(connection.closeHandshakeExpired(now + timeout, timeout));
+
+        sockets.clientSend(clientFrame(0x88, std::string("\x03\xe9", 2)));
+        connection.handleDataReadyForRead();
+        CHECK(webSocket->receiveFrames().empty());
+        CHECK_FALSE(connection.closeHandshakeExpired(now + timeout, timeout));
+        webSocket.reset();
+        CHECK(handler->disconnects == 1);
+        CHECK(handler->closeCode == WebSocket::CloseCode::GoingAway);
+        CHECK(handler->closeReason == "bye");
+    }
+    SECTION("long reasons are truncated to fit a control frame") {
+        connection.close(WebSocket::CloseCode::Normal, std::string(200, 'x'));
+        auto frames = webSocket->receiveFrames();
+        REQUIRE(frames.size() == 1);
+        CHECK(frames[0].payload.size() == 125);
+    }
+    SECTION("client Close frames are echoed") {
+        sockets.clientSend(clientFrame(0x81, "hello"));
+        sockets.clientSend(clientFrame(0x88, std::string("\x03\xe8", 2) + "done"));
+        connection.handleDataReadyForRead();
+        auto frames = webSocket->receiveFrames();
+        REQUIRE(frames.size() == 1);
+        CHECK(frames[0].opcode() == 0x8);
+        CHECK(frames[0].text() == std::string("\x03\xe8", 2));
+        webSocket.reset();
+        REQUIRE(handler->messages.size() == 1);
+        CHECK(handler->messages[0] == "hello");
+        CHECK(handler->closeCode == WebSocket::CloseCode::Normal);
+        CHECK(handler->closeReason == "done");
+    }
+    SECTION("Close frames with reserved codes are a protocol error") {
+        sockets.clientSend(clientFrame(0x88, std::string("\x03\xee", 2)));
+        connection.handleDataReadyForRead();
+        auto frames = webSocket->receiveFrames();
+        REQUIRE(frames.size() == 1);
+        CHECK(frames[0].text() == std::string("\x03\xea", 2));
+        webSocket.reset();
+        CHECK(handler->closeCode == WebSocket::CloseCode::ProtocolError);
+    }
+    SECTION("Close frames with registered codes are echoed") {
+        sockets.clientSend(clientFrame(0x88, std::string("\x03\xf5", 2)));
+        connection.handleDataReadyForRead();
+        auto frames = webSocket->receiveFrames();
+        REQUIRE(frames.size() == 1);
+        CHECK(frames[0].text() == std::string("\x03\xf5", 2));
+        webSocket.reset();
+        CHECK(handler->closeCode == WebSocket::CloseCode::TryAgainLater);
+    }
+    SECTION("1015 is never valid on the wire") {
+        sockets.clientSend(clientFrame(0x88, std::string("\x03\xf7", 2)));
+        connection.handleDataReadyForRead();
+        auto frames = webSocket->receiveFrames();
+        REQUIRE(frames.size() == 1);
+        CHECK(frames[0].text() == std::string("\x03\xea", 2));
+    }
+    SECTION("dropped connections are reported as abnormal") {
+        ::shutdown(sockets.client, SHUT_RDWR);
+        connection.handleDataReadyForRead();
+        webSocket.reset();
+        CHECK(handler->disconnects == 1);
+        CHECK(handler->closeCode == WebSocket::CloseCode::Abnormal);
+    }
+}
+#endif
+
+#ifndef _WIN32
+TEST_CASE("Invalid UTF-8 text closes with 1007", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    auto handler = std::make_shared<RecordingHandler>();
+    mockServer.handlers["/ws"] = handler;
+
+    SECTION("when validation is enabled") {
+        server.setUtf8ValidationEnabled(true);
+        TestWebSocket webSocket(logger, mockServer);
+        webSocket.sockets.clientSend(clientFrame(0x81, "caf\xc3\xa9"));
+        webSocket.sockets.clientSend(clientFrame(0x81, "caf\xc3"));
+        webSocket.connection.handleDataReadyForRead();
+        auto frames = webSocket.receiveFrames();
+        REQUIRE(frames.size() == 1);
+        CHECK(frames[0].opcode() == 0x8);
+        CHECK(frames[0].text().substr(0, 2) == std::string("\x03\xef", 2));
+        REQUIRE(handler->messages.size() == 1);
+        CHECK(handler->messages[0] == "caf\xc3\xa9");
+    }
+    SECTION("but not by default") {
+        TestWebSocket webSocket(logger, mockServer);
+        webSocket.sockets.clientSend(clientFrame(0x81, "caf\xc3"));
+        webSocket.connection.handleDataReadyForRead();
+        CHECK(webSocket.receiveFrames().empty());
+        CHECK(handler->messages.size() == 1);
+    }
+}
+#endif
+
+#ifndef _WIN32
+TEST_CASE("Messages inflating past the buffer size close with 1009", "[ConnectionTests]") {
+    if (!Config::deflateEnabled) {
+        return;
+    }
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    server.setPerMessageDeflateEnabled(true);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    auto handler = std::make_shared<RecordingHandler>();
+    mockServer.handlers["/ws"] = handler;
+    TestWebSocket webSocket(logger, mockServer, "permessage-deflate");
+
+    // A tiny frame that would inflate to twice the mock's buffer size.
+    const std::vector<uint8_t> message(2 * mockServer.clientBufferSize(), 'x');
+    ZlibContext client;
+    client.initialise();
+    std::vector<uint8_t> compressed;
+    client.deflate(message.data(), message.size(), compressed);
+    webSocket.sockets.clientSend(clientFrame(0xc1, std::string(compressed.begin(), compressed.end())));
+    webSocket.connection.handleDataReadyForRead();
+    auto frames = webSocket.receiveFrames();
+    REQUIRE(frames.size() == 1);
+    CHECK(frames[0].opcode() == 0x8);
+    CHECK(frames[0].text().substr(0, 2) == std::string("\x03\xf1", 2));
+    CHECK(handler->messages.empty());
+}
+#endif
+
+#ifndef _WIN32
+TEST_CASE("Publishing to topics", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    // Make this thread the server thread.
+    REQUIRE(server.startListening(0));
+    REQUIRE(server.poll(0) == Server::PollResult::Continue);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    mockServer.handlers["/ws"] = std::make_shared<RecordingHandler>();
+    TestWebSocket first(logger, mockServer);
+    TestWebSocket second(logger, mockServer);
+
+    CHECK(server.subscribe(&first.connection, "prices"));
+    CHECK_FALSE(server.subscribe(&first.connection, "prices"));
+    CHECK(server.subscribe(&second.connection, "news"));
+    CHECK(server.numSubscribers("prices") == 1);
+
+    server.publish("prices", "ABC 100");
+    server.publish("nobody", "dropped");
+    auto frames = first.receiveFrames();
+    REQUIRE(frames.size() == 1);
+    CHECK(frames[0].text() == "ABC 100");
+    CHECK(second.receiveFrames().empty());
+
+    server.publish("prices", "ABC 101", true);
+    CHECK(first.receiveFrames().size() == 1);
+    CHECK(server.subscribe(&second.connection, "prices"));
+    frames = second.receiveFrames();
+    REQUIRE(frames.size() == 1);
+    CHECK(frames[0].text() == "ABC 101");
+
+    const uint8_t binary[] = {1, 2, 3};
+    server.publish("news", binary, sizeof(binary));
+    frames = second.receiveFrames();
+    REQUIRE(frames.size() == 1);
+    CHECK(frames[0].opcode() == 0x2);
+
+    CHECK(server.unsubscribe(&first.connection, "prices"));
+    server.publish("prices", "ABC 102");
+    CHECK(first.receiveFrames().empty());
+    CHECK(second.receiveFrames().size() == 1);
+    CHECK(server.numSubscribers("prices") == 1);
+}
+#endif
+
+#ifndef _WIN32
+TEST_CASE("Conflating messages for slow clients", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    mockServer.handlers["/ws"] = std::make_shared<RecordingHandler>();
+    TestWebSocket webSocket(logger, mockServer);
+    auto& connection = webSocket.connection;
+    auto& sockets = webSocket.sockets;
+
+    // Sent straight away while the client keeps up.
+    connection.sendConflated("A", "0");
+    auto frames = webSocket.receiveFrames();
+    REQUIRE(frames.size() == 1);
+    CHECK(frames[0].text() == "0");
+
+    // Back the connection up with a message too big for the socket buffers.
+    int small = 4096;
+    REQUIRE(::setsockopt(sockets.server, SOL_SOCKET, SO_SNDBUF, &small, sizeof(small)) == 0);
+    REQUIRE(::setsockopt(sockets.client, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small)) == 0);
+    REQUIRE(::fcntl(sockets.server, F_SETFL, O_NONBLOCK) == 0);
+    std::vector<uint8_t> big(256 * 1024, 'x');
+    connection.send(big.data(), big.size());
+    REQUIRE(connection.outputBufferSize() > 0);
+
+    connection.sendConflated("A", "1");
+    connection.sendConflated("B", "1");
+    connection.sendConflated("A", "2");
+    connection.send("unkeyed");
+    connection.sendConflated("A", "3");
+    CHECK(connection.queuedMessageCount() == 3);
+    CHECK(connection.messagesConflated() == 2);
+
+    auto drain = [&] {
+        std::vector<uint8_t> received;
+        for (int i = 0; i < 10000 && (connection.outputBufferSize() > 0 || connection.queuedMessageCount() > 0); ++i) {
+            auto data = sockets.clientReceive();
+            received.insert(received.end(), data.begin(), data.end());
+            connection.handleDataReadyForWrite();
+        }
+        auto data = sockets.clientReceive();
+        received.insert(received.end(), data.begin(), data.end());
+        return parseFrames(received);
+    };
+
+    SECTION("the latest value for each key is delivered in order") {
+        frames = drain();
+        REQUIRE(frames.size() == 4);
+        CHECK(frames[0].payload.size() == big.size());
+        CHECK(frames[1].text() == "3");
+        CHECK(frames[2].text() == "1");
+        CHECK(frames[3].text() == "unkeyed");
+        CHECK(connection.queuedMessageCount() == 0);
+    }
+    SECTION("queued messages go out before a Close frame") {
+        connection.close(WebSocket::CloseCode::Normal, "");
+        CHECK(connection.queuedMessageCount() == 0);
+        frames = drain();
+        REQUIRE(frames.size() == 5);
+        CHECK(frames[3].text() == "unkeyed");
+        CHECK(frames[4].opcode() == 0x8);
+    }
+}
+#endif
+
+#ifndef _WIN32
+TEST_CASE("Sending doesn't allocate once warmed up", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    server.setPerMessageDeflateEnabled(true);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    mockServer.handlers["/ws"] = std::make_shared<RecordingHandler>();
+    std::string message;
+    for (int i = 0; i < 20; ++i) {
+        message += R"({"instrument":"ABC","price":)" + std::to_string(i) + "}";
+    }
+    const uint8_t binary[] = {1, 2, 3, 4};
+
+    auto check = [&](const std::string& extensions) {
+        TestWebSocket webSocket(logger, mockServer, extensions);
+        auto& connection = webSocket.connection;
+        size_t allocations = 0;
+        for (int i = 0; i < 10; ++i) {
+            auto before = allocationCount();
+            connection.send(std::string_view(message));
+            connection.send(message.c_str());
+            connection.send(binary, sizeof(binary));
+            auto after = allocationCount();
+            webSocket.sockets.clientReceive();
+            // The first few messages size the buffers.
+            if (i >= 3) {
+                allocations += after - before;
+            }
+        }
+        CHECK(allocations == 0);
+    };
+
+    SECTION("raw") {
+        check("");
+    }
+    if (Config::deflateEnabled) {
+        SECTION("compressed") {
+            check("permessage-deflate");
+        }
+        SECTION("compressed without context takeover") {
+            check("permessage-deflate; server_no_context_takeover");
+        }
+    }
+}
+#endif
+
+#ifndef _WIN32
+TEST_CASE("Client mode", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    auto handler = std::make_shared<RecordingHandler>();
+    SocketPair sockets;
+    auto connection = std::make_unique<Connection>(logger, mockServer, sockets.server, testAddress());
+    connection->startClientHandshake("example.com:80", "/feed", handler);
+    CHECK(connection->isClient());
+
+    auto requestData = sockets.clientReceive();
+    std::string request(requestData.begin(), requestData.end());
+    CHECK(request.find("GET /feed HTTP/1.1\r\n") == 0);
+    CHECK(request.find("Host: example.com:80\r\n") != std::string::npos);
+    CHECK(request.find("Sec-WebSocket-Version: 13\r\n") != std::string::npos);
+    static const std::string keyHeader = "Sec-WebSocket-Key: ";
+    auto keyPos = request.find(keyHeader);
+    REQUIRE(keyPos != std::string::npos);
+    keyPos += keyHeader.size();
+    auto key = request.substr(keyPos, request.find("\r\n", keyPos) - keyPos);
+
+    auto respond = [&](const std::string& acceptKey) {
+        sockets.clientSend("HTTP/1.1 101 Switching Protocols\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Sec-WebSocket-Accept: " +
+                           acceptKey + "\r\n\r\n");
+        connection->handleDataReadyForRead();
+    };
+
+    SECTION("a good handshake connects") {
+        respond(getAcceptKey(key));
+        REQUIRE(handler->connects == 1);
+        CHECK(connection->getRequestUri() == "/feed");
+
+        connection->send("hello");
+        auto sent = sockets.clientReceive();
+        REQUIRE(sent.size() >= 2);
+        CHECK((sent[1] & 0x80) != 0);
+        HybiPacketDecoder decoder(*logger, sent);
+        std::vector<uint8_t> decoded;
+        CHECK(decoder.decodeNextMessage(decoded) == HybiPacketDecoder::MessageState::TextMessage);
+        CHECK(std::string(decoded.begin(), decoded.end()) == "hello");
+
+        // Servers don't mask.
+        sockets.clientSend(std::string("\x81\x05world"));
+        connection->handleDataReadyForRead();
+        REQUIRE(handler->messages.size() == 1);
+        CHECK(handler->messages[0] == "world");
+    }
+    SECTION("a bad accept key is refused") {
+        respond(getAcceptKey("something else"));
+        CHECK(handler->connects == 0);
+        connection.reset();
+        CHECK(handler->disconnects == 1);
+        CHECK(handler->closeCode == WebSocket::CloseCode::Abnormal);
+    }
+}
+#endif
+
+#ifndef _WIN32
+TEST_CASE("Messages from one read are delivered as a batch", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    struct BatchingHandler : RecordingHandler {
+        std::vector<size_t> batchSizes;
+        std::vector<bool> isText;
+        void onDataBatch(WebSocket* connection, const WebSocket::MessageView* messages, size_t count) override {
+            batchSizes.push_back(count);
+            for (size_t i = 0; i < count; ++i) {
+                isText.push_back(messages[i].isText);
+            }
+            RecordingHandler::onDataBatch(connection, messages, count);
+        }
+        void onData(WebSocket* connection, const char* data) override {
+            RecordingHandler::onData(connection, data);
+        }
+        void onData(WebSocket*, const uint8_t* data, size_t length) override {
+            messages.emplace_back(reinterpret_cast<const char*>(data), length);
+        }
+    };
+    auto handler = std::make_shared<BatchingHandler>();
+    mockServer.handlers["/ws"] = handler;
+    TestWebSocket webSocket(logger, mockServer);
+
+    std::vector<uint8_t> data;
+    for (const auto& frame : {clientFrame(0x81, "one"), clientFrame(0x82, "two!"),
+                              clientFrame(0x89, "ping"), clientFrame(0x81, "three")}) {
+        data.insert(data.end(), frame.begin(), frame.end());
+    }
+    webSocket.sockets.clientSend(data);
+    webSocket.connection.handleDataReadyForRead();
+
+    REQUIRE(handler->batchSizes == std::vector<size_t>{3});
+    CHECK(handler->isText == std::vector<bool>{true, false, true});
+    CHECK(handler->messages == std::vector<std::string>{"one", "two!", "three"});
+    auto frames = webSocket.receiveFrames();
+    REQUIRE(frames.size() == 1);
+    CHECK(frames[0].opcode() == 0xa);
+
+    SECTION("and a close delivers what came before it") {
+        data = clientFrame(0x81, "four");
+        auto close = clientFrame(0x88, "\x03\xe8");
+        data.insert(data.end(), close.begin(), close.end());
+        webSocket.sockets.clientSend(data);
+        webSocket.connection.handleDataReadyForRead();
+        CHECK(handler->batchSizes == std::vector<size_t>{3, 1});
+        CHECK(handler->messages.back() == "four");
+    }
+}
+#endif
+
+#ifndef _WIN32
+TEST_CASE("Control frames overtake backed up data", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    auto handler = std::make_shared<RecordingHandler>();
+    mockServer.handlers["/ws"] = handler;
+    TestWebSocket webSocket(logger, mockServer);
+    auto& connection = webSocket.connection;
+    auto& sockets = webSocket.sockets;
+
+    int small = 4096;
+    REQUIRE(::setsockopt(sockets.server, SOL_SOCKET, SO_SNDBUF, &small, sizeof(small)) == 0);
+    REQUIRE(::setsockopt(sockets.client, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small)) == 0);
+    REQUIRE(::fcntl(sockets.server, F_SETFL, O_NONBLOCK) == 0);
+    std::vector<uint8_t> big(64 * 1024, 'x');
+    for (int i = 0; i < 4; ++i) {
+        connection.send(big.data(), big.size());
+    }
+    REQUIRE(connection.outputBufferSize() > 3 * big.size());
+
+    auto drain = [&] {
+        std::vector<uint8_t> received;
+        for (int i = 0; i < 10000 && connection.outputBufferSize() > 0; ++i) {
+            auto data = sockets.clientReceive();
+            received.insert(received.end(), data.begin(), data.end());
+            connection.handleDataReadyForWrite();
+        }
+        auto data = sockets.clientReceive();
+        received.insert(received.end(), data.begin(), data.end());
+        return parseFrames(received);
+    };
+
+    SECTION("pongs go out at the next frame boundary") {
+        sockets.clientSend(clientFrame(0x89, "one"));
+        sockets.clientSend(clientFrame(0x89, "two"));
+        connection.handleDataReadyForRead();
+        auto frames = drain();
+        REQUIRE(frames.size() == 6);
+        CHECK(frames[0].payload.size() == big.size());
+        CHECK(frames[1].opcode() == 0xa);
+        CHECK(frames[1].text() == "one");
+        CHECK(frames[2].opcode() == 0xa);
+        CHECK(frames[2].text() == "two");
+        for (size_t i = 3; i < frames.size(); ++i) {
+            CHECK(frames[i].payload.size() == big.size());
+        }
+    }
+    SECTION("a burst of pings is answered in order") {
+        std::vector<uint8_t> pings;
+        for (int i = 0; i < 100; ++i) {
+            auto ping = clientFrame(0x89, std::to_string(i));
+            pings.insert(pings.end(), ping.begin(), ping.end());
+        }
+        sockets.clientSend(pings);
+        connection.handleDataReadyForRead();
+        auto frames = drain();
+        REQUIRE(frames.size() == 104);
+        CHECK(frames[0].payload.size() == big.size());
+        for (int i = 0; i < 100; ++i) {
+            CHECK(frames[1 + i].opcode() == 0xa);
+            CHECK(frames[1 + i].text() == std::to_string(i));
+        }
+        CHECK(frames[101].payload.size() == big.size());
+    }
+    SECTION("an echoed Close replaces data not yet started") {
+        sockets.clientSend(clientFrame(0x88, "\x03\xe8"));
+        connection.handleDataReadyForRead();
+        auto frames = drain();
+        REQUIRE(frames.size() == 2);
+        CHECK(frames[0].payload.size() == big.size());
+        CHECK(frames[1].opcode() == 0x8);
+        CHECK(frames[1].text() == "\x03\xe8");
+    }
+}
+#endif
+
+#ifndef _WIN32
+TEST_CASE("Messages past their time to live are dropped", "[ConnectionTests]") {
+    using namespace std::chrono_literals;
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    mockServer.handlers["/ws"] = std::make_shared<RecordingHandler>();
+    TestWebSocket webSocket(logger, mockServer);
+    auto& connection = webSocket.connection;
+    auto& sockets = webSocket.sockets;
+
+    // Sent straight away while the client keeps up.
+    connection.send("quick", 1h);
+    auto frames = webSocket.receiveFrames();
+    REQUIRE(frames.size() == 1);
+    CHECK(frames[0].text() == "quick");
+
+    int small = 4096;
+    REQUIRE(::setsockopt(sockets.server, SOL_SOCKET, SO_SNDBUF, &small, sizeof(small)) == 0);
+    REQUIRE(::setsockopt(sockets.client, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small)) == 0);
+    REQUIRE(::fcntl(sockets.server, F_SETFL, O_NONBLOCK) == 0);
+    std::vector<uint8_t> big(64 * 1024, 'x');
+    // This has started going out, so it has to be finished.
+    connection.send(big.data(), big.size(), 10ms);
+    REQUIRE(connection.outputBufferSize() > 0);
+    std::this_thread::sleep_for(20ms);
+
+    auto drain = [&] {
+        std::vector<uint8_t> received;
+        for (int i = 0; i < 10000 && (connection.outputBufferSize() > 0 || connection.queuedMessageCount() > 0); ++i) {
+            auto data = sockets.clientReceive();
+            received.insert(received.end(), data.begin(), data.end());
+            connection.handleDataReadyForWrite();
+        }
+        auto data = sockets.clientReceive();
+        received.insert(received.end(), data.begin(), data.end());
+        return parseFrames(received);
+    };
+
+    SECTION("unless they've started going out") {
+        connection.send("stale", 0ms);
+        connection.send("fresh");
+        uint8_t binary[] = {1, 2, 3};
+        connection.send(binary, sizeof(binary), 0ms);
+        connection.send("later", 1h);
+        sockets.clientSend(clientFrame(0x89, "ping"));
+        connection.handleDataReadyForRead();
+        frames = drain();
+        REQUIRE(frames.size() == 4);
+        CHECK(frames[0].payload.size() == big.size());
+        CHECK(frames[1].opcode() == 0xa);
+        CHECK(frames[2].text() == "fresh");
+        CHECK(frames[3].text() == "later");
+        CHECK(connection.messagesExpired() == 2);
+        CHECK(connection.bytesExpired() == 2 + 5 + 2 + 3);
+    }
+    SECTION("including while queued behind conflated messages") {
+        connection.sendConflated("A", "1");
+        connection.send("stale", 0ms);
+        REQUIRE(connection.queuedMessageCount() == 2);
+        frames = drain();
+        REQUIRE(frames.size() == 2);
+        CHECK(frames[1].text() == "1");
+        CHECK(connection.messagesExpired() == 1);
+    }
+}
+#endif
+
+#ifndef _WIN32
+TEST_CASE("Compression offloaded to workers keeps messages in order", "[ConnectionTests]") {
+    if (!Config::deflateEnabled) {
+        return;
+    }
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    server.setPerMessageDeflateEnabled(true);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    mockServer.offloadThreshold = 64;
+    auto handler = std::make_shared<RecordingHandler>();
+    mockServer.handlers["/ws"] = handler;
+    auto webSocket = std::make_unique<TestWebSocket>(logger, mockServer, "permessage-deflate");
+    auto& connection = webSocket->connection;
+
+    std::string message;
+    for (int i = 0; i < 200; ++i) {
+        message += R"({"instrument":"ABC","price":)" + std::to_string(i * 7919 % 1000) + "}";
+    }
+    ZlibContext client;
+    client.initialise();
+
+    SECTION("sending") {
+        connection.send(message);
+        connection.send("small");
+        REQUIRE(mockServer.offloaded.size() == 1);
+        CHECK(webSocket->receiveFrames().empty());
+        mockServer.runOffloaded();
+        auto frames = webSocket->receiveFrames();
+        REQUIRE(frames.size() == 2);
+        CHECK(frames[0].compressed());
+        std::vector<uint8_t> decompressed;
+        int zlibError = 0;
+        REQUIRE(client.inflate(frames[0].payload, decompressed, zlibError));
+        CHECK(std::string(decompressed.begin(), decompressed.end()) == message);
+        // Compressed with the same context, after the big message.
+        decompressed.clear();
+        REQUIRE(client.inflate(frames[1].payload, decompressed, zlibError));
+        CHECK(std::string(decompressed.begin(), decompressed.end()) == "small");
+        CHECK(connection.compressionStats().messagesCompressed == 2);
+    }
+    SECTION("receiving") {
+        std::vector<uint8_t> compressed;
+        client.deflate(reinterpret_cast<const uint8_t*>(message.data()), message.size(), compressed);
+        REQUIRE(compressed.size() >= mockServer.offloadThreshold);
+        auto data = clientFrame(0xc1, std::string(compressed.begin(), compressed.end()));
+        auto after = clientFrame(0x81, "after");
+        data.insert(data.end(), after.begin(), after.end());
+        webSocket->sockets.clientSend(data);
+        connection.handleDataReadyForRead();
+        REQUIRE(mockServer.offloaded.size() == 1);
+        CHECK(handler->messages.empty());
+        // Nothing more is read until the job's done.
+        CHECK_FALSE(mockServer.readEvents);
+        mockServer.runOffloaded();
+        CHECK(mockServer.readEvents);
+        REQUIRE(handler->messages.size() == 2);
+        CHECK(handler->messages[0] == message);
+        CHECK(handler->messages[1] == "after");
+    }
+    SECTION("the connection can go before the job finishes") {
+        connection.send(message);
+        webSocket.reset();
+        CHECK(handler->disconnects == 1);
+        mockServer.runOffloaded();
+    }
+}
+
+namespace {
+
+std::string getRequest(const std::string& uri) {
+    return "GET " + uri + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+}
+
+// Returns the bodies of the (Content-Length delimited) responses in data.
+std::vector<std::string> responseBodies(const std::vector<uint8_t>& data) {
+    std::vector<std::string> bodies;
+    const std::string text(data.begin(), data.end());
+    size_t pos = 0;
+    while (pos < text.size()) {
+        auto headerEnd = text.find("\r\n\r\n", pos);
+        REQUIRE(headerEnd != std::string::npos);
+        auto lengthPos = text.find("Content-Length: ", pos);
+        REQUIRE(lengthPos < headerEnd);
+        auto length = std::stoul(text.substr(lengthPos + 16));
+        bodies.push_back(text.substr(headerEnd + 4, length));
+        pos = headerEnd + 4 + length;
+    }
+    return bodies;
+}
+
+// A response that isn't sent until the test says so.
+struct DeferredResponse : Response {
+    std::shared_ptr<ResponseWriter> writer;
+    void handle(std::shared_ptr<ResponseWriter> responseWriter) override {
+        writer = responseWriter;
+    }
+    void cancel() override {
+    }
+    void send(const std::string& body) {
+        writer->begin(ResponseCode::Ok);
+        writer->header("Content-Length", std::to_string(body.size()));
+        writer->payload(body.data(), body.size());
+        writer->finish(true);
+    }
+};
+
+}
+
+TEST_CASE("Pipelined requests", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    std::vector<std::string> handled;
+    std::shared_ptr<DeferredResponse> deferred;
+    mockServer.pageHandler = [&](const Request& request) -> std::shared_ptr<Response> {
+        handled.push_back(request.getRequestUri());
+        if (request.getRequestUri() == "/slow") {
+            deferred = std::make_shared<DeferredResponse>();
+            return deferred;
+        }
+        if (request.getRequestUri() == "/bye") {
+            return Response::error(ResponseCode::Forbidden, "bye");
+        }
+        return Response::textResponse(request.getRequestUri());
+    };
+    SocketPair sockets;
+    Connection connection(logger, mockServer, sockets.server, testAddress());
+
+    SECTION("are answered in order from a single read") {
+        sockets.clientSend(getRequest("/a") + getRequest("/b") + getRequest("/c"));
+        connection.handleDataReadyForRead();
+        CHECK(handled == std::vector<std::string>{"/a", "/b", "/c"});
+        CHECK(responseBodies(sockets.clientReceive()) == std::vector<std::string>{"/a", "/b", "/c"});
+    }
+    SECTION("split across reads") {
+        const auto requests = getRequest("/a") + getRequest("/b");
+        sockets.clientSend(requests.substr(0, 40));
+        connection.handleDataReadyForRead();
+        sockets.clientSend(requests.substr(40));
+        connection.handleDataReadyForRead();
+        CHECK(responseBodies(sockets.clientReceive()) == std::vector<std::string>{"/a", "/b"});
+    }
+    SECTION("wait for an asynchronous response to finish") {
+        sockets.clientSend(getRequest("/slow") + getRequest("/a") + getRequest("/b"));
+        connection.handleDataReadyForRead();
+        CHECK(handled == std::vector<std::string>{"/slow"});
+        CHECK(sockets.clientReceive().empty());
+        REQUIRE(deferred);
+        // No further reads: finishing the response dispatches the rest.
+        deferred->send("slow");
+        CHECK(handled == std::vector<std::string>{"/slow", "/a", "/b"});
+        CHECK(responseBodies(sockets.clientReceive()) == std::vector<std::string>{"slow", "/a", "/b"});
+    }
+    SECTION("are dropped after a response that closes the connection") {
+        sockets.clientSend(getRequest("/a") + getRequest("/bye") + getRequest("/b"));
+        connection.handleDataReadyForRead();
+        CHECK(handled == std::vector<std::string>{"/a", "/bye"});
+        auto received = sockets.clientReceive();
+        const std::string text(received.begin(), received.end());
+        CHECK(text.find("HTTP/1.1 200") == 0);
+        CHECK(text.find("HTTP/1.1 403") != std::string::npos);
+        CHECK(text.find("HTTP/1.1", text.find("HTTP/1.1 403") + 1) == std::string::npos);
+        // The connection has been shut down.
+        uint8_t byte;
+        CHECK(::recv(sockets.client, &byte, 1, MSG_DONTWAIT) == 0);
+    }
+}
+
+TEST_CASE("HTTP keep-alive", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    std::shared_ptr<DeferredResponse> deferred;
+    mockServer.pageHandler = [&](const Request& request) -> std::shared_ptr<Response> {
+        if (request.getRequestUri() == "/slow") {
+            deferred = std::make_shared<DeferredResponse>();
+            return deferred;
+        }
+        return Response::textResponse("hello");
+    };
+    SocketPair sockets;
+    Connection connection(logger, mockServer, sockets.server, testAddress());
+    auto request = [&](const std::string& version, const std::string& headers) {
+        sockets.clientSend("GET / " + version + "\r\n" + headers + "\r\n");
+        connection.handleDataReadyForRead();
+        auto response = sockets.clientReceive();
+        return std::string(response.begin(), response.end());
+    };
+    auto isClosed = [&] {
+        uint8_t byte;
+        return ::recv(sockets.client, &byte, 1, MSG_DONTWAIT) == 0;
+    };
+
+    SECTION("HTTP/1.0 closes by default") {
+        auto response = request("HTTP/1.0", "");
+        CHECK(response.find("HTTP/1.1 200") == 0);
+        CHECK(response.find("Connection: close\r\n") != std::string::npos);
+        CHECK(isClosed());
+    }
+    SECTION("HTTP/1.0 can ask to be kept alive") {
+        auto response = request("HTTP/1.0", "Connection: keep-alive\r\n");
+        CHECK(response.find("Connection: keep-alive\r\n") != std::string::npos);
+        CHECK_FALSE(isClosed());
+        CHECK(request("HTTP/1.0", "Connection: keep-alive\r\n").find("HTTP/1.1 200") == 0);
+    }
+    SECTION("HTTP/1.1 stays open unless asked not to") {
+        CHECK(request("HTTP/1.1", "").find("Connection: keep-alive\r\n") != std::string::npos);
+        CHECK_FALSE(isClosed());
+        CHECK(request("HTTP/1.1", "Connection: close\r\n").find("Connection: close\r\n") != std::string::npos);
+        CHECK(isClosed());
+    }
+    SECTION("the Keep-Alive header advertises our limits") {
+        mockServer.keepAliveTimeoutSeconds = 5;
+        mockServer.keepAliveMaxRequests = 3;
+        CHECK(request("HTTP/1.1", "").find("Keep-Alive: timeout=5, max=2\r\n") != std::string::npos);
+        CHECK(request("HTTP/1.1", "").find("Keep-Alive: timeout=5, max=1\r\n") != std::string::npos);
+        auto last = request("HTTP/1.1", "");
+        CHECK(last.find("Connection: close\r\n") != std::string::npos);
+        CHECK(last.find("Keep-Alive") == std::string::npos);
+        CHECK(isClosed());
+    }
+    SECTION("the Keep-Alive header only lists the limits set") {
+        mockServer.keepAliveTimeoutSeconds = 5;
+        CHECK(request("HTTP/1.1", "").find("Keep-Alive: timeout=5\r\n") != std::string::npos);
+        mockServer.keepAliveTimeoutSeconds = 0;
+        mockServer.keepAliveMaxRequests = 10;
+        CHECK(request("HTTP/1.1", "").find("Keep-Alive: max=8\r\n") != std::string::npos);
+        mockServer.keepAliveMaxRequests = 0;
+        CHECK(request("HTTP/1.1", "").find("Keep-Alive") == std::string::npos);
+    }
+    SECTION("idle connections expire") {
+        const auto timeout = std::chrono::seconds(5);
+        const auto later = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        // Lame connections are the Server's business.
+        CHECK_FALSE(connection.httpKeepAliveExpired(later, timeout));
+        sockets.clientSend("GET /slow HTTP/1.1\r\n\r\n");
+        connection.handleDataReadyForRead();
+        CHECK_FALSE(connection.httpKeepAliveExpired(later, timeout));
+        REQUIRE(deferred);
+        deferred->send("done");
+        CHECK_FALSE(connection.httpKeepAliveExpired(std::chrono::steady_clock::now(), timeout));
+        CHECK(connection.httpKeepAliveExpired(later, timeout));
+    }
+    SECTION("unsupported versions are refused") {
+        CHECK(request("HTTP/0.9", "").find("HTTP/1.1 501") == 0);
+    }
+}
+
+namespace {
+
+struct RecordingBodyHandler : RequestBodyHandler {
+    std::vector<std::string> pieces;
+    std::shared_ptr<Flow> flow;
+    bool pauseOnData = false;
+    bool throwOnEnd = false;
+    int begins = 0;
+    int ends = 0;
+    int aborts = 0;
+    void onBegin(const Request&, std::shared_ptr<Flow> bodyFlow) override {
+        ++begins;
+        flow = bodyFlow;
+    }
+    void onBodyData(const Request&, const uint8_t* data, size_t length) override {
+        pieces.emplace_back(reinterpret_cast<const char*>(data), length);
+        if (pauseOnData) {
+            flow->pause();
+        }
+    }
+    std::shared_ptr<Response> onBodyEnd(const Request&) override {
+        ++ends;
+        if (throwOnEnd) {
+            throw 42;
+        }
+        std::string body;
+        for (const auto& piece : pieces) {
+            body += piece;
+        }
+        return Response::textResponse("got " + body);
+    }
+    void onAbort(const Request&) override {
+        ++aborts;
+    }
+};
+
+}
+
+TEST_CASE("Request bodies", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    auto handler = std::make_shared<RecordingBodyHandler>();
+    mockServer.bodyHandlers["/upload"] = handler;
+    std::string pageContent;
+    mockServer.pageHandler = [&](const Request& request) -> std::shared_ptr<Response> {
+        pageContent.assign(reinterpret_cast<const char*>(request.content()), request.contentLength());
+        return Response::textResponse("ok");
+    };
+    SocketPair sockets;
+    auto connection = std::make_unique<Connection>(logger, mockServer, sockets.server, testAddress());
+    auto receive = [&] {
+        connection->handleDataReadyForRead();
+        return responseBodies(sockets.clientReceive());
+    };
+
+    SECTION("are streamed to a body handler as they arrive") {
+        sockets.clientSend("POST /upload HTTP/1.1\r\nContent-Length: 10\r\n\r\n0123");
+        CHECK(receive().empty());
+        CHECK(handler->begins == 1);
+        CHECK(handler->pieces == std::vector<std::string>{"0123"});
+        sockets.clientSend("456789");
+        CHECK(receive() == std::vector<std::string>{"got 0123456789"});
+        CHECK(handler->ends == 1);
+    }
+    SECTION("chunked bodies are decoded for a body handler") {
+        sockets.clientSend("POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                           "3\r\nabc\r\n");
+        CHECK(receive().empty());
+        sockets.clientSend("2\r\nde\r\n0\r\n\r\n");
+        CHECK(receive() == std::vector<std::string>{"got abcde"});
+        CHECK(handler->pieces == std::vector<std::string>{"abc", "de"});
+    }
+    SECTION("body handlers can pause the flow") {
+        handler->pauseOnData = true;
+        sockets.clientSend("POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n");
+        connection->handleDataReadyForRead();
+        CHECK_FALSE(mockServer.readEvents);
+        CHECK(connection->readingPaused());
+        // Anything already read waits until the handler resumes.
+        sockets.clientSend("2\r\nde\r\n0\r\n\r\n");
+        connection->handleDataReadyForRead();
+        CHECK(handler->pieces == std::vector<std::string>{"abc"});
+        handler->pauseOnData = false;
+        handler->flow->resume();
+        CHECK(mockServer.readEvents);
+        CHECK(handler->pieces == std::vector<std::string>{"abc", "de"});
+        CHECK(responseBodies(sockets.clientReceive()) == std::vector<std::string>{"got abcde"});
+    }
+    SECTION("body handlers hear about abandoned requests") {
+        sockets.clientSend("POST /upload HTTP/1.1\r\nContent-Length: 10\r\n\r\n0123");
+        connection->handleDataReadyForRead();
+        connection.reset();
+        CHECK(handler->aborts == 1);
+        CHECK(handler->ends == 0);
+    }
+    SECTION("requests can follow a chunked body") {
+        sockets.clientSend("POST /page HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                           "3\r\nabc\r\n2\r\nde\r\n0\r\n\r\n"
+                           + getRequest("/next"));
+        CHECK(receive() == std::vector<std::string>{"ok", "ok"});
+        CHECK(pageContent.empty());
+    }
+    SECTION("chunked bodies arrive in full for page handlers") {
+        sockets.clientSend("POST /page HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+                           "3\r\nabc\r\n2\r\nde\r\n0\r\n\r\n");
+        CHECK(receive() == std::vector<std::string>{"ok"});
+        CHECK(pageContent == "abcde");
+    }
+    SECTION("malformed and ambiguous bodies are refused") {
+        sockets.clientSend("POST /page HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 5\r\n\r\n");
+        connection->handleDataReadyForRead();
+        auto response = sockets.clientReceive();
+        CHECK(std::string(response.begin(), response.end()).find("HTTP/1.1 400") == 0);
+    }
+    SECTION("a malformed buffered body is refused once") {
+        sockets.clientSend("POST /page HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\nzz\r\n");
+        connection->handleDataReadyForRead();
+        auto bytes = sockets.clientReceive();
+        const std::string response(bytes.begin(), bytes.end());
+        CHECK(response.find("HTTP/1.1 400") == 0);
+        CHECK(response.find("HTTP/1.1", 1) == std::string::npos);
+        CHECK(pageContent.empty());
+    }
+    SECTION("anything a body handler throws is an internal error") {
+        handler->throwOnEnd = true;
+        sockets.clientSend("POST /upload HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc");
+        connection->handleDataReadyForRead();
+        auto response = sockets.clientReceive();
+        CHECK(std::string(response.begin(), response.end()).find("HTTP/1.1 500") == 0);
+    }
+}
+
+TEST_CASE("Expect: 100-continue", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    std::string pageContent;
+    mockServer.pageHandler = [&](const Request& request) -> std::shared_ptr<Response> {
+        pageContent.assign(reinterpret_cast<const char*>(request.content()), request.contentLength());
+        return Response::textResponse("ok");
+    };
+    auto handler = std::make_shared<RecordingBodyHandler>();
+    mockServer.bodyHandlers["/upload"] = handler;
+    SocketPair sockets;
+    Connection connection(logger, mockServer, sockets.server, testAddress());
+    auto send = [&](const std::string& data) {
+        sockets.clientSend(data);
+        connection.handleDataReadyForRead();
+        auto response = sockets.clientReceive();
+        return std::string(response.begin(), response.end());
+    };
+    auto isClosed = [&] {
+        uint8_t byte;
+        return ::recv(sockets.client, &byte, 1, MSG_DONTWAIT) == 0;
+    };
+
+    SECTION("the client is told to continue") {
+        CHECK(send("POST /page HTTP/1.1\r\nExpect: 100-continue\r\nContent-Length: 5\r\n\r\n")
+              == "HTTP/1.1 100 Continue\r\n\r\n");
+        auto response = send("hello");
+        CHECK(response.find("HTTP/1.1 200") == 0);
+        CHECK(pageContent == "hello");
+        CHECK_FALSE(isClosed());
+    }
+    SECTION("HTTP/1.0 clients are never told to continue") {
+        CHECK(send("POST /page HTTP/1.0\r\nExpect: 100-continue\r\nContent-Length: 5\r\n\r\n").empty());
+        CHECK(send("hello").find("HTTP/1.1 200") == 0);
+    }
+    SECTION("oversized bodies are refused before they are sent") {
+        auto response = send("POST /page HTTP/1.1\r\nExpect: 100-continue\r\nContent-Length: 1000000\r\n\r\n");
+        CHECK(response.find("HTTP/1.1 413") == 0);
+        CHECK(isClosed());
+    }
+    SECTION("page handlers can refuse a body") {
+        mockServer.bodyCheck = [](const Request& request) {
+            return request.hasHeader("Authorization") ? Response::unhandled()
+                                                      : Response::error(ResponseCode::Unauthorized, "Who are you?");
+        };
+        auto response = send("POST /page HTTP/1.1\r\nExpect: 100-continue\r\nContent-Length: 5\r\n\r\n");
+        CHECK(response.find("HTTP/1.1 401") == 0);
+        CHECK(response.find("100 Continue") == std::string::npos);
+        CHECK(response.find("Connection: close\r\n") != std::string::npos);
+        CHECK(isClosed());
+    }
+    SECTION("page handlers can let a body through") {
+        mockServer.bodyCheck = [](const Request&) { return Response::unhandled(); };
+        auto response = send("POST /page HTTP/1.1\r\nExpect: 100-continue\r\nAuthorization: x\r\n"
+                             "Transfer-Encoding: chunked\r\n\r\n");
+        CHECK(response == "HTTP/1.1 100 Continue\r\n\r\n");
+        CHECK(send("5\r\nhello\r\n0\r\n\r\n").find("HTTP/1.1 200") == 0);
+        CHECK(pageContent == "hello");
+    }
+    SECTION("body handlers can refuse a body") {
+        struct RefusingBodyHandler : RecordingBodyHandler {
+            std::shared_ptr<Response> checkRequestBody(const Request&) override {
+                return Response::error(ResponseCode::PayloadTooLarge, "Too big");
+            }
+        };
+        auto refusing = std::make_shared<RefusingBodyHandler>();
+        mockServer.bodyHandlers["/upload"] = refusing;
+        auto response = send("POST /upload HTTP/1.1\r\nExpect: 100-continue\r\nContent-Length: 5\r\n\r\n");
+        CHECK(response.find("HTTP/1.1 413") == 0);
+        CHECK(refusing->begins == 0);
+        CHECK(isClosed());
+    }
+    SECTION("body handlers are told to continue") {
+        CHECK(send("POST /upload HTTP/1.1\r\nExpect: 100-continue\r\nContent-Length: 5\r\n\r\n")
+              == "HTTP/1.1 100 Continue\r\n\r\n");
+        CHECK(send("hello").find("got hello") != std::string::npos);
+    }
+    SECTION("requests without bodies aren't told to continue") {
+        CHECK(send("GET /page HTTP/1.1\r\nExpect: 100-continue\r\n\r\n").find("HTTP/1.1 200") == 0);
+    }
+    SECTION("other expectations fail") {
+        auto response = send("POST /page HTTP/1.1\r\nExpect: something-else\r\nContent-Length: 5\r\n\r\n");
+        CHECK(response.find("HTTP/1.1 417") == 0);
+    }
+}
+
+TEST_CASE("Response headers", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    mockServer.pageHandler = [](const Request&) -> std::shared_ptr<Response> {
+        return Response::textResponse("hello");
+    };
+    SocketPair sockets;
+    Connection connection(logger, mockServer, sockets.server, testAddress());
+    sockets.clientSend(getRequest("/"));
+    connection.handleDataReadyForRead();
+    auto bytes = sockets.clientReceive();
+    std::string response(bytes.begin(), bytes.end());
+    CHECK(response.find("HTTP/1.1 200 OK\r\nServer: ") == 0);
+    CHECK(response.find("\r\nDate: " + mockServer.date + "\r\n") != std::string::npos);
+    CHECK(response.find("\r\nContent-Type: text/plain\r\n") != std::string::npos);
+}
+
+namespace {
+
+struct HttpResponse {
+    std::string headers;
+    std::string body;
+};
+
+// Splits a single response into its headers and body, undoing any chunking.
+HttpResponse parseResponse(const std::string& response) {
+    auto endOfHeaders = response.find("\r\n\r\n");
+    REQUIRE(endOfHeaders != std::string::npos);
+    HttpResponse result{response.substr(0, endOfHeaders + 2), {}};
+    auto pos = endOfHeaders + 4;
+    if (result.headers.find("Transfer-encoding: chunked\r\n") == std::string::npos) {
+        result.body = response.substr(pos);
+        return result;
+    }
+    for (;;) {
+        auto endOfSize = response.find("\r\n", pos);
+        REQUIRE(endOfSize != std::string::npos);
+        auto size = std::stoul(response.substr(pos, endOfSize - pos), nullptr, 16);
+        pos = endOfSize + 2;
+        if (size == 0)
+            break;
+        result.body += response.substr(pos, size);
+        pos += size + 2;
+    }
+    return result;
+}
+
+}
+
+TEST_CASE("HTTP response compression", "[ConnectionTests]") {
+    if (!Config::deflateEnabled) {
+        return;
+    }
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    mockServer.httpCompression.enabled = true;
+    std::string big(4000, 'x');
+    mockServer.pageHandler = [&](const Request& request) -> std::shared_ptr<Response> {
+        if (request.getRequestUri() == "/small") {
+            return Response::jsonResponse("{}");
+        }
+        if (request.getRequestUri() == "/big") {
+            return Response::jsonResponse("\"" + big + "\"");
+        }
+        return Response::unhandled();
+    };
+    SocketPair sockets;
+    Connection connection(logger, mockServer, sockets.server, testAddress());
+    auto request = [&](const std::string& requestLine, const std::string& headers) {
+        sockets.clientSend(requestLine + "\r\n" + headers + "\r\n");
+        connection.handleDataReadyForRead();
+        auto bytes = sockets.clientReceive();
+        return parseResponse(std::string(bytes.begin(), bytes.end()));
+    };
+    auto isGzip = [](const std::string& body) {
+        return body.size() > 2 && body[0] == '\x1f' && body[1] == '\x8b';
+    };
+
+    SECTION("responses are compressed for clients that accept it") {
+        for (int i = 0; i < 2; ++i) {
+            auto response = request("GET /big HTTP/1.1", "Accept-Encoding: gzip, deflate\r\n");
+            CHECK(response.headers.find("\r\nContent-Encoding: gzip\r\n") != std::string::npos);
+            CHECK(response.headers.find("\r\nVary: Accept-Encoding\r\n") != std::string::npos);
+            CHECK(response.headers.find("Content-Length") == std::string::npos);
+            CHECK(isGzip(response.body));
+            CHECK(response.body.size() < 100);
+        }
+    }
+    SECTION("other clients are told the response varies") {
+        auto response = request("GET /big HTTP/1.1", "");
+        CHECK(response.headers.find("Content-Encoding") == std::string::npos);
+        CHECK(response.headers.find("\r\nVary: Accept-Encoding\r\n") != std::string::npos);
+        CHECK(response.headers.find("\r\nContent-Length: 4002\r\n") != std::string::npos);
+        CHECK(response.body.size() == 4002);
+    }
+    SECTION("small responses are left alone") {
+        auto response = request("GET /small HTTP/1.1", "Accept-Encoding: gzip\r\n");
+        CHECK(response.headers.find("Content-Encoding") == std::string::npos);
+        CHECK(response.headers.find("Vary") == std::string::npos);
+        CHECK(response.body == "{}");
+    }
+    SECTION("only listed content types are compressed") {
+        mockServer.httpCompression.contentTypes = {"text/"};
+        auto response = request("GET /big HTTP/1.1", "Accept-Encoding: gzip\r\n");
+        CHECK(response.headers.find("Content-Encoding") == std::string::npos);
+        CHECK(response.body.size() == 4002);
+    }
+    SECTION("deflate is used if gzip isn't accepted") {
+        auto response = request("GET /big HTTP/1.1", "Accept-Encoding: gzip;q=0, deflate\r\n");
+        CHECK(response.headers.find("\r\nContent-Encoding: deflate\r\n") != std::string::npos);
+        CHECK(response.body.size() < 100);
+    }
+    SECTION("HTTP/1.0 clients get the connection closed instead of chunks") {
+        auto response = request("GET /big HTTP/1.0", "Accept-Encoding: gzip\r\nConnection: keep-alive\r\n");
+        CHECK(response.headers.find("Transfer-encoding") == std::string::npos);
+        CHECK(response.headers.find("\r\nConnection: close\r\n") != std::string::npos);
+        CHECK(isGzip(response.body));
+    }
+    SECTION("HEAD requests aren't compressed") {
+        auto response = request("HEAD /big HTTP/1.1", "Accept-Encoding: gzip\r\n");
+        CHECK(response.headers.find("Content-Encoding") == std::string::npos);
+    }
+    SECTION("static files are compressed") {
+        char directory[] = "/tmp/seasocksXXXXXX";
+        REQUIRE(::mkdtemp(directory));
+        const std::string path = std::string(directory) + "/data.json";
+        {
+            std::ofstream file(path);
+            for (int i = 0; i < 10000; ++i)
+                file << "[1,2,3]";
+        }
+        mockServer.staticPath = directory;
+        auto response = request("GET /data.json HTTP/1.1", "Accept-Encoding: gzip\r\n");
+        CHECK(response.headers.find("\r\nAccept-Ranges: bytes\r\n") != std::string::npos);
+        CHECK(response.headers.find("\r\nContent-Encoding: gzip\r\n") != std::string::npos);
+        CHECK(isGzip(response.body));
+        CHECK(response.body.size() < 1000);
+        // Read over several blocks, but compressed as one stream without a
+        // sync flush (and its empty stored block) after each.
+        CHECK(response.body.find(std::string("\0\0\xff\xff", 4)) == std::string::npos);
+        auto ranged = request("GET /data.json HTTP/1.1", "Accept-Encoding: gzip\r\nRange: bytes=0-6\r\n");
+        CHECK(ranged.headers.find("Content-Encoding") == std::string::npos);
+        CHECK(ranged.body == "[1,2,3]");
+        ::unlink(path.c_str());
+        ::rmdir(directory);
+    }
+}
+
+TEST_CASE("Static file cache", "[ConnectionTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    StaticFileCacheOptions options;
+    options.enabled = true;
+    options.revalidateInterval = std::chrono::hours(1);
+    StaticFileCache cache(options);
+    mockServer.fileCache = &cache;
+    char directory[] = "/tmp/seasocksXXXXXX";
+    REQUIRE(::mkdtemp(directory));
+    mockServer.staticPath = directory;
+    const std::string smallPath = std::string(directory) + "/app.js";
+    const std::string bigPath = std::string(directory) + "/index.html";
+    const std::string big(5000, 'x');
+    std::ofstream(smallPath) << "var x = 1;";
+    std::ofstream(bigPath) << big;
+    SocketPair sockets;
+    Connection connection(logger, mockServer, sockets.server, testAddress());
+    auto request = [&](const std::string& uri, const std::string& headers = "") {
+        sockets.clientSend("GET " + uri + " HTTP/1.1\r\n" + headers + "\r\n");
+        connection.handleDataReadyForRead();
+        auto bytes = sockets.clientReceive();
+        return parseResponse(std::string(bytes.begin(), bytes.end()));
+    };
+
+    auto first = request("/app.js");
+    CHECK(first.body == "var x = 1;");
+    CHECK(first.headers.find("\r\nContent-Type: text/javascript\r\n") != std::string::npos);
+    CHECK(first.headers.find("\r\nContent-Length: 10\r\n") != std::string::npos);
+    CHECK(first.headers.find("\r\nLast-Modified: ") != std::string::npos);
+    CHECK(request("/").body == big);
+    CHECK(cache.numFiles() == 2);
+
+    // Served from memory from now on.
+    ::unlink(smallPath.c_str());
+    ::unlink(bigPath.c_str());
+    ::rmdir(directory);
+    auto second = request("/app.js");
+    CHECK(second.headers == first.headers);
+    CHECK(second.body == "var x = 1;");
+    CHECK(request("/index.html", "Range: bytes=10-14\r\n").body == "xxxxx");
+    // Ranges reaching outside the file are clamped or refused, never read from memory past it.
+    auto suffix = request("/app.js", "Range: bytes=-5000\r\n");
+    CHECK(suffix.headers.find("HTTP/1.1 206") == 0);
+    CHECK(suffix.headers.find("\r\nContent-Range: bytes 0-9/10\r\n") != std::string::npos);
+    CHECK(suffix.body == "var x = 1;");
+    CHECK(request("/missing.js").headers.find("HTTP/1.1 404") == 0);
+
+    // Errors close the connection, so refuse a backwards range on a new one.
+    SocketPair rangeSockets;
+    Connection rangeConnection(logger, mockServer, rangeSockets.server, testAddress());
+    rangeSockets.clientSend("GET /app.js HTTP/1.1\r\nRange: bytes=6-2\r\n\r\n");
+    rangeConnection.handleDataReadyForRead();
+    auto refused = rangeSockets.clientReceive();
+    CHECK(std::string(refused.begin(), refused.end()).find("HTTP/1.1 416 Range Not Satisfiable\r\n") == 0);
+}
+
+TEST_CASE("Static file cache keeps compressed copies", "[ConnectionTests]") {
+    if (!Config::deflateEnabled) {
+        return;
+    }
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    MockServerImpl mockServer;
+    mockServer.realServer = &server;
+    mockServer.httpCompression.enabled = true;
+    StaticFileCacheOptions options;
+    options.enabled = true;
+    options.revalidateInterval = std::chrono::hours(1);
+    StaticFileCache cache(options);
+    mockServer.fileCache = &cache;
+    char directory[] = "/tmp/seasocksXXXXXX";
+    REQUIRE(::mkdtemp(directory));
+    mockServer.staticPath = directory;
+    const std::string path = std::string(directory) + "/data.json";
+    {
+        std::ofstream file(path);
+        for (int i = 0; i < 10000; ++i)
+            file << "[1,2,3]";
+    }
+    SocketPair sockets;
+    Connection connection(logger, mockServer, sockets.server, testAddress());
+    auto request = [&](const std::string& headers) {
+        sockets.clientSend("GET /data.json HTTP/1.1\r\n" + headers + "\r\n");
+        connection.handleDataReadyForRead();
+        auto bytes = sockets.clientReceive();
+        return parseResponse(std::string(bytes.begin(), bytes.end()));
+    };
+
+    auto first = request("Accept-Encoding: gzip\r\n");
+    CHECK(first.headers.find("\r\nContent-Encoding: gzip\r\n") != std::string::npos);
+    CHECK(first.headers.find("Transfer-encoding") == std::string::npos);
+    CHECK(first.headers.find("\r\nContent-Length: " + std::to_string(first.body.size()) + "\r\n")
+          != std::string::npos);
+    CHECK(first.body.size() < 1000);
+    CHECK(cache.memoryUsed() == 70000 + first.body.size());
+
+    // Sent again as is, even once the file's gone.
+    ::unlink(path.c_str());
+    ::rmdir(directory);
+    auto second = request("Accept-Encoding: gzip\r\n");
+    CHECK(second.headers == first.headers);
+    CHECK(second.body == first.body);
+    CHECK(cache.memoryUsed() == 70000 + first.body.size());
+
+    auto deflated = request("Accept-Encoding: deflate\r\n");
+    CHECK(deflated.headers.find("\r\nContent-Encoding: deflate\r\n") != std::string::npos);
+    CHECK(deflated.body != first.body);
+    CHECK(cache.memoryUsed() == 70000 + first.body.size() + deflated.body.size());
+    CHECK(request("").body.size() == 70000);
+}
+#endif
@@ -0,0 +1,144 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/ContentEncoding.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+#include <vector>
+
+#include <zlib.h>
+
+using namespace seasocks;
+
+namespace {
+
+// Decodes gzip or zlib-wrapped data, as a browser would.
+std::string decode(const std::vector<uint8_t>& encoded) {
+    z_stream stream{};
+    REQUIRE(inflateInit2(&stream, 15 + 32) == Z_OK);
+    stream.next_in = const_cast<Bytef*>(encoded.data());
+    stream.avail_in = static_cast<uInt>(encoded.size());
+    std::string result;
+    int ret;
+    do {
+        char buf[4096];
+        stream.next_out = reinterpret_cast<Bytef*>(buf);
+        stream.avail_out = sizeof(buf);
+        ret = inflate(&stream, Z_NO_FLUSH);
+        result.append(buf, sizeof(buf) - stream.avail_out);
+    } while (ret == Z_OK);
+    inflateEnd(&stream);
+    CHECK(ret == Z_STREAM_END);
+    return result;
+}
+
+std::string makeJson(size_t numObjects) {
+    std::string json = "[";
+    for (size_t i = 0; i < numObjects; ++i) {
+        json += R"({"instrument":"ABC)" + std::to_string(i % 17) + R"(","bid":)" + std::to_string(i * 7 % 1000) + "},";
+    }
+    return json + "{}]";
+}
+
+}
+
+TEST_CASE("negotiates content encodings", "[ContentEncodingTests]") {
+    CHECK(negotiateContentEncoding("") == ContentEncoding::Identity);
+    CHECK(negotiateContentEncoding("gzip") == ContentEncoding::Gzip);
+    CHECK(negotiateContentEncoding("gzip, deflate, br") == ContentEncoding::Gzip);
+    CHECK(negotiateContentEncoding("deflate, gzip") == ContentEncoding::Gzip);
+    CHECK(negotiateContentEncoding("deflate") == ContentEncoding::Deflate);
+    CHECK(negotiateContentEncoding("GZip") == ContentEncoding::Gzip);
+    CHECK(negotiateContentEncoding("x-gzip") == ContentEncoding::Gzip);
+    CHECK(negotiateContentEncoding("br, identity") == ContentEncoding::Identity);
+    CHECK(negotiateContentEncoding("*") == ContentEncoding::Gzip);
+}
+
+TEST_CASE("honours quality values", "[ContentEncodingTests]") {
+    CHECK(negotiateContentEncoding("gzip;q=0.5, deflate") == ContentEncoding::Deflate);
+    CHECK(negotiateContentEncoding("gzip;q=0, deflate;q=0.1") == ContentEncoding::Deflate);
+    CHECK(negotiateContentEncoding("gzip;q=0") == ContentEncoding::Identity);
+    CHECK(negotiateContentEncoding("gzip ; q=0.000") == ContentEncoding::Identity);
+    CHECK(negotiateContentEncoding("*;q=0") == ContentEncoding::Identity);
+    CHECK(negotiateContentEncoding("*, gzip;q=0") == ContentEncoding::Deflate);
+    CHECK(negotiateContentEncoding("gzip;q=1.0") == ContentEncoding::Gzip);
+    CHECK(negotiateContentEncoding("gzip;q=nonsense") == ContentEncoding::Identity);
+    CHECK(negotiateContentEncoding("gzip;q=2") == ContentEncoding::Identity);
+}
+
+TEST_CASE("matches content types", "[ContentEncodingTests]") {
+    const std::vector<std::string> types = {"text/", "application/json"};
+    CHECK(matchesContentType("text/html", types));
+    CHECK(matchesContentType("text/plain; charset=utf-8", types));
+    CHECK(matchesContentType("Application/JSON", types));
+    CHECK(matchesContentType("application/json;charset=utf-8", types));
+    CHECK_FALSE(matchesContentType("application/jsonp", types));
+    CHECK_FALSE(matchesContentType("text/", types));
+    CHECK_FALSE(matchesContentType("image/png", types));
+    CHECK_FALSE(matchesContentType("", types));
+}
+
+TEST_CASE("compresses content", "[ContentEncodingTests]") {
+    const auto json = makeJson(1000);
+    ContentEncoder encoder;
+    for (auto encoding : {ContentEncoding::Gzip, ContentEncoding::Deflate, ContentEncoding::Gzip}) {
+        CAPTURE(contentEncodingName(encoding));
+        encoder.begin(encoding, 6);
+        std::vector<uint8_t> encoded;
+        encoder.encode(json.data(), json.size(), false, encoded);
+        encoder.finish(encoded);
+        if (encoding == ContentEncoding::Gzip) {
+            REQUIRE(encoded.size() > 2);
+            CHECK(encoded[0] == 0x1f);
+            CHECK(encoded[1] == 0x8b);
+        }
+        CHECK(encoded.size() * 5 < json.size());
+        CHECK(decode(encoded) == json);
+    }
+}
+
+TEST_CASE("compresses streamed content", "[ContentEncodingTests]") {
+    const auto json = makeJson(1000);
+    ContentEncoder encoder;
+    encoder.begin(ContentEncoding::Gzip, 1);
+    std::vector<uint8_t> encoded;
+    for (size_t offset = 0; offset < json.size(); offset += 1000) {
+        auto length = std::min<size_t>(1000, json.size() - offset);
+        encoder.encode(json.data() + offset, length, true, encoded);
+        // Each flushed part can be decoded as soon as it arrives.
+        CHECK_FALSE(encoded.empty());
+    }
+    encoder.finish(encoded);
+    CHECK(decode(encoded) == json);
+
+    // Reused for the next response.
+    encoder.begin(ContentEncoding::Gzip, 9);
+    std::vector<uint8_t> next;
+    encoder.encode("hello", 5, false, next);
+    encoder.finish(next);
+    CHECK(decode(next) == "hello");
+}
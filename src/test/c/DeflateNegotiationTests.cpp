@@ -0,0 +1,145 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/DeflateNegotiation.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+using namespace seasocks;
+
+namespace {
+
+DeflateParameters negotiate(const std::string& header, const PerMessageDeflateOptions& options = {}) {
+    DeflateParameters result;
+    REQUIRE(negotiatePerMessageDeflate(header, options, result));
+    return result;
+}
+
+bool accepts(const std::string& header, const PerMessageDeflateOptions& options = {}) {
+    DeflateParameters result;
+    return negotiatePerMessageDeflate(header, options, result);
+}
+
+}
+
+TEST_CASE("bare permessage-deflate uses defaults", "[DeflateNegotiationTests]") {
+    auto result = negotiate("permessage-deflate");
+    CHECK(result.serverMaxWindowBits == 15);
+    CHECK(result.clientMaxWindowBits == 15);
+    CHECK_FALSE(result.serverNoContextTakeover);
+    CHECK_FALSE(result.clientNoContextTakeover);
+    CHECK(result.responseHeader() == "permessage-deflate");
+}
+
+TEST_CASE("ignores other extensions", "[DeflateNegotiationTests]") {
+    CHECK_FALSE(accepts("x-webkit-deflate-frame"));
+    CHECK_FALSE(accepts(""));
+    CHECK(accepts("x-webkit-deflate-frame, permessage-deflate"));
+}
+
+TEST_CASE("chrome style offer", "[DeflateNegotiationTests]") {
+    auto result = negotiate("permessage-deflate; client_max_window_bits");
+    CHECK(result.clientMaxWindowBits == 15);
+    CHECK(result.responseHeader() == "permessage-deflate");
+
+    PerMessageDeflateOptions options;
+    options.clientMaxWindowBits = 10;
+    result = negotiate("permessage-deflate; client_max_window_bits", options);
+    CHECK(result.clientMaxWindowBits == 10);
+    CHECK(result.responseHeader() == "permessage-deflate; client_max_window_bits=10");
+}
+
+TEST_CASE("client window is only limited if client allows it", "[DeflateNegotiationTests]") {
+    PerMessageDeflateOptions options;
+    options.clientMaxWindowBits = 10;
+    auto result = negotiate("permessage-deflate", options);
+    CHECK(result.clientMaxWindowBits == 15);
+    CHECK(result.responseHeader() == "permessage-deflate");
+}
+
+TEST_CASE("client window hint is honoured", "[DeflateNegotiationTests]") {
+    auto result = negotiate("permessage-deflate; client_max_window_bits=12");
+    CHECK(result.clientMaxWindowBits == 12);
+    CHECK(result.responseHeader() == "permessage-deflate; client_max_window_bits=12");
+}
+
+TEST_CASE("server window is the smaller of offer and policy", "[DeflateNegotiationTests]") {
+    PerMessageDeflateOptions options;
+    options.serverMaxWindowBits = 11;
+    CHECK(negotiate("permessage-deflate; server_max_window_bits=13", options).serverMaxWindowBits == 11);
+    CHECK(negotiate("permessage-deflate; server_max_window_bits=10", options).serverMaxWindowBits == 10);
+    CHECK(negotiate("permessage-deflate; server_max_window_bits=\"10\"", options).serverMaxWindowBits == 10);
+    CHECK(negotiate("permessage-deflate", options).responseHeader() == "permessage-deflate; server_max_window_bits=11");
+}
+
+TEST_CASE("eight bit server windows fall back to the next offer", "[DeflateNegotiationTests]") {
+    CHECK_FALSE(accepts("permessage-deflate; server_max_window_bits=8"));
+    auto result = negotiate("permessage-deflate; server_max_window_bits=8, permessage-deflate");
+    CHECK(result.serverMaxWindowBits == 15);
+}
+
+TEST_CASE("context takeover", "[DeflateNegotiationTests]") {
+    auto result = negotiate("permessage-deflate; server_no_context_takeover; client_no_context_takeover");
+    CHECK(result.serverNoContextTakeover);
+    CHECK(result.clientNoContextTakeover);
+    CHECK(result.responseHeader() == "permessage-deflate; server_no_context_takeover; client_no_context_takeover");
+
+    PerMessageDeflateOptions options;
+    options.serverNoContextTakeover = true;
+    options.clientNoContextTakeover = true;
+    result = negotiate("permessage-deflate", options);
+    CHECK(result.serverNoContextTakeover);
+    CHECK(result.clientNoContextTakeover);
+}
+
+TEST_CASE("preset dictionaries", "[DeflateNegotiationTests]") {
+    DeflateParameters result;
+    REQUIRE(negotiatePerMessageDeflate("permessage-deflate; seasocks_dictionary=\"prices-v1\"; server_no_context_takeover",
+                                       {}, result, "prices-v1"));
+    CHECK(result.dictionaryId == "prices-v1");
+    CHECK(result.responseHeader() == "permessage-deflate; server_no_context_takeover; seasocks_dictionary=prices-v1");
+
+    // Offers of a dictionary we don't have fall back to the next offer.
+    REQUIRE(negotiatePerMessageDeflate("permessage-deflate; seasocks_dictionary=prices-v0, permessage-deflate",
+                                       {}, result, "prices-v1"));
+    CHECK(result.dictionaryId.empty());
+    CHECK(result.responseHeader() == "permessage-deflate");
+    CHECK_FALSE(accepts("permessage-deflate; seasocks_dictionary=prices-v1"));
+    CHECK_FALSE(accepts("permessage-deflate; seasocks_dictionary"));
+
+    // Clients that don't ask for it don't get it.
+    REQUIRE(negotiatePerMessageDeflate("permessage-deflate", {}, result, "prices-v1"));
+    CHECK(result.dictionaryId.empty());
+}
+
+TEST_CASE("malformed offers are declined", "[DeflateNegotiationTests]") {
+    CHECK_FALSE(accepts("permessage-deflate; server_max_window_bits"));
+    CHECK_FALSE(accepts("permessage-deflate; server_max_window_bits=16"));
+    CHECK_FALSE(accepts("permessage-deflate; server_max_window_bits=abc"));
+    CHECK_FALSE(accepts("permessage-deflate; client_max_window_bits=7"));
+    CHECK_FALSE(accepts("permessage-deflate; server_no_context_takeover=1"));
+    CHECK_FALSE(accepts("permessage-deflate; server_no_context_takeover; server_no_context_takeover"));
+    CHECK_FALSE(accepts("permessage-deflate; unknown_parameter"));
+}
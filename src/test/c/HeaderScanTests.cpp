@@ -0,0 +1,126 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/HeaderScan.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <string>
+
+using namespace seasocks;
+
+namespace {
+
+size_t find(const std::string& str, size_t alreadySearched = 0) {
+    return findHeaderTerminator(reinterpret_cast<const uint8_t*>(str.data()), str.size(), alreadySearched);
+}
+
+size_t naiveFind(const std::string& str) {
+    for (size_t i = 0; i + 4 <= str.size(); ++i) {
+        if (str[i] == '\r' && str[i + 1] == '\n' && str[i + 2] == '\r' && str[i + 3] == '\n') {
+            return i;
+        }
+    }
+    return NoHeaderTerminator;
+}
+
+std::string browserHeaders(size_t cookieBytes) {
+    return "GET /app/index.html HTTP/1.1\r\n"
+           "Host: www.example.com\r\n"
+           "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/119.0\r\n"
+           "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+           "Accept-Language: en-GB,en;q=0.5\r\n"
+           "Accept-Encoding: gzip, deflate, br\r\n"
+           "Referer: https://www.example.com/\r\n"
+           "Connection: keep-alive\r\n"
+           "Cookie: session=" + std::string(cookieBytes, 'x') + "\r\n"
+           "Upgrade-Insecure-Requests: 1\r\n"
+           "\r\n";
+}
+
+}
+
+TEST_CASE("finds the end of the headers", "[HeaderScanTests]") {
+    CHECK(find("GET / HTTP/1.1\r\nHost: a\r\n\r\n") == 23);
+    CHECK(find("\r\n\r\n") == 0);
+    CHECK(find("GET / HTTP/1.1\r\n\r\nbody\r\n\r\n") == 14);
+}
+
+TEST_CASE("reports incomplete headers", "[HeaderScanTests]") {
+    CHECK(find("") == NoHeaderTerminator);
+    CHECK(find("\r\n\r") == NoHeaderTerminator);
+    CHECK(find("GET / HTTP/1.1\r\nHost: a\r\n") == NoHeaderTerminator);
+    CHECK(find("GET / HTTP/1.1\n\nHost: a\r\n\n\r\n") == NoHeaderTerminator);
+}
+
+TEST_CASE("resumes where the last search left off", "[HeaderScanTests]") {
+    const std::string headers = "GET / HTTP/1.1\r\nHost: a\r\n\r\n";
+    for (size_t split = 0; split <= headers.size(); ++split) {
+        CAPTURE(split);
+        const auto firstRead = headers.substr(0, split);
+        const auto found = find(firstRead);
+        if (split < headers.size()) {
+            CHECK(found == NoHeaderTerminator);
+            CHECK(find(headers, split) == 23);
+        } else {
+            CHECK(found == 23);
+        }
+    }
+}
+
+TEST_CASE("header scanning", "[HeaderScanTests][.benchmark]") {
+    using Clock = std::chrono::steady_clock;
+    constexpr size_t PacketSize = 64;
+    constexpr int Iterations = 2000;
+    std::cout << "headerBytes naive(us) incremental(us)" << std::endl;
+    for (auto cookieBytes : {0, 256, 1024, 2048}) {
+        const auto headers = browserHeaders(cookieBytes);
+        size_t check = 0;
+        // Headers arriving a packet at a time, searched after each one.
+        const auto naiveStart = Clock::now();
+        for (int i = 0; i < Iterations; ++i) {
+            for (size_t got = PacketSize; got < headers.size() + PacketSize; got += PacketSize) {
+                check += naiveFind(headers.substr(0, got));
+            }
+        }
+        const auto naive = Clock::now() - naiveStart;
+        const auto incrementalStart = Clock::now();
+        for (int i = 0; i < Iterations; ++i) {
+            size_t searched = 0;
+            for (size_t got = PacketSize; got < headers.size() + PacketSize; got += PacketSize) {
+                const auto data = headers.substr(0, got);
+                check += find(data, searched);
+                searched = data.size();
+            }
+        }
+        const auto incremental = Clock::now() - incrementalStart;
+        CHECK(check != 0);
+        std::cout << headers.size() << " "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(naive).count() << " "
+                  << std::chrono::duration_cast<std::chrono::microseconds>(incremental).count() << std::endl;
+    }
+}
@@ -0,0 +1,59 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/KnownHeaders.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cctype>
+#include <string>
+
+using namespace seasocks;
+
+TEST_CASE("recognises every known header", "[KnownHeadersTests]") {
+    for (size_t i = 0; i < NumKnownHeaders; ++i) {
+        auto header = static_cast<KnownHeader>(i);
+        auto name = std::string(knownHeaderName(header));
+        CAPTURE(name);
+        CHECK(knownHeader(name) == header);
+        std::string upper;
+        for (auto c : name) {
+            upper += static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+        }
+        CHECK(knownHeader(upper) == header);
+    }
+}
+
+TEST_CASE("doesn't recognise other headers", "[KnownHeadersTests]") {
+    CHECK(knownHeader("") == KnownHeader::Unknown);
+    CHECK(knownHeader("Accept") == KnownHeader::Unknown);
+    CHECK(knownHeader("Cookie") == KnownHeader::Unknown);
+    CHECK(knownHeader("Hosts") == KnownHeader::Unknown);
+    CHECK(knownHeader("Content-Type") == KnownHeader::Unknown);
+    CHECK(knownHeader("Sec-WebSocket-Key3") == KnownHeader::Unknown);
+    CHECK(knownHeader("Sec-WebSocket-Kez") == KnownHeader::Unknown);
+    CHECK(knownHeader("Accept-Language") == KnownHeader::Unknown);
+    CHECK(knownHeaderName(KnownHeader::Unknown).empty());
+}
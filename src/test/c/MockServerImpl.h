@@ -27,8 +27,11 @@
 
 #include "seasocks/ServerImpl.h"
 
+#include <functional>
 #include <stdexcept>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace seasocks {
 
@@ -38,6 +41,23 @@ public:
 
     std::string staticPath;
     std::unordered_map<std::string, std::shared_ptr<WebSocket::Handler>> handlers;
+    std::unordered_map<std::string, std::shared_ptr<RequestBodyHandler>> bodyHandlers;
+    bool readEvents = true;
+    CompressionPolicy compressionPolicy;
+    // Tests needing a real Server (e.g. for the per-message deflate settings) can provide one.
+    Server* realServer = nullptr;
+    // Offloaded jobs wait here for the test to run them.
+    size_t offloadThreshold = 0;
+    int keepAliveTimeoutSeconds = 0;
+    int keepAliveMaxRequests = 0;
+    std::vector<std::pair<std::function<void()>, std::function<void()>>> offloaded;
+    // Answers page requests, if set.
+    std::function<std::shared_ptr<Response>(const Request&)> pageHandler;
+    std::string date = "Wed, 20 Apr 2011 17:31:28 GMT";
+    HttpCompressionOptions httpCompression;
+    StaticFileCache* fileCache = nullptr;
+    // Vets requests before their bodies are read, if set.
+    std::function<std::shared_ptr<Response>(const Request&)> bodyCheck;
 
     void remove(Connection* /*connection*/) override {
     }
@@ -47,6 +67,14 @@ public:
     bool unsubscribeFromWriteEvents(Connection* /*connection*/) override {
         return false;
     }
+    bool subscribeToReadEvents(Connection* /*connection*/) override {
+        readEvents = true;
+        return true;
+    }
+    bool unsubscribeFromReadEvents(Connection* /*connection*/) override {
+        readEvents = false;
+        return true;
+    }
     const std::string& getStaticPath() const override {
         return staticPath;
     }
@@ -56,11 +84,23 @@ public:
             return std::shared_ptr<WebSocket::Handler>();
         return it->second;
     }
+    std::shared_ptr<RequestBodyHandler> getRequestBodyHandler(const char* endpoint) const override {
+        auto it = bodyHandlers.find(endpoint);
+        if (it == bodyHandlers.end())
+            return std::shared_ptr<RequestBodyHandler>();
+        return it->second;
+    }
     bool isCrossOriginAllowed(const std::string& /*endpoint*/) const override {
         return false;
     }
-    std::shared_ptr<Response> handle(const Request& /*request*/) override {
-        return std::shared_ptr<Response>();
+    const CompressionPolicy& getCompressionPolicy(const std::string& /*endpoint*/) const override {
+        return compressionPolicy;
+    }
+    std::shared_ptr<Response> handle(const Request& request) override {
+        return pageHandler ? pageHandler(request) : std::shared_ptr<Response>();
+    }
+    std::shared_ptr<Response> checkRequestBody(const Request& request) override {
+        return bodyCheck ? bodyCheck(request) : std::shared_ptr<Response>();
     }
     std::string getStatsDocument() const override {
         return "";
@@ -68,11 +108,41 @@ public:
     void checkThread() const override {
     }
     Server& server() override {
-        throw std::runtime_error("not supported");
+        if (!realServer)
+            throw std::runtime_error("not supported");
+        return *realServer;
     };
     size_t clientBufferSize() const override {
         return 512 * 1024;
     }
+    const std::string& httpDate() const override {
+        return date;
+    }
+    int httpKeepAliveTimeoutSeconds() const override {
+        return keepAliveTimeoutSeconds;
+    }
+    int httpKeepAliveMaxRequests() const override {
+        return keepAliveMaxRequests;
+    }
+    StaticFileCache* staticFileCache() override {
+        return fileCache;
+    }
+    const HttpCompressionOptions& httpCompressionOptions() const override {
+        return httpCompression;
+    }
+    size_t compressionOffloadThreshold() const override {
+        return offloadThreshold;
+    }
+    void offload(std::function<void()> work, std::function<void()> done) override {
+        offloaded.emplace_back(std::move(work), std::move(done));
+    }
+    // Runs the oldest offloaded job, as a worker and then the seasocks thread would.
+    void runOffloaded() {
+        auto job = std::move(offloaded.front());
+        offloaded.erase(offloaded.begin());
+        job.first();
+        job.second();
+    }
 };
 
 }
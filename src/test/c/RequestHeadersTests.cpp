@@ -0,0 +1,192 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "AllocationCounter.h"
+#include "internal/HeaderMap.h"
+#include "internal/RequestHeaders.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace seasocks;
+
+namespace {
+
+// Builds headers the way Connection does: copy the block, then split each
+// "Name: value\r\n" line in place.
+RequestHeaders parse(const std::string& block) {
+    auto data = reinterpret_cast<const uint8_t*>(block.data());
+    RequestHeaders headers(data, data + block.size());
+    auto text = reinterpret_cast<char*>(headers.block());
+    size_t pos = 0;
+    while (pos < headers.blockSize()) {
+        auto colon = static_cast<char*>(memchr(text + pos, ':', headers.blockSize() - pos));
+        auto end = static_cast<char*>(memchr(colon, '\r', headers.blockSize() - static_cast<size_t>(colon - text)));
+        auto value = colon + 1;
+        while (*value == ' ') {
+            ++value;
+        }
+        headers.add(std::string_view(text + pos, static_cast<size_t>(colon - text) - pos),
+                    std::string_view(value, static_cast<size_t>(end - value)));
+        pos = static_cast<size_t>(end - text) + 2;
+    }
+    return headers;
+}
+
+const std::vector<std::pair<std::string, std::string>> browserHeaders = {
+    {"Host", "www.example.com"},
+    {"User-Agent", "Mozilla/5.0 (X11; Linux x86_64; rv:109.0) Gecko/20100101 Firefox/119.0"},
+    {"Accept", "text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8"},
+    {"Accept-Language", "en-GB,en;q=0.5"},
+    {"Accept-Encoding", "gzip, deflate, br"},
+    {"Referer", "https://www.example.com/"},
+    {"Connection", "keep-alive, Upgrade"},
+    {"Cookie", "session=0123456789abcdef; theme=dark"},
+    {"Upgrade-Insecure-Requests", "1"},
+    {"Sec-Fetch-Dest", "websocket"},
+    {"Sec-Fetch-Mode", "websocket"},
+    {"Sec-Fetch-Site", "same-origin"},
+    {"Sec-WebSocket-Version", "13"},
+    {"Sec-WebSocket-Key", "dGhlIHNhbXBsZSBub25jZQ=="},
+    {"Sec-WebSocket-Extensions", "permessage-deflate; client_max_window_bits"},
+    {"Origin", "https://www.example.com"},
+    {"Pragma", "no-cache"},
+    {"Cache-Control", "no-cache"},
+    {"Upgrade", "websocket"},
+    {"DNT", "1"},
+};
+
+std::string browserBlock() {
+    std::string block;
+    for (const auto& [name, value] : browserHeaders) {
+        block += name + ": " + value + "\r\n";
+    }
+    return block;
+}
+
+}
+
+TEST_CASE("looks up headers by name", "[RequestHeadersTests]") {
+    auto headers = parse("Host: example.com\r\nContent-Length: 12\r\n");
+    CHECK(headers.size() == 2);
+    CHECK(headers.has("Host"));
+    CHECK(headers.get("Host") == "example.com");
+    CHECK(headers.get("Content-Length") == "12");
+    CHECK_FALSE(headers.has("Origin"));
+    CHECK(headers.get("Origin").empty());
+}
+
+TEST_CASE("header names are case insensitive", "[RequestHeadersTests]") {
+    auto headers = parse("Sec-WebSocket-Key: abc\r\n");
+    CHECK(headers.get("sec-websocket-key") == "abc");
+    CHECK(headers.get("SEC-WEBSOCKET-KEY") == "abc");
+    CHECK_FALSE(headers.has("Sec-WebSocket-Ke"));
+}
+
+TEST_CASE("the first of duplicated headers wins", "[RequestHeadersTests]") {
+    auto headers = parse("Cookie: a=1\r\nCookie: b=2\r\n");
+    CHECK(headers.get("Cookie") == "a=1");
+}
+
+TEST_CASE("empty header values", "[RequestHeadersTests]") {
+    auto headers = parse("X-Empty:\r\nHost: a\r\n");
+    CHECK(headers.has("X-Empty"));
+    CHECK(headers.get("X-Empty").empty());
+    CHECK(headers.get("Host") == "a");
+}
+
+TEST_CASE("well-known headers are looked up by slot", "[RequestHeadersTests]") {
+    auto headers = parse("X-Custom: 1\r\nUPGRADE: websocket\r\nupgrade: other\r\nConnection: Upgrade\r\n");
+    CHECK(headers.get(KnownHeader::Upgrade) == "websocket");
+    CHECK(headers.get("Upgrade") == "websocket");
+    CHECK(headers.get(KnownHeader::Connection) == "Upgrade");
+    CHECK_FALSE(headers.has(KnownHeader::Host));
+    CHECK(headers.get(KnownHeader::Host).empty());
+    CHECK_FALSE(headers.has(KnownHeader::Unknown));
+    CHECK(headers.get("x-custom") == "1");
+}
+
+TEST_CASE("views survive moving the headers", "[RequestHeadersTests]") {
+    std::vector<RequestHeaders> all;
+    all.push_back(parse("Host: a\r\n"));
+    all.push_back(parse("Host: b\r\n"));
+    all.push_back(parse("Host: c\r\n"));
+    RequestHeaders moved(std::move(all[1]));
+    CHECK(all[0].get("Host") == "a");
+    CHECK(moved.get("Host") == "b");
+    CHECK(all[2].get("Host") == "c");
+}
+
+TEST_CASE("storage doesn't grow with the number of headers", "[RequestHeadersTests]") {
+    const auto block = browserBlock();
+    const auto before = allocationCount();
+    auto headers = parse(block);
+    const auto after = allocationCount();
+    CHECK(headers.size() == browserHeaders.size());
+    CHECK(headers.get("Sec-WebSocket-Key") == "dGhlIHNhbXBsZSBub25jZQ==");
+    CHECK(after - before == 2);
+}
+
+TEST_CASE("header storage", "[RequestHeadersTests][.benchmark]") {
+    using Clock = std::chrono::steady_clock;
+    constexpr int Iterations = 20000;
+    const auto block = browserBlock();
+    const char* lookups[] = {"Connection", "Upgrade", "Sec-WebSocket-Key", "Sec-WebSocket-Version",
+                             "Sec-WebSocket-Extensions", "Origin", "Host", "Content-Length"};
+    size_t check = 0;
+
+    const auto mapStart = Clock::now();
+    for (int i = 0; i < Iterations; ++i) {
+        HeaderMap headers(31);
+        for (const auto& [name, value] : browserHeaders) {
+            headers.emplace(name, value);
+        }
+        for (auto name : lookups) {
+            auto iter = headers.find(name);
+            check += iter == headers.end() ? 0 : iter->second.size();
+        }
+    }
+    const auto map = Clock::now() - mapStart;
+
+    const auto flatStart = Clock::now();
+    for (int i = 0; i < Iterations; ++i) {
+        auto headers = parse(block);
+        for (auto name : lookups) {
+            check += headers.get(name).size();
+        }
+    }
+    const auto flat = Clock::now() - flatStart;
+
+    CHECK(check != 0);
+    std::cout << "HeaderMap: " << std::chrono::duration_cast<std::chrono::microseconds>(map).count() << "us, "
+              << "RequestHeaders: " << std::chrono::duration_cast<std::chrono::microseconds>(flat).count() << "us for "
+              << Iterations << " requests of " << browserHeaders.size() << " headers" << std::endl;
+}
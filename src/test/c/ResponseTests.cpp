@@ -65,3 +65,57 @@ TEST_CASE("html response", "[ResponseTests]") {
     CHECK(resp->getAdditionalHeaders().empty() == true);
     CHECK(resp->keepConnectionAlive() == true);
 }
+
+TEST_CASE("status lines", "[ResponseTests]") {
+    CHECK(statusLine(ResponseCode::Ok) == "HTTP/1.1 200 OK\r\n");
+    CHECK(statusLine(ResponseCode::NotFound) == "HTTP/1.1 404 Not Found\r\n");
+    CHECK(statusLine(ResponseCode::PayloadTooLarge) == "HTTP/1.1 413 Payload Too Large\r\n");
+    CHECK(statusLine(static_cast<ResponseCode>(499)).empty());
+}
+
+namespace {
+
+// Only overrides the string header(), so numeric headers come via the default.
+struct RecordingWriter : ResponseWriter {
+    std::vector<std::pair<std::string, std::string>> headers;
+    std::string body;
+    void begin(ResponseCode, TransferEncoding) override {
+    }
+    void header(const std::string& header, const std::string& value) override {
+        headers.emplace_back(header, value);
+    }
+    using ResponseWriter::header;
+    void payload(const void* data, size_t size, bool) override {
+        body.append(static_cast<const char*>(data), size);
+    }
+    void finish(bool) override {
+    }
+    void error(ResponseCode, const std::string&) override {
+    }
+    bool isActive() const override {
+        return true;
+    }
+};
+
+}
+
+TEST_CASE("synchronous responses write their headers", "[ResponseTests]") {
+    ConcreteResponse response(ResponseCode::Ok, "hello", "text/plain", {{"Cache-Control", "max-age=5"}}, true);
+    CHECK(response.storedAdditionalHeaders() != nullptr);
+    auto writer = std::make_shared<RecordingWriter>();
+    response.handle(writer);
+    CHECK(writer->body == "hello");
+    auto value = [&](const std::string& name) {
+        std::vector<std::string> values;
+        for (const auto& header : writer->headers) {
+            if (header.first == name) {
+                values.push_back(header.second);
+            }
+        }
+        return values;
+    };
+    CHECK(value("Content-Length") == std::vector<std::string>{"5"});
+    CHECK(value("Connection") == std::vector<std::string>{"keep-alive"});
+    CHECK(value("Cache-Control") == std::vector<std::string>{"max-age=5"});
+    CHECK(value("Expires").size() == 1);
+}
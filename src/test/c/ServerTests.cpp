@@ -29,8 +29,18 @@
 
 #include <catch2/catch_test_macros.hpp>
 
-#include <thread>
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#include "internal/HybiAccept.h"
+
 #include <chrono>
+#include <string>
+#include <thread>
 
 using namespace seasocks;
 
@@ -79,3 +89,81 @@ TEST_CASE("Server tests", "[ServerTests]") {
     server.terminate();
     seasocksThread.join();
 }
+
+#ifndef _WIN32
+TEST_CASE("Client WebSocket connections", "[ServerTests]") {
+    auto logger = std::make_shared<IgnoringLogger>();
+    Server server(logger);
+    REQUIRE(server.startListening(0));
+    // Make this thread the server thread.
+    REQUIRE(server.poll(0) == Server::PollResult::Continue);
+
+    // Play the part of a remote WebSocket server.
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    REQUIRE(listener != -1);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addressLength = sizeof(address);
+    REQUIRE(::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+    REQUIRE(::listen(listener, 1) == 0);
+    REQUIRE(::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &addressLength) == 0);
+
+    struct Handler : WebSocket::Handler {
+        int connects = 0;
+        std::string received;
+        void onConnect(WebSocket* socket) override {
+            ++connects;
+            socket->send("hello");
+        }
+        void onData(WebSocket*, const char* data) override {
+            received = data;
+        }
+        void onDisconnect(WebSocket*) override {
+        }
+    };
+    auto handler = std::make_shared<Handler>();
+    auto* webSocket = server.connectWebSocket("127.0.0.1", ntohs(address.sin_port), "/ws", handler);
+    REQUIRE(webSocket);
+    int remote = ::accept(listener, nullptr, nullptr);
+    REQUIRE(remote != -1);
+
+    auto receive = [&](size_t atLeast) {
+        std::string data;
+        char buf[1024];
+        for (int i = 0; i < 100 && data.size() < atLeast; ++i) {
+            server.poll(10);
+            ssize_t numRead;
+            while ((numRead = ::recv(remote, buf, sizeof(buf), MSG_DONTWAIT)) > 0) {
+                data.append(buf, static_cast<size_t>(numRead));
+            }
+        }
+        return data;
+    };
+    auto request = receive(1);
+    for (int i = 0; i < 100 && request.find("\r\n\r\n") == std::string::npos; ++i) {
+        request += receive(request.size() + 1);
+    }
+    static const std::string keyHeader = "Sec-WebSocket-Key: ";
+    auto keyPos = request.find(keyHeader);
+    REQUIRE(keyPos != std::string::npos);
+    keyPos += keyHeader.size();
+    auto key = request.substr(keyPos, request.find("\r\n", keyPos) - keyPos);
+    std::string response = "HTTP/1.1 101 Switching Protocols\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Sec-WebSocket-Accept: " +
+                           getAcceptKey(key) + "\r\n\r\n\x81\x02hi";
+    REQUIRE(::send(remote, response.data(), response.size(), 0) == static_cast<ssize_t>(response.size()));
+
+    // 2 byte header, 4 byte mask and "hello".
+    auto frame = receive(11);
+    CHECK(handler->connects == 1);
+    CHECK(handler->received == "hi");
+    REQUIRE(frame.size() == 11);
+    CHECK(static_cast<uint8_t>(frame[1]) == (0x80 | 5));
+
+    ::close(remote);
+    ::close(listener);
+}
+#endif
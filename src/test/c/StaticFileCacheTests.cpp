@@ -0,0 +1,193 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/StaticFileCache.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+
+using namespace seasocks;
+
+namespace {
+
+struct TempDir {
+    std::string path;
+    std::vector<std::string> files;
+    TempDir() {
+        char name[] = "/tmp/seasocksXXXXXX";
+        REQUIRE(::mkdtemp(name));
+        path = name;
+    }
+    ~TempDir() {
+        for (const auto& file : files)
+            ::unlink(file.c_str());
+        ::rmdir(path.c_str());
+    }
+    std::string write(const std::string& name, const std::string& contents) {
+        auto file = path + "/" + name;
+        std::ofstream(file, std::ios::binary | std::ios::trunc) << contents;
+        files.push_back(file);
+        return file;
+    }
+};
+
+std::string contents(const StaticFileCache::File& file) {
+    return std::string(reinterpret_cast<const char*>(file.data()), file.size());
+}
+
+StaticFileCacheOptions testOptions() {
+    StaticFileCacheOptions options;
+    options.enabled = true;
+    options.memoryBudget = 100;
+    options.maxFileSize = 80;
+    options.revalidateInterval = std::chrono::milliseconds(0);
+    return options;
+}
+
+}
+
+TEST_CASE("caches files", "[StaticFileCacheTests]") {
+    TempDir dir;
+    StaticFileCache cache(testOptions());
+    auto small = dir.write("small.js", "var x = 1;");
+    auto big = dir.write("big.js", std::string(60, 'x'));
+
+    auto file = cache.get(small);
+    REQUIRE(file);
+    CHECK(contents(*file) == "var x = 1;");
+    CHECK(cache.get(small) == file);
+
+    auto bigFile = cache.get(big);
+    REQUIRE(bigFile);
+    CHECK(contents(*bigFile) == std::string(60, 'x'));
+    CHECK(cache.numFiles() == 2);
+    CHECK(cache.memoryUsed() == 70);
+}
+
+TEST_CASE("files truncated in place are still served in full", "[StaticFileCacheTests]") {
+    TempDir dir;
+    auto options = testOptions();
+    options.revalidateInterval = std::chrono::hours(1);
+    StaticFileCache cache(options);
+    auto path = dir.write("big.js", std::string(60, 'x'));
+    auto file = cache.get(path);
+    REQUIRE(file);
+    REQUIRE(::truncate(path.c_str(), 0) == 0);
+    CHECK(contents(*cache.get(path)) == std::string(60, 'x'));
+}
+
+TEST_CASE("keeps compressed copies", "[StaticFileCacheTests]") {
+    TempDir dir;
+    StaticFileCache cache(testOptions());
+    auto a = dir.write("a.js", std::string(40, 'a'));
+    auto b = dir.write("b.js", std::string(40, 'b'));
+    auto fileA = cache.get(a);
+    REQUIRE(fileA);
+    CHECK_FALSE(fileA->encoded(ContentEncoding::Gzip));
+
+    const auto& stored = cache.storeEncoded(*fileA, ContentEncoding::Gzip, std::vector<uint8_t>(5, 'z'));
+    CHECK(fileA->encoded(ContentEncoding::Gzip) == &stored);
+    CHECK(stored.size() == 5);
+    CHECK_FALSE(fileA->encoded(ContentEncoding::Deflate));
+    CHECK(cache.memoryUsed() == 45);
+
+    // Compressed copies count towards the budget, and go with their file.
+    auto fileB = cache.get(b);
+    cache.storeEncoded(*fileB, ContentEncoding::Deflate, std::vector<uint8_t>(20, 'z'));
+    CHECK(cache.numFiles() == 1);
+    CHECK(cache.memoryUsed() == 60);
+    CHECK(cache.get(b) == fileB);
+    CHECK(fileA->encoded(ContentEncoding::Gzip) == &stored);
+}
+
+TEST_CASE("leaves files it can't cache", "[StaticFileCacheTests]") {
+    TempDir dir;
+    StaticFileCache cache(testOptions());
+    CHECK_FALSE(cache.get(dir.path + "/missing.js"));
+    CHECK_FALSE(cache.get(dir.path));
+    CHECK_FALSE(cache.get(dir.write("huge.js", std::string(81, 'x'))));
+    CHECK(cache.numFiles() == 0);
+}
+
+TEST_CASE("notices changed files", "[StaticFileCacheTests]") {
+    TempDir dir;
+    StaticFileCache cache(testOptions());
+    auto path = dir.write("app.js", "one");
+    auto first = cache.get(path);
+    REQUIRE(first);
+
+    SECTION("rewritten") {
+        dir.write("app.js", "three");
+    }
+    SECTION("replaced") {
+        auto replacement = dir.write("new.js", "two");
+        REQUIRE(::rename(replacement.c_str(), path.c_str()) == 0);
+    }
+    auto second = cache.get(path);
+    REQUIRE(second);
+    CHECK(second != first);
+    CHECK(contents(*second) != "one");
+    // Anyone still sending the old version can finish.
+    CHECK(contents(*first) == "one");
+    CHECK(cache.memoryUsed() == second->size());
+}
+
+TEST_CASE("only checks for changes occasionally", "[StaticFileCacheTests]") {
+    TempDir dir;
+    auto options = testOptions();
+    options.revalidateInterval = std::chrono::hours(1);
+    StaticFileCache cache(options);
+    auto path = dir.write("app.js", "one");
+    auto first = cache.get(path);
+    dir.write("app.js", "three");
+    CHECK(cache.get(path) == first);
+}
+
+TEST_CASE("evicts the least recently used files", "[StaticFileCacheTests]") {
+    TempDir dir;
+    StaticFileCache cache(testOptions());
+    auto a = dir.write("a.js", std::string(40, 'a'));
+    auto b = dir.write("b.js", std::string(40, 'b'));
+    auto c = dir.write("c.js", std::string(40, 'c'));
+    auto fileA = cache.get(a);
+    auto fileB = cache.get(b);
+    CHECK(cache.get(a) == fileA);
+    auto fileC = cache.get(c);
+    CHECK(cache.numFiles() == 2);
+    CHECK(cache.memoryUsed() == 80);
+    CHECK(cache.get(a) == fileA);
+    CHECK(cache.get(c) == fileC);
+    CHECK(cache.get(b) != fileB);
+    CHECK(contents(*fileB) == std::string(40, 'b'));
+}
+#endif
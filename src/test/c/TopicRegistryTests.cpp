@@ -0,0 +1,106 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/TopicRegistry.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+using namespace seasocks;
+
+namespace {
+
+// The registry never dereferences the sockets, so any distinct addresses will do.
+WebSocket* fakeSocket(int n) {
+    static char sockets[8];
+    return reinterpret_cast<WebSocket*>(&sockets[n]);
+}
+
+}
+
+TEST_CASE("Subscribing and unsubscribing", "[TopicRegistryTests]") {
+    TopicRegistry registry;
+    auto* topic = registry.subscribe(fakeSocket(0), "prices");
+    REQUIRE(topic);
+    CHECK(registry.subscribe(fakeSocket(1), "prices") == topic);
+    CHECK(registry.subscribe(fakeSocket(0), "prices") == nullptr);
+    CHECK(topic->subscribers.size() == 2);
+
+    CHECK(registry.unsubscribe(fakeSocket(0), "prices"));
+    CHECK_FALSE(registry.unsubscribe(fakeSocket(0), "prices"));
+    CHECK_FALSE(registry.unsubscribe(fakeSocket(2), "prices"));
+    REQUIRE(registry.find("prices"));
+    CHECK(registry.find("prices")->subscribers == std::vector<WebSocket*>{fakeSocket(1)});
+
+    CHECK(registry.unsubscribe(fakeSocket(1), "prices"));
+    CHECK(registry.find("prices") == nullptr);
+    CHECK(registry.numTopics() == 0);
+}
+
+TEST_CASE("Disconnected sockets leave all their topics", "[TopicRegistryTests]") {
+    TopicRegistry registry;
+    registry.subscribe(fakeSocket(0), "a");
+    registry.subscribe(fakeSocket(0), "b");
+    registry.subscribe(fakeSocket(1), "b");
+    registry.unsubscribeAll(fakeSocket(0));
+    CHECK(registry.find("a") == nullptr);
+    REQUIRE(registry.find("b"));
+    CHECK(registry.find("b")->subscribers == std::vector<WebSocket*>{fakeSocket(1)});
+    registry.unsubscribeAll(fakeSocket(0));
+    CHECK(registry.numTopics() == 1);
+}
+
+TEST_CASE("Subscribers moved into a gap can still leave", "[TopicRegistryTests]") {
+    TopicRegistry registry;
+    for (int i = 0; i < 4; ++i) {
+        registry.subscribe(fakeSocket(i), "a");
+        registry.subscribe(fakeSocket(i), "b");
+    }
+    // Socket 3 is moved into socket 1's place in both topics...
+    CHECK(registry.unsubscribe(fakeSocket(1), "a"));
+    registry.unsubscribeAll(fakeSocket(1));
+    CHECK(registry.find("a")->subscribers ==
+          std::vector<WebSocket*>{fakeSocket(0), fakeSocket(3), fakeSocket(2)});
+    // ...and must be removed from there, not from where it was.
+    CHECK(registry.unsubscribe(fakeSocket(3), "a"));
+    CHECK(registry.find("a")->subscribers == std::vector<WebSocket*>{fakeSocket(0), fakeSocket(2)});
+    registry.unsubscribeAll(fakeSocket(3));
+    CHECK(registry.find("b")->subscribers == std::vector<WebSocket*>{fakeSocket(0), fakeSocket(2)});
+    registry.unsubscribeAll(fakeSocket(0));
+    registry.unsubscribeAll(fakeSocket(2));
+    CHECK(registry.numTopics() == 0);
+}
+
+TEST_CASE("Retained values outlive subscribers", "[TopicRegistryTests]") {
+    TopicRegistry registry;
+    auto& topic = registry.findOrCreate("status");
+    topic.hasRetained = true;
+    topic.retained = "up";
+    registry.subscribe(fakeSocket(0), "status");
+    registry.unsubscribeAll(fakeSocket(0));
+    REQUIRE(registry.find("status"));
+    CHECK(registry.find("status")->retained == "up");
+    registry.clearRetained("status");
+    CHECK(registry.find("status") == nullptr);
+}
@@ -0,0 +1,77 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "internal/Utf8.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <string>
+
+using namespace seasocks;
+
+namespace {
+
+bool valid(const std::string& str) {
+    return isValidUtf8(reinterpret_cast<const uint8_t*>(str.data()), str.size());
+}
+
+}
+
+TEST_CASE("Valid UTF-8 is accepted", "[Utf8Tests]") {
+    CHECK(valid(""));
+    CHECK(valid("plain ASCII"));
+    CHECK(valid("caf\xc3\xa9"));
+    CHECK(valid("\xe2\x82\xac 100"));
+    CHECK(valid("\xf0\x9f\x98\x80"));
+    CHECK(valid("\xed\x9f\xbf"));         // U+D7FF, just below the surrogates
+    CHECK(valid("\xf4\x8f\xbf\xbf"));     // U+10FFFF
+    CHECK(valid(std::string("nul\0byte", 8)));
+}
+
+TEST_CASE("Invalid UTF-8 is rejected", "[Utf8Tests]") {
+    CHECK_FALSE(valid("\x80"));               // Lone continuation byte
+    CHECK_FALSE(valid("\xc3"));               // Truncated
+    CHECK_FALSE(valid("\xe2\x82"));           // Truncated
+    CHECK_FALSE(valid("\xc0\xaf"));           // Overlong '/'
+    CHECK_FALSE(valid("\xe0\x80\xaf"));       // Overlong '/'
+    CHECK_FALSE(valid("\xf0\x80\x80\xaf"));   // Overlong '/'
+    CHECK_FALSE(valid("\xed\xa0\x80"));       // Surrogate U+D800
+    CHECK_FALSE(valid("\xf4\x90\x80\x80"));   // U+110000
+    CHECK_FALSE(valid("\xf5\x80\x80\x80"));
+    CHECK_FALSE(valid("\xff"));
+    CHECK_FALSE(valid("\xc3\x28"));           // Bad continuation
+    CHECK_FALSE(valid("\xe2\x28\xa1"));
+    CHECK_FALSE(valid("\xf0\x9f\x98\x28"));
+}
+
+TEST_CASE("UTF-8 errors are found at any offset", "[Utf8Tests]") {
+    // Exercise both the vectorised ASCII skipping and the byte at a time tail.
+    for (size_t prefix = 0; prefix < 40; ++prefix) {
+        std::string ascii(prefix, 'a');
+        CHECK(valid(ascii + "\xe2\x82\xac" + ascii));
+        CHECK_FALSE(valid(ascii + "\x80" + ascii));
+        CHECK_FALSE(valid(ascii + "\xe2\x82"));
+    }
+}
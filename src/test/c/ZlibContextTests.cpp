@@ -0,0 +1,174 @@
+// Copyright (c) 2013-2017, Matt Godbolt
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer.
+//
+// Redistributions in binary form must reproduce the above copyright notice,
+// this list of conditions and the following disclaimer in the documentation
+// and/or other materials provided with the distribution.
+//
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+// AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+// IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+// ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+// LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+// CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+// SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+// INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+// CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+// ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "seasocks/ZlibContext.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <iostream>
+#include <string>
+
+using namespace seasocks;
+
+namespace {
+
+std::vector<uint8_t> makeJson(size_t numObjects) {
+    std::string json = "[";
+    for (size_t i = 0; i < numObjects; ++i) {
+        json += R"({"instrument":"ABC)" + std::to_string(i % 17) + R"(","bid":)" + std::to_string(i * 7 % 1000)
+                + R"(,"ask":)" + std::to_string(i * 11 % 1000) + "},";
+    }
+    json += "{}]";
+    return {json.begin(), json.end()};
+}
+
+// Compresses with one context and decompresses with another, as a client would.
+void roundTrip(ZlibContext& server, ZlibContext& client, const std::vector<uint8_t>& message) {
+    std::vector<uint8_t> compressed;
+    server.deflate(message.data(), message.size(), compressed);
+    std::vector<uint8_t> decompressed;
+    int zlibError = 0;
+    REQUIRE(client.inflate(compressed, decompressed, zlibError));
+    CHECK(decompressed == message);
+}
+
+size_t memoryAfterTraffic(int windowBits, int memLevel, bool noContextTakeover) {
+    ZlibContext server;
+    ZlibContext client;
+    server.initialise(windowBits, windowBits, memLevel, noContextTakeover, noContextTakeover);
+    client.initialise(windowBits, windowBits, memLevel, noContextTakeover, noContextTakeover);
+    auto message = makeJson(500);
+    roundTrip(server, client, message);
+    roundTrip(client, server, message);
+    return server.memoryUsage();
+}
+
+}
+
+TEST_CASE("round trips", "[ZlibContextTests]") {
+    ZlibContext server;
+    ZlibContext client;
+    server.initialise();
+    client.initialise();
+    roundTrip(server, client, makeJson(1));
+    roundTrip(server, client, makeJson(1000));
+    roundTrip(server, client, {});
+}
+
+TEST_CASE("round trips without context takeover", "[ZlibContextTests]") {
+    ZlibContext server;
+    ZlibContext client;
+    server.initialise(9, 9, 1, true, true);
+    client.initialise(9, 9, 1, true, true);
+    for (int i = 0; i < 3; ++i) {
+        roundTrip(server, client, makeJson(100));
+    }
+}
+
+TEST_CASE("no context takeover doesn't reference previous messages", "[ZlibContextTests]") {
+    ZlibContext server;
+    server.initialise(15, 15, 6, true, false);
+    auto message = makeJson(10);
+    std::vector<uint8_t> first;
+    std::vector<uint8_t> second;
+    server.deflate(message.data(), message.size(), first);
+    server.deflate(message.data(), message.size(), second);
+    CHECK(first == second);
+
+    // A fresh inflater must be able to decode the second message on its own.
+    ZlibContext client;
+    client.initialise();
+    std::vector<uint8_t> decompressed;
+    int zlibError = 0;
+    REQUIRE(client.inflate(second, decompressed, zlibError));
+    CHECK(decompressed == message);
+}
+
+TEST_CASE("preset dictionaries help small messages", "[ZlibContextTests]") {
+    auto message = makeJson(1);
+    auto compressedSize = [&](bool useDictionary) {
+        ZlibContext server;
+        ZlibContext client;
+        server.initialise(15, 15, 6, true, true);
+        client.initialise(15, 15, 6, true, true);
+        if (useDictionary) {
+            auto dictionary = makeJson(3);
+            server.setDictionary(dictionary.data(), dictionary.size());
+            client.setDictionary(dictionary.data(), dictionary.size());
+        }
+        std::vector<uint8_t> compressed;
+        for (int i = 0; i < 3; ++i) {
+            // Each message relies on the dictionary again after the reset.
+            roundTrip(server, client, message);
+            roundTrip(client, server, message);
+        }
+        server.deflate(message.data(), message.size(), compressed);
+        return compressed.size();
+    };
+    auto plain = compressedSize(false);
+    auto primed = compressedSize(true);
+    CHECK(primed * 2 < plain);
+}
+
+TEST_CASE("smaller windows use less memory", "[ZlibContextTests]") {
+    auto full = memoryAfterTraffic(15, 8, false);
+    auto small = memoryAfterTraffic(9, 1, true);
+    CHECK(full > 0);
+    CHECK(small * 8 < full);
+}
+
+TEST_CASE("memory per connection", "[ZlibContextTests][.benchmark]") {
+    std::cout << "windowBits memLevel bytes/connection" << std::endl;
+    for (auto windowBits : {15, 13, 11, 9}) {
+        for (auto memLevel : {8, 6, 4, 1}) {
+            std::cout << windowBits << " " << memLevel << " "
+                      << memoryAfterTraffic(windowBits, memLevel, true) << std::endl;
+        }
+    }
+}
+
+TEST_CASE("inflated output can be capped", "[ZlibContextTests]") {
+    ZlibContext server;
+    server.initialise(15, 15, 6, true, true);
+    const std::vector<uint8_t> message(1024 * 1024, 'x');
+    std::vector<uint8_t> compressed;
+    server.deflate(message.data(), message.size(), compressed);
+    REQUIRE(compressed.size() < 4096);
+
+    ZlibContext client;
+    client.initialise(15, 15, 6, true, true);
+    auto copy = compressed;
+    std::vector<uint8_t> decompressed;
+    int zlibError = -1;
+    CHECK_FALSE(client.inflate(copy, decompressed, zlibError, 64 * 1024));
+    CHECK(zlibError == 0);
+    CHECK(decompressed.size() <= 64 * 1024);
+
+    ZlibContext another;
+    another.initialise(15, 15, 6, true, true);
+    decompressed.clear();
+    REQUIRE(another.inflate(compressed, decompressed, zlibError, message.size()));
+    CHECK(decompressed == message);
+}